@@ -44,6 +44,8 @@ AssetLibrary::AssetLibrary()
     for (int i = 0; i < kMelodyCount; ++i)
         melodyFeatures[(size_t) i] = computeFeatures(melodyTemplates[(size_t) i]);
 
+    markovModel.train(*this);
+
     for (int i = 0; i < kPresetCount; ++i)
     {
         const auto json = getPresetJson(i);
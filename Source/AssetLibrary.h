@@ -1,6 +1,7 @@
 #pragma once
 
 #include "JuceIncludes.h"
+#include "MarkovMelody.h"
 #include "MelodyGenerator.h"
 #include "MFPRConstants.h"
 
@@ -40,6 +41,9 @@ public:
     const TemplateSequence& getChordTemplate(int index) const;
     const TemplateSequence& getMelodyTemplate(int index) const;
 
+    // Trained from the melody templates when the library is constructed.
+    const MarkovMelodyModel& getMarkovModel() const { return markovModel; }
+
     juce::String getPresetJson(int index) const;
     juce::String getPresetName(int index) const;
 
@@ -64,6 +68,8 @@ private:
     std::array<Features, kChordCount> chordFeatures;
     std::array<Features, kMelodyCount> melodyFeatures;
 
+    MarkovMelodyModel markovModel;
+
     std::array<juce::String, kPresetCount> presetNames;
 };
 } // namespace mfpr
@@ -0,0 +1,174 @@
+#include "BatchGenerator.h"
+#include "AssetLibrary.h"
+#include "WorkerPool.h"
+
+namespace mfpr
+{
+static BatchGenerator::IntRange clampRange(BatchGenerator::IntRange r, int lo, int hi)
+{
+    r.first = juce::jlimit(lo, hi, r.first);
+    r.last = juce::jlimit(lo, hi, r.last);
+    return r;
+}
+
+BatchGenerator::Grid BatchGenerator::sanitise(const Grid& grid)
+{
+    auto g = grid;
+    g.genres = clampRange(g.genres, 0, kNumGenres - 1);
+    g.keys = clampRange(g.keys, 0, int(kKeys.size()) - 1);
+    g.modes = clampRange(g.modes, 0, kNumModes - 1);
+    g.lengths = clampRange(g.lengths, 0, int(kLengths.size()) - 1);
+    g.types = clampRange(g.types, 0, int(kTypes.size()) - 1);
+    g.seeds.first = juce::jmax(0, g.seeds.first);
+    return g;
+}
+
+static juce::String legalName(const juce::String& s)
+{
+    return juce::File::createLegalFileName(s.replace("#", "sharp").replace(" ", "_"));
+}
+
+juce::int64 BatchGenerator::Grid::getNumPatterns() const
+{
+    // Sizes in 64 bits: a range spanning all ints has one more entry than int can hold.
+    const auto size = [](const IntRange& r) { return juce::jmax<juce::int64>(0, juce::int64(r.last) - r.first + 1); };
+    return size(genres) * size(keys) * size(modes) * size(lengths) * size(types) * size(seeds);
+}
+
+GenerationParams BatchGenerator::paramsForIndex(const Grid& grid, int index)
+{
+    // Mixed-radix decode, seeds varying fastest.
+    int rest = juce::jmax(0, index);
+    auto take = [&rest](const IntRange& r)
+    {
+        const int n = juce::jmax(1, r.size());
+        const int v = r.first + rest % n;
+        rest /= n;
+        return v;
+    };
+
+    GenerationParams p;
+    p.seed = (uint32_t) take(grid.seeds);
+    p.type = (GeneratorType) take(grid.types);
+    p.lengthBars = kLengths[(size_t) take(grid.lengths)].getIntValue();
+    p.modeIndex = take(grid.modes);
+    p.keyIndex = take(grid.keys);
+    p.genreIndex = take(grid.genres);
+    p.melodyFollowChordChance = (p.type == GeneratorType::hybrid) ? 0.80f : 0.0f;
+    return p;
+}
+
+juce::File BatchGenerator::fileForParams(const juce::File& outputDir, const GenerationParams& params)
+{
+    const auto& genre = kGenres[(size_t) params.genreIndex];
+    const auto name = legalName(genre) + "_" + legalName(kKeys[(size_t) params.keyIndex]) + "_"
+                      + legalName(kModes[(size_t) params.modeIndex]) + "_" + juce::String(params.lengthBars) + "bar_"
+                      + kTypes[(size_t) params.type] + "_" + juce::String(params.seed) + ".mid";
+
+    return outputDir.getChildFile(legalName(genre)).getChildFile(name);
+}
+
+BatchGenerator::Result BatchGenerator::run(AssetLibrary& library,
+                                           const Grid& requestedGrid,
+                                           const Settings& settings,
+                                           WorkerPool* pool,
+                                           ProgressCallback onProgress)
+{
+    Result result;
+
+    const auto grid = sanitise(requestedGrid);
+    const auto numPatterns = grid.getNumPatterns();
+    if (numPatterns > kMaxPatterns)
+    {
+        result.error = "The grid has " + juce::String(numPatterns) + " patterns, more than the "
+                       + juce::String(kMaxPatterns) + " one run can generate.";
+        return result;
+    }
+
+    const int total = (int) numPatterns;
+    if (total <= 0)
+        return result;
+
+    const auto startMs = juce::Time::getMillisecondCounterHiRes();
+
+    // Create the per-genre folders up front so workers only ever create files.
+    for (int g = grid.genres.first; g <= grid.genres.last; ++g)
+        settings.outputDir.getChildFile(legalName(kGenres[(size_t) g])).createDirectory();
+
+    MelodyGenerator generator;
+    std::vector<std::unique_ptr<CandidateSearch>> searches((size_t) (pool != nullptr ? pool->getMaxConcurrency() : 1));
+
+    std::atomic<int> written { 0 };
+    std::atomic<int> failed { 0 };
+    std::atomic<int> done { 0 };
+    std::atomic<bool> cancelled { false };
+
+    const int progressInterval = juce::jmax(1, total / 100);
+    juce::CriticalSection progressLock;
+    int lastReported = 0;
+
+    auto generateOne = [&](int index, int slot)
+    {
+        if (cancelled.load())
+            return;
+
+        const auto params = paramsForIndex(grid, index);
+
+        GeneratedPattern pattern;
+        if (settings.candidates > 1)
+        {
+            auto& search = searches[(size_t) slot];
+            if (search == nullptr)
+                search = std::make_unique<CandidateSearch>();
+
+            CandidateSearchSettings cs;
+            cs.numCandidates = settings.candidates;
+            cs.scoringModel = settings.scoringModel;
+            pattern = search->run(generator, params, settings.rootNote, settings.velocity, settings.channel, library, cs, nullptr);
+        }
+        else
+        {
+            pattern = generator.generate(params, settings.rootNote, settings.velocity, settings.channel, library);
+        }
+
+        bool ok = false;
+        {
+            juce::FileOutputStream out(fileForParams(settings.outputDir, params));
+            if (out.openedOk())
+            {
+                out.setPosition(0);
+                out.truncate();
+                ok = MidiExporter::writePatternToStream(pattern, out, settings.midi);
+            }
+        }
+        (ok ? written : failed).fetch_add(1);
+
+        const int completed = done.fetch_add(1) + 1;
+        if (onProgress != nullptr && (completed % progressInterval == 0 || completed == total))
+        {
+            const juce::ScopedLock sl(progressLock);
+            if (completed > lastReported)
+            {
+                lastReported = completed;
+                if (!onProgress(completed, total))
+                    cancelled.store(true);
+            }
+        }
+    };
+
+    if (pool != nullptr)
+    {
+        pool->parallelFor(total, generateOne);
+    }
+    else
+    {
+        for (int i = 0; i < total; ++i)
+            generateOne(i, 0);
+    }
+
+    result.written = written.load();
+    result.failed = failed.load();
+    result.seconds = (juce::Time::getMillisecondCounterHiRes() - startMs) / 1000.0;
+    return result;
+}
+} // namespace mfpr
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "CandidateSearch.h"
+#include "MFPRConstants.h"
+#include "MelodyGenerator.h"
+#include "MidiExporter.h"
+
+namespace mfpr
+{
+class AssetLibrary;
+class ScoringModel;
+class WorkerPool;
+
+// Headless generation of a whole parameter grid to .mid files (offline pack building).
+class BatchGenerator final
+{
+public:
+    struct IntRange
+    {
+        int first = 0;
+        int last = 0; // inclusive
+
+        int size() const { return juce::jmax(0, last - first + 1); }
+    };
+
+    // Every combination of these ranges is generated once. Ranges are indices into
+    // kGenres / kKeys / kModes / kLengths / kTypes; seeds are raw generator seeds.
+    struct Grid
+    {
+        IntRange genres { 0, kNumGenres - 1 };
+        IntRange keys { 0, 11 };
+        IntRange modes { 0, 1 };
+        IntRange lengths { 0, 0 };
+        IntRange types { 0, 2 };
+        IntRange seeds { 1, 1 };
+
+        juce::int64 getNumPatterns() const;
+    };
+
+    struct Settings
+    {
+        juce::File outputDir;
+        int rootNote = 60;
+        int velocity = 100;
+        int channel = 1;
+        int candidates = 1; // >1 keeps the best of N seeds per file, like the Generate button
+        const ScoringModel* scoringModel = nullptr; // ranks the candidates (see CandidateSearchSettings)
+        MidiExporter::Settings midi;
+    };
+
+    struct Result
+    {
+        int written = 0;
+        int failed = 0;
+        double seconds = 0.0;
+        juce::String error; // set if the grid was rejected and nothing was generated
+    };
+
+    // Patterns are indexed with int, so larger grids are rejected rather than truncated.
+    static constexpr juce::int64 kMaxPatterns = std::numeric_limits<int>::max();
+
+    // Called from worker threads (never concurrently, with increasing counts) roughly
+    // every 1% of the grid. Return false to cancel the remaining work.
+    using ProgressCallback = std::function<bool(int done, int total)>;
+
+    // Work is spread over the pool (or done on the calling thread if pool is null).
+    // Each file is rendered and written by the thread that generated it, so memory
+    // stays at one pattern per thread however large the grid is.
+    static Result run(AssetLibrary& library,
+                      const Grid& grid,
+                      const Settings& settings,
+                      WorkerPool* pool,
+                      ProgressCallback onProgress = nullptr);
+
+    // The grid run() generates: ranges clamped to the menu indices, seeds to non-negative values.
+    static Grid sanitise(const Grid& grid);
+
+    static GenerationParams paramsForIndex(const Grid& grid, int index);
+    static juce::File fileForParams(const juce::File& outputDir, const GenerationParams& params);
+};
+} // namespace mfpr
@@ -0,0 +1,145 @@
+#include "CandidateSearch.h"
+#include "AssetLibrary.h"
+#include "ScoringModel.h"
+#include "WorkerPool.h"
+
+namespace mfpr
+{
+CandidateSearch::CandidateSearch()
+{
+    candidates.resize((size_t) CandidateSearchSettings::kMaxCandidates);
+}
+
+const GeneratedPattern& CandidateSearch::run(const MelodyGenerator& generator,
+                                             const GenerationParams& params,
+                                             int inputRootMidiNote,
+                                             int inputVelocity,
+                                             int outputChannel,
+                                             AssetLibrary& library,
+                                             const CandidateSearchSettings& settings,
+                                             WorkerPool* pool)
+{
+    if (settings.scoringModel != nullptr && settings.scoringModel->hasWeightsFor(params.genreIndex))
+        return runWithModel(generator, params, inputRootMidiNote, inputVelocity, outputChannel, library, settings, pool);
+
+    const int count = juce::jlimit(1, CandidateSearchSettings::kMaxCandidates, settings.numCandidates);
+    const uint32_t baseSeed = params.seed;
+
+    // Lowest candidate index that reached the early-stop score; nothing above it can matter.
+    std::atomic<int> stopIndex { count - 1 };
+
+    constexpr auto notFinished = -std::numeric_limits<double>::infinity();
+    for (int i = 0; i < count; ++i)
+        finishedScores[(size_t) i].store(notFinished);
+
+    auto evaluate = [&](int i, int)
+    {
+        if (i > stopIndex.load())
+            return;
+
+        auto p = params;
+        p.seed = baseSeed + uint32_t(i);
+
+        // Only lower seeds may bound this one: a higher seed could lie past the early stop,
+        // and ties go to the lower seed, so i has to score strictly above all of them to win.
+        double scoreToBeat = notFinished;
+        if (settings.branchAndBound)
+            for (int j = 0; j < i; ++j)
+                scoreToBeat = std::max(scoreToBeat, finishedScores[(size_t) j].load(std::memory_order_relaxed));
+
+        auto& c = candidates[(size_t) i];
+        c.score = generator.generateScored(c.pattern, p, inputRootMidiNote, inputVelocity, outputChannel, library, scoreToBeat);
+        finishedScores[(size_t) i].store(c.score, std::memory_order_relaxed);
+
+        if (c.score >= settings.earlyStopScore)
+        {
+            int current = stopIndex.load();
+            while (i < current && !stopIndex.compare_exchange_weak(current, i))
+            {
+            }
+        }
+    };
+
+    if (pool != nullptr)
+    {
+        pool->parallelFor(count, evaluate);
+    }
+    else
+    {
+        for (int i = 0; i < count && i <= stopIndex.load(); ++i)
+            evaluate(i, 0);
+    }
+
+    // Reduce in seed order with a strict comparison so ties resolve like the serial loop.
+    // Abandoned candidates score -inf and never win.
+    const int last = stopIndex.load();
+    int bestIndex = 0;
+    numAbandoned = 0;
+    for (int i = 1; i <= last; ++i)
+    {
+        if (candidates[(size_t) i].score == notFinished)
+            ++numAbandoned;
+        else if (candidates[(size_t) i].score > candidates[(size_t) bestIndex].score)
+            bestIndex = i;
+    }
+
+    return candidates[(size_t) bestIndex].pattern;
+}
+
+const GeneratedPattern& CandidateSearch::runWithModel(const MelodyGenerator& generator,
+                                                      const GenerationParams& params,
+                                                      int inputRootMidiNote,
+                                                      int inputVelocity,
+                                                      int outputChannel,
+                                                      AssetLibrary& library,
+                                                      const CandidateSearchSettings& settings,
+                                                      WorkerPool* pool)
+{
+    const int count = juce::jlimit(1, CandidateSearchSettings::kMaxCandidates, settings.numCandidates);
+    const int concurrency = pool != nullptr ? pool->getMaxConcurrency() : 1;
+    const int chunkSize = juce::jlimit(1, 16, (count + concurrency - 1) / concurrency);
+    const int numChunks = (count + chunkSize - 1) / chunkSize;
+
+    // Each chunk generates its candidates, then scores them in one batched call.
+    auto evaluateChunk = [&](int chunk, int)
+    {
+        const int first = chunk * chunkSize;
+        const int n = juce::jmin(chunkSize, count - first);
+
+        std::array<const GeneratedPattern*, 16> patterns {};
+        std::array<double, 16> scores {};
+        for (int i = 0; i < n; ++i)
+        {
+            auto p = params;
+            p.seed = params.seed + uint32_t(first + i);
+
+            auto& c = candidates[(size_t) (first + i)];
+            generator.generateInto(c.pattern, p, inputRootMidiNote, inputVelocity, outputChannel, library);
+            patterns[(size_t) i] = &c.pattern;
+        }
+
+        settings.scoringModel->scoreBatch(patterns.data(), n, params, scores.data());
+        for (int i = 0; i < n; ++i)
+            candidates[(size_t) (first + i)].score = scores[(size_t) i];
+    };
+
+    if (pool != nullptr)
+        pool->parallelFor(numChunks, evaluateChunk);
+    else
+        for (int chunk = 0; chunk < numChunks; ++chunk)
+            evaluateChunk(chunk, 0);
+
+    // Same reduction as a serial loop that stops at the first candidate reaching the threshold.
+    int bestIndex = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (candidates[(size_t) i].score > candidates[(size_t) bestIndex].score)
+            bestIndex = i;
+        if (candidates[(size_t) i].score >= settings.earlyStopScore)
+            break;
+    }
+
+    numAbandoned = 0;
+    return candidates[(size_t) bestIndex].pattern;
+}
+} // namespace mfpr
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "MelodyGenerator.h"
+
+namespace mfpr
+{
+class AssetLibrary;
+class ScoringModel;
+class WorkerPool;
+
+struct CandidateSearchSettings
+{
+    static constexpr int kMaxCandidates = 256;
+
+    int numCandidates = 10; // 1..256
+
+    // Stop as soon as a candidate scores at or above this. Candidates are still
+    // considered in seed order, so the result matches a serial search that breaks
+    // out of its loop at the first candidate reaching the threshold.
+    double earlyStopScore = std::numeric_limits<double>::infinity();
+
+    // Abandon a candidate mid-generation once its running score can no longer beat a
+    // finished lower seed. Never changes the result, only how much work is done.
+    bool branchAndBound = true;
+
+    // Rank candidates with this model instead of MelodyGenerator::score() when it has
+    // weights for the genre. Every candidate is then generated in full (no branch-and-bound)
+    // and scored in batches; the early stop still applies in seed order.
+    const ScoringModel* scoringModel = nullptr;
+};
+
+// Generates numCandidates variations (seeds params.seed + i) and keeps the best
+// scoring one. With a WorkerPool the candidates are evaluated in parallel; the
+// winner is always identical to the serial search (ties go to the lower seed).
+// Candidate patterns are generated into buffers owned by the search and reused on
+// every run, so once warmed up a search does no heap allocation.
+class CandidateSearch final
+{
+public:
+    CandidateSearch();
+
+    // The returned pattern lives in this object and stays valid until the next run().
+    const GeneratedPattern& run(const MelodyGenerator& generator,
+                                const GenerationParams& params,
+                                int inputRootMidiNote,
+                                int inputVelocity,
+                                int outputChannel,
+                                AssetLibrary& library,
+                                const CandidateSearchSettings& settings,
+                                WorkerPool* pool);
+
+    // Candidates the last run() abandoned through branch-and-bound.
+    int getNumAbandoned() const { return numAbandoned; }
+
+private:
+    const GeneratedPattern& runWithModel(const MelodyGenerator& generator,
+                                         const GenerationParams& params,
+                                         int inputRootMidiNote,
+                                         int inputVelocity,
+                                         int outputChannel,
+                                         AssetLibrary& library,
+                                         const CandidateSearchSettings& settings,
+                                         WorkerPool* pool);
+
+    struct Candidate
+    {
+        GeneratedPattern pattern;
+        double score = 0.0;
+    };
+
+    std::vector<Candidate> candidates;
+
+    // Scores of finished candidates (-inf until then), used as bounds by higher seeds.
+    std::array<std::atomic<double>, CandidateSearchSettings::kMaxCandidates> finishedScores;
+    int numAbandoned = 0;
+};
+} // namespace mfpr
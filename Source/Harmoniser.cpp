@@ -0,0 +1,96 @@
+#include "Harmoniser.h"
+
+namespace mfpr
+{
+int Harmoniser::voice(int noteNumber, const Settings& settings, std::array<int, kMaxVoices>& out)
+{
+    const auto mode = (size_t) clampModeIndex(settings.modeIndex);
+    const auto key = (size_t) pitchClassOf(settings.keyIndex);
+    const auto& e = kHarmonyTable.entries[mode][key][(size_t) pitchClassOf(noteNumber)];
+    const int root = noteNumber + e.snap;
+
+    std::array<int, kMaxVoices> candidates {};
+    int numCandidates = 0;
+    switch (kGenreVoicings[(size_t) juce::jlimit(0, kNumGenres - 1, settings.genreIndex)])
+    {
+        case VoicingStyle::triad:
+            candidates = { root + e.third, root + e.fifth, 0 };
+            numCandidates = 2;
+            break;
+        case VoicingStyle::seventh:
+            candidates = { root + e.third, root + e.fifth, root + e.seventh };
+            numCandidates = 3;
+            break;
+        case VoicingStyle::spread:
+            candidates = { root - 12, root + e.fifth, root + e.third + 12 };
+            numCandidates = 3;
+            break;
+    }
+
+    int count = 0;
+    for (int i = 0; i < numCandidates; ++i)
+    {
+        const auto note = candidates[(size_t) i];
+        if (note >= 0 && note <= 127 && note != noteNumber)
+            out[(size_t) count++] = note;
+    }
+    return count;
+}
+
+void Harmoniser::process(const juce::MidiMessage& message, int samplePosition, const Settings& settings, juce::MidiBuffer& out)
+{
+    if (message.isNoteOn())
+        noteOn(message.getChannel(), message.getNoteNumber(), message.getVelocity(), samplePosition, settings, out);
+    else if (message.isNoteOff())
+        noteOff(message.getChannel(), message.getNoteNumber(), samplePosition, out);
+    else if (message.isAllNotesOff() || message.isAllSoundOff())
+        releaseAll(out, samplePosition);
+}
+
+void Harmoniser::noteOn(int channel, int noteNumber, juce::uint8 velocity, int samplePosition, const Settings& settings, juce::MidiBuffer& out)
+{
+    // A retrigger without a note-off in between: let go of the previous chord first.
+    auto& h = held[indexOf(channel, noteNumber)];
+    if (h.count > 0)
+        noteOff(channel, noteNumber, samplePosition, out);
+
+    std::array<int, kMaxVoices> notes {};
+    const int count = voice(noteNumber, settings, notes);
+    for (int i = 0; i < count; ++i)
+    {
+        const auto note = notes[(size_t) i];
+        if (sounding[indexOf(channel, note)]++ == 0)
+            out.addEvent(juce::MidiMessage::noteOn(channel, note, velocity), samplePosition);
+        h.notes[(size_t) i] = (uint8_t) note;
+    }
+    h.count = (uint8_t) count;
+}
+
+void Harmoniser::noteOff(int channel, int noteNumber, int samplePosition, juce::MidiBuffer& out)
+{
+    auto& h = held[indexOf(channel, noteNumber)];
+    for (int i = 0; i < h.count; ++i)
+    {
+        const auto note = (int) h.notes[(size_t) i];
+        auto& n = sounding[indexOf(channel, note)];
+        if (n > 0 && --n == 0)
+            out.addEvent(juce::MidiMessage::noteOff(channel, note), samplePosition);
+    }
+    h.count = 0;
+}
+
+void Harmoniser::releaseAll(juce::MidiBuffer& out, int samplePosition)
+{
+    for (int channel = 1; channel <= 16; ++channel)
+    {
+        for (int note = 0; note < 128; ++note)
+        {
+            auto& n = sounding[indexOf(channel, note)];
+            if (n > 0)
+                out.addEvent(juce::MidiMessage::noteOff(channel, note), samplePosition);
+            n = 0;
+            held[indexOf(channel, note)].count = 0;
+        }
+    }
+}
+} // namespace mfpr
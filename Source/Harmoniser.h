@@ -0,0 +1,137 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "MFPRConstants.h"
+#include "ScaleTables.h"
+
+namespace mfpr
+{
+// Diatonic chord tones above each pitch class, built at compile time like kScaleTable.
+// The input is first snapped into the scale; third/fifth/seventh are the scale degrees two,
+// four and six steps above the snapped degree, in semitones above the snapped pitch.
+struct HarmonyTable
+{
+    struct Entry
+    {
+        int8_t snap = 0;
+        int8_t third = 0;
+        int8_t fifth = 0;
+        int8_t seventh = 0;
+    };
+
+    std::array<std::array<std::array<Entry, 12>, 12>, kNumModes> entries {}; // [mode][key][pitch class]
+};
+
+constexpr HarmonyTable makeHarmonyTable()
+{
+    HarmonyTable t;
+    for (int mode = 0; mode < kNumModes; ++mode)
+    {
+        for (int key = 0; key < 12; ++key)
+        {
+            const auto mask = kScaleTable.inScale[(size_t) mode][(size_t) key];
+
+            // Semitones above `pc` of the scale degree `steps` degrees higher.
+            const auto degreesAbove = [mask](int pc, int steps)
+            {
+                int semitones = 0;
+                while (steps > 0)
+                {
+                    ++semitones;
+                    if ((mask >> ((pc + semitones) % 12)) & 1)
+                        --steps;
+                }
+                return semitones;
+            };
+
+            for (int pc = 0; pc < 12; ++pc)
+            {
+                const int snap = kScaleTable.snapOffset[(size_t) mode][(size_t) key][(size_t) pc];
+                const int root = (pc + snap + 12) % 12;
+                auto& e = t.entries[(size_t) mode][(size_t) key][(size_t) pc];
+                e.snap = int8_t(snap);
+                e.third = int8_t(degreesAbove(root, 2));
+                e.fifth = int8_t(degreesAbove(root, 4));
+                e.seventh = int8_t(degreesAbove(root, 6));
+            }
+        }
+    }
+    return t;
+}
+
+inline constexpr HarmonyTable kHarmonyTable = makeHarmonyTable();
+
+static_assert(kHarmonyTable.entries[0][0][0].third == 4 && kHarmonyTable.entries[0][0][0].fifth == 7
+                  && kHarmonyTable.entries[0][0][0].seventh == 11,
+              "C in C major harmonises as Cmaj7");
+static_assert(kHarmonyTable.entries[0][0][2].third == 3 && kHarmonyTable.entries[0][0][2].seventh == 10,
+              "D in C major harmonises as Dm7");
+static_assert(kHarmonyTable.entries[1][9][9].third == 3 && kHarmonyTable.entries[1][9][9].fifth == 7,
+              "A in A minor harmonises as Am");
+
+// How the chord tones are stacked on the played note.
+enum class VoicingStyle
+{
+    triad,   // played note + third + fifth
+    seventh, // played note + third + fifth + seventh
+    spread   // root an octave below + fifth + tenth (open voicing)
+};
+
+// Per entry of kGenres.
+inline constexpr std::array<VoicingStyle, kNumGenres> kGenreVoicings = {
+    VoicingStyle::seventh, VoicingStyle::seventh, VoicingStyle::triad,  VoicingStyle::spread,  // House .. Progressive House
+    VoicingStyle::seventh, VoicingStyle::triad,   VoicingStyle::triad,  VoicingStyle::triad,   // Future House .. Big Room
+    VoicingStyle::spread,  VoicingStyle::spread,  VoicingStyle::spread, VoicingStyle::spread,  // Techno .. Trance
+    VoicingStyle::spread,  VoicingStyle::triad,   VoicingStyle::triad,  VoicingStyle::seventh, // Progressive Trance .. Future Bass
+    VoicingStyle::triad,   VoicingStyle::seventh, VoicingStyle::seventh, VoicingStyle::triad,  // Drum & Bass .. UK Bass
+    VoicingStyle::triad,   VoicingStyle::seventh, VoicingStyle::seventh, VoicingStyle::triad,  // Trap .. Pop
+    VoicingStyle::spread,  VoicingStyle::seventh, VoicingStyle::seventh, VoicingStyle::spread, // Synthwave .. Ambient
+    VoicingStyle::seventh, VoicingStyle::triad,   VoicingStyle::seventh, VoicingStyle::seventh // Lo-Fi .. Afro House
+};
+
+// Live-input harmoniser: every incoming note-on gets its chord tones added at the same
+// sample position, and the matching note-off releases exactly the notes that were added,
+// even if key, mode or genre changed in between. Per event this is one table lookup and
+// a fixed number of MIDI events; nothing is allocated, so it can run on the audio thread.
+class Harmoniser final
+{
+public:
+    static constexpr int kMaxVoices = 3; // harmony notes added per played note
+
+    struct Settings
+    {
+        int keyIndex = 0;
+        int modeIndex = 0;
+        int genreIndex = 0;
+    };
+
+    // Harmony notes (not including the played note itself) for a note-on; any that would
+    // fall outside 0..127 are left out. Returns how many were written to `out`.
+    static int voice(int noteNumber, const Settings& settings, std::array<int, kMaxVoices>& out);
+
+    // Adds the harmony for `message` to `out` at samplePosition. Note-ons start a chord,
+    // note-offs end it, all-notes-off releases everything; other messages are ignored.
+    void process(const juce::MidiMessage& message, int samplePosition, const Settings& settings, juce::MidiBuffer& out);
+
+    // Releases every harmony note still sounding.
+    void releaseAll(juce::MidiBuffer& out, int samplePosition);
+
+private:
+    void noteOn(int channel, int noteNumber, juce::uint8 velocity, int samplePosition, const Settings& settings, juce::MidiBuffer& out);
+    void noteOff(int channel, int noteNumber, int samplePosition, juce::MidiBuffer& out);
+
+    static constexpr size_t indexOf(int channel, int noteNumber) { return (size_t) ((channel - 1) * 128 + noteNumber); }
+
+    // The harmony each held input note added, so its note-off can release the same notes.
+    struct Held
+    {
+        uint8_t count = 0;
+        std::array<uint8_t, kMaxVoices> notes {};
+    };
+    std::array<Held, 16 * 128> held {};
+
+    // How many held input notes share each output note. Overlapping chords only start a
+    // note when the first one needs it and only end it when the last one lets go.
+    std::array<uint8_t, 16 * 128> sounding {};
+};
+} // namespace mfpr
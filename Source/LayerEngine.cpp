@@ -0,0 +1,395 @@
+#include "LayerEngine.h"
+
+namespace mfpr
+{
+static double quantiseUp(double ppq, LaunchQuantise quantise)
+{
+    double grid = 0.0;
+    switch (quantise)
+    {
+        case LaunchQuantise::none: return ppq;
+        case LaunchQuantise::step: grid = 0.25; break;
+        case LaunchQuantise::beat: grid = 1.0; break;
+        case LaunchQuantise::bar: grid = 4.0; break;
+    }
+    return std::ceil(ppq / grid - 1.0e-9) * grid;
+}
+
+LayerEngine::LayerEngine() = default;
+LayerEngine::~LayerEngine() = default;
+
+void LayerEngine::launch(int layer, const GeneratedPattern& pattern, const LayerSettings& settings)
+{
+    if (!juce::isPositiveAndBelow(layer, kMaxLayers))
+        return;
+
+    auto schedule = std::make_unique<PatternSchedule>(pattern);
+
+    const juce::ScopedLock sl(commandLock);
+    collectRetired();
+
+    int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
+    commandFifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 + size2 == 0)
+    {
+        jassertfalse; // the audio thread is not draining commands
+        return;
+    }
+
+    commands[(size_t) (size1 > 0 ? start1 : start2)] = { CommandType::launch, layer, schedule.get(), settings };
+    commandFifo.finishedWrite(1);
+    ownedSchedules.push_back(std::move(schedule));
+}
+
+void LayerEngine::stop(int layer)
+{
+    if (!juce::isPositiveAndBelow(layer, kMaxLayers))
+        return;
+
+    const juce::ScopedLock sl(commandLock);
+    collectRetired();
+
+    int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
+    commandFifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 + size2 == 0)
+        return;
+
+    commands[(size_t) (size1 > 0 ? start1 : start2)] = { CommandType::stop, layer, nullptr, {} };
+    commandFifo.finishedWrite(1);
+}
+
+void LayerEngine::stopAll()
+{
+    const juce::ScopedLock sl(commandLock);
+    collectRetired();
+
+    int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
+    commandFifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 + size2 == 0)
+        return;
+
+    commands[(size_t) (size1 > 0 ? start1 : start2)] = { CommandType::stopAll, 0, nullptr, {} };
+    commandFifo.finishedWrite(1);
+}
+
+bool LayerEngine::isActive(int layer) const
+{
+    return juce::isPositiveAndBelow(layer, kMaxLayers) && activeFlags[(size_t) layer].load();
+}
+
+void LayerEngine::releaseFinished()
+{
+    const juce::ScopedLock sl(commandLock);
+    collectRetired();
+}
+
+void LayerEngine::collectRetired()
+{
+    int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
+    retiredFifo.prepareToRead(retiredFifo.getNumReady(), start1, size1, start2, size2);
+
+    const auto release = [this](int start, int size)
+    {
+        for (int i = start; i < start + size; ++i)
+        {
+            const auto* s = retired[(size_t) i];
+            ownedSchedules.erase(std::remove_if(ownedSchedules.begin(), ownedSchedules.end(), [s](const auto& p) { return p.get() == s; }),
+                                 ownedSchedules.end());
+        }
+    };
+    release(start1, size1);
+    release(start2, size2);
+    retiredFifo.finishedRead(size1 + size2);
+}
+
+void LayerEngine::retire(const PatternSchedule* schedule)
+{
+    if (schedule == nullptr)
+        return;
+
+    // If the message thread has fallen far behind, the schedule simply stays owned until
+    // the engine is destroyed.
+    int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
+    retiredFifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 + size2 == 0)
+        return;
+
+    retired[(size_t) (size1 > 0 ? start1 : start2)] = schedule;
+    retiredFifo.finishedWrite(1);
+}
+
+void LayerEngine::activate(int layer)
+{
+    for (int i = 0; i < numActive; ++i)
+        if (activeLayers[(size_t) i] == layer)
+            return;
+    activeLayers[(size_t) numActive++] = (uint8_t) layer;
+}
+
+void LayerEngine::applyCommands(double nowPpq)
+{
+    int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
+    commandFifo.prepareToRead(commandFifo.getNumReady(), start1, size1, start2, size2);
+
+    const auto apply = [&](const Command& c)
+    {
+        // Queues a change (a launch, or a stop with a null schedule), replacing any not yet due.
+        const auto queue = [&](Layer& l, const PatternSchedule* schedule, const LayerSettings& settings, double atPpq)
+        {
+            if (l.hasChange && l.nextSchedule != schedule)
+                retire(l.nextSchedule);
+            l.hasChange = true;
+            l.nextSchedule = schedule;
+            l.nextSettings = settings;
+            l.changePpq = atPpq;
+        };
+
+        switch (c.type)
+        {
+            case CommandType::launch:
+            {
+                auto& l = layers[(size_t) c.layer];
+                queue(l, c.schedule, c.settings, quantiseUp(nowPpq, c.settings.quantise));
+                activate(c.layer);
+                break;
+            }
+            case CommandType::stop:
+            {
+                auto& l = layers[(size_t) c.layer];
+                if (l.schedule == nullptr && !l.hasChange)
+                    break;
+                const auto quantise = l.hasChange ? l.nextSettings.quantise : l.settings.quantise;
+                queue(l, nullptr, l.settings, quantiseUp(nowPpq, quantise));
+                break;
+            }
+            case CommandType::stopAll:
+                for (int i = 0; i < numActive; ++i)
+                {
+                    auto& l = layers[activeLayers[(size_t) i]];
+                    queue(l, nullptr, l.settings, nowPpq);
+                }
+                break;
+        }
+    };
+
+    for (int i = start1; i < start1 + size1; ++i)
+        apply(commands[(size_t) i]);
+    for (int i = start2; i < start2 + size2; ++i)
+        apply(commands[(size_t) i]);
+    commandFifo.finishedRead(size1 + size2);
+}
+
+void LayerEngine::wrapLoop(double loopEndPpq, double loopStartPpq)
+{
+    const auto loopLength = loopEndPpq - loopStartPpq;
+    for (int i = 0; i < numActive; ++i)
+    {
+        auto& l = layers[activeLayers[(size_t) i]];
+
+        // A one-shot goes on from the loop start rather than starting over.
+        if (l.schedule != nullptr && !l.settings.loop)
+            l.startPpq -= loopLength;
+
+        // A change quantised to the loop end (or later) would never be reached: it moves back
+        // by whole loops, into the loop.
+        if (l.hasChange && l.changePpq >= loopEndPpq - EmissionRange::kTolerancePpq)
+            l.changePpq -= loopLength * std::floor((l.changePpq - loopStartPpq + EmissionRange::kTolerancePpq) / loopLength);
+    }
+}
+
+void LayerEngine::cutAll(juce::MidiBuffer& out, int samplePosition)
+{
+    for (int i = 0; i < numActive; ++i)
+        layers[activeLayers[(size_t) i]].notes.releaseAll(out, samplePosition);
+}
+
+// PPQ of event e in the given repeat of a layer's pattern, with off-steps swung.
+static double eventPpq(double startPpq, int lengthSteps, int repeat, const PatternSchedule::Event& e, double swingPpq)
+{
+    const auto step = juce::int64(repeat) * lengthSteps + e.step;
+    return startPpq + double(step) * 0.25 + ((step & 1) == 1 ? swingPpq : 0.0);
+}
+
+void LayerEngine::seek(Layer& l, double ppq, double swingPpq) const
+{
+    l.repeat = 0;
+    l.index = 0;
+    ppq -= EmissionRange::kTolerancePpq;
+    if (l.schedule == nullptr || (!l.settings.loop && ppq <= l.startPpq))
+        return;
+
+    // A looping layer also runs before its start (negative repeats), in phase with it, so it
+    // plays on after a loop wrap or a jump back to before its launch.
+    const auto& events = l.schedule->getEvents();
+    const int L = l.schedule->getLengthSteps();
+    const int repeat = (int) std::floor((ppq - l.startPpq) * 4.0 / L);
+    if (!l.settings.loop && repeat > 0)
+    {
+        l.index = (int) events.size(); // one-shot already over
+        return;
+    }
+
+    // Within a repeat, event times rise with the index (swing delays by less than a step).
+    const auto it = std::lower_bound(events.begin(), events.end(), ppq, [&](const PatternSchedule::Event& e, double t)
+    {
+        return eventPpq(l.startPpq, L, repeat, e, swingPpq) < t;
+    });
+
+    l.repeat = repeat;
+    l.index = (int) (it - events.begin());
+    if (l.index == (int) events.size() && l.settings.loop && !events.empty())
+    {
+        ++l.repeat;
+        l.index = 0;
+    }
+}
+
+double LayerEngine::nextTime(const Layer& l, double swingPpq) const
+{
+    auto t = std::numeric_limits<double>::infinity();
+    if (l.schedule != nullptr && l.index < (int) l.schedule->getEvents().size())
+        t = eventPpq(l.startPpq, l.schedule->getLengthSteps(), l.repeat, l.schedule->getEvents()[(size_t) l.index], swingPpq);
+    if (l.hasChange)
+        t = juce::jmin(t, l.changePpq);
+    return t;
+}
+
+void LayerEngine::mergeRange(const EmissionRange& range, double swingPpq, juce::MidiBuffer& out)
+{
+    const double endPpq = range.endPpq - EmissionRange::kTolerancePpq; // as in EmissionRange::contains
+    const auto later = [](const HeapEntry& a, const HeapEntry& b) { return a.first > b.first || (a.first == b.first && a.second > b.second); };
+    const auto heapBegin = heap.begin();
+    int heapSize = 0;
+
+    for (int i = 0; i < numActive; ++i)
+    {
+        const int index = activeLayers[(size_t) i];
+        auto& l = layers[(size_t) index];
+        seek(l, range.startPpq, swingPpq);
+
+        const auto t = nextTime(l, swingPpq);
+        if (t < endPpq)
+            heap[(size_t) heapSize++] = { t, index };
+    }
+    std::make_heap(heapBegin, heapBegin + heapSize, later);
+
+    while (heapSize > 0)
+    {
+        std::pop_heap(heapBegin, heapBegin + heapSize, later);
+        const auto [t, index] = heap[(size_t) --heapSize];
+        auto& l = layers[(size_t) index];
+        const int samplePos = juce::jlimit(range.fromSample, range.toSample - 1, range.sampleAt(t));
+
+        const bool eventDue = l.schedule != nullptr && l.index < (int) l.schedule->getEvents().size()
+                              && !(l.hasChange && l.changePpq <= t);
+        if (eventDue)
+        {
+            const auto& e = l.schedule->getEvents()[(size_t) l.index];
+            const int note = e.noteNumber + l.settings.transpose;
+            if (note >= 0 && note <= 127)
+            {
+                if (e.velocity > 0)
+                {
+                    out.addEvent(juce::MidiMessage::noteOn(l.settings.channel, note, (juce::uint8) e.velocity), samplePos);
+                    l.notes.noteOn(l.settings.channel, note);
+                }
+                else
+                {
+                    out.addEvent(juce::MidiMessage::noteOff(l.settings.channel, note), samplePos);
+                    l.notes.noteOff(l.settings.channel, note);
+                }
+            }
+
+            if (++l.index == (int) l.schedule->getEvents().size() && l.settings.loop)
+            {
+                ++l.repeat;
+                l.index = 0;
+            }
+        }
+        else
+        {
+            // The queued launch or stop is due: cut the old pattern and start the new one here.
+            l.notes.releaseAll(out, samplePos);
+            if (l.schedule != l.nextSchedule)
+                retire(l.schedule);
+
+            l.schedule = l.nextSchedule;
+            l.settings = l.nextSettings;
+            l.startPpq = l.changePpq;
+            l.hasChange = false;
+            l.nextSchedule = nullptr;
+            l.repeat = 0;
+            l.index = 0;
+        }
+
+        const auto next = nextTime(l, swingPpq);
+        if (next < endPpq)
+        {
+            heap[(size_t) heapSize++] = { next, index };
+            std::push_heap(heapBegin, heapBegin + heapSize, later);
+        }
+    }
+}
+
+void LayerEngine::process(const TransportScheduler::Block& transport, double swingAmount, juce::MidiBuffer& out)
+{
+    if (transport.clockOffsetPpq != 0.0)
+    {
+        for (int i = 0; i < numActive; ++i)
+        {
+            auto& l = layers[activeLayers[(size_t) i]];
+            l.startPpq += transport.clockOffsetPpq;
+            l.changePpq += transport.clockOffsetPpq;
+        }
+    }
+
+    if (transport.stopped || transport.relocated)
+        cutAll(out, 0);
+
+    if (transport.stopped)
+    {
+        for (int i = 0; i < numActive; ++i)
+        {
+            auto& l = layers[activeLayers[(size_t) i]];
+            retire(l.schedule);
+            if (l.hasChange)
+                retire(l.nextSchedule);
+            l = {};
+        }
+        numActive = 0;
+    }
+
+    applyCommands(transport.ranges[0].startPpq);
+
+    const double swingPpq = 0.25 * swingAmount;
+    for (int r = 0; r < transport.numRanges; ++r)
+    {
+        const auto& range = transport.ranges[(size_t) r];
+        if (range.fromSample == transport.loopWrapSample())
+        {
+            cutAll(out, range.fromSample);
+            wrapLoop(transport.ranges[0].endPpq, range.startPpq);
+        }
+        mergeRange(range, swingPpq, out);
+    }
+
+    // Layers that have stopped, or played their single pass, are idle again.
+    for (int i = numActive; --i >= 0;)
+    {
+        auto& l = layers[activeLayers[(size_t) i]];
+        const bool finished = l.schedule == nullptr
+                              || (!l.settings.loop && l.index >= (int) l.schedule->getEvents().size());
+        if (finished && !l.hasChange)
+        {
+            retire(l.schedule);
+            l.schedule = nullptr;
+            activeLayers[(size_t) i] = activeLayers[(size_t) --numActive];
+        }
+    }
+
+    for (int i = 0; i < kMaxLayers; ++i)
+        activeFlags[(size_t) i].store(false, std::memory_order_relaxed);
+    for (int i = 0; i < numActive; ++i)
+        activeFlags[activeLayers[(size_t) i]].store(true, std::memory_order_relaxed);
+}
+} // namespace mfpr
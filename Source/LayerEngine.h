@@ -0,0 +1,133 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "MelodyGenerator.h"
+#include "PatternSchedule.h"
+#include "TransportScheduler.h"
+
+namespace mfpr
+{
+enum class LaunchQuantise
+{
+    none, // at the start of the next block
+    step, // next 16th
+    beat, // next quarter note
+    bar   // next 4/4 bar
+};
+
+struct LayerSettings
+{
+    int channel = 1;
+    int transpose = 0; // semitones; notes pushed outside 0..127 are dropped
+    LaunchQuantise quantise = LaunchQuantise::bar;
+    bool loop = true; // false plays the pattern once and frees the layer
+};
+
+// Clip-launcher style playback of up to kMaxLayers patterns at once, each on its own channel
+// with its own transpose, launched and stopped on a quantisation boundary.
+//
+// launch()/stop() are called on the message thread: patterns are compiled there and passed
+// to the audio thread through a lock-free FIFO; schedules the audio thread has finished with
+// come back through a second FIFO and are freed on the message thread. process() runs on
+// the audio thread and never allocates or locks. Each block it merges the next events of all
+// playing layers (a k-way merge over their schedules) into a single time-ordered stream, so
+// the output buffer is only ever appended to.
+class LayerEngine final
+{
+public:
+    static constexpr int kMaxLayers = 64;
+
+    LayerEngine();
+    ~LayerEngine();
+
+    // Message thread. Replaces whatever the layer plays at the next boundary of settings.quantise.
+    void launch(int layer, const GeneratedPattern& pattern, const LayerSettings& settings);
+
+    // Message thread. Ends the layer at the next boundary of its own quantisation.
+    void stop(int layer);
+
+    // Message thread. Ends every layer at the start of the next block.
+    void stopAll();
+
+    // Message thread. Frees the schedules the audio thread has finished with (as launch(),
+    // stop() and stopAll() also do), so layers ending on their own don't pile them up.
+    void releaseFinished();
+
+    // True while the layer is playing or waiting to launch (as of the last process() call).
+    bool isActive(int layer) const;
+
+    // Audio thread. Adds this block's layer events to `out`, following the transport's ranges;
+    // cuts sounding notes on stops, relocations and loop wraps (a stop also ends every layer).
+    void process(const TransportScheduler::Block& transport, double swingAmount, juce::MidiBuffer& out);
+
+private:
+    enum class CommandType
+    {
+        launch,
+        stop,
+        stopAll
+    };
+
+    struct Command
+    {
+        CommandType type = CommandType::launch;
+        int layer = 0;
+        const PatternSchedule* schedule = nullptr;
+        LayerSettings settings;
+    };
+
+    struct Layer
+    {
+        const PatternSchedule* schedule = nullptr; // null when idle
+        LayerSettings settings;
+        double startPpq = 0.0;
+
+        // A launch (or, with a null schedule, a stop) waiting for changePpq.
+        bool hasChange = false;
+        const PatternSchedule* nextSchedule = nullptr;
+        LayerSettings nextSettings;
+        double changePpq = 0.0;
+
+        // Next event: schedule index within repeat number `repeat`.
+        int repeat = 0;
+        int index = 0;
+
+        ActiveNoteTable notes;
+    };
+
+    void applyCommands(double nowPpq);
+    void retire(const PatternSchedule* schedule);
+    void collectRetired();
+    void activate(int layer);
+    void cutAll(juce::MidiBuffer& out, int samplePosition);
+
+    // At a host loop wrap: moves one-shots and pending changes from before it to after it.
+    void wrapLoop(double loopEndPpq, double loopStartPpq);
+
+    // Positions the layer's cursor on its first event at or after ppq.
+    void seek(Layer& l, double ppq, double swingPpq) const;
+
+    // PPQ of the event under the cursor (or of a pending change, if earlier); +inf if none.
+    double nextTime(const Layer& l, double swingPpq) const;
+
+    void mergeRange(const EmissionRange& range, double swingPpq, juce::MidiBuffer& out);
+
+    // Message-thread side.
+    std::vector<std::unique_ptr<PatternSchedule>> ownedSchedules;
+    juce::CriticalSection commandLock; // serialises message-thread writers only
+
+    juce::AbstractFifo commandFifo { 256 };
+    std::array<Command, 256> commands;
+    juce::AbstractFifo retiredFifo { 256 };
+    std::array<const PatternSchedule*, 256> retired {};
+
+    // Audio-thread side.
+    std::array<Layer, kMaxLayers> layers;
+    std::array<uint8_t, kMaxLayers> activeLayers {}; // indices of non-idle layers
+    int numActive = 0;
+    std::array<std::atomic<bool>, kMaxLayers> activeFlags {};
+
+    using HeapEntry = std::pair<double, int>; // (next event PPQ, layer)
+    std::array<HeapEntry, kMaxLayers> heap {};
+};
+} // namespace mfpr
@@ -9,6 +9,7 @@ inline constexpr auto kPluginName = "MelodyForgePro";
 inline constexpr auto kPluginDisplayName = "MelodyForge Pro";
 
 inline constexpr int kNumGenres = 32;
+inline constexpr int kNumModes = 10;
 inline constexpr int kNumChordProgressions = 300;
 inline constexpr int kNumMelodyShots = 200;
 inline constexpr int kNumPresets = 200;
@@ -31,9 +32,12 @@ inline const std::array<juce::String, kNumGenres> kGenres = {
 inline const std::array<juce::String, 12> kKeys = { "C",  "C#", "D",  "D#", "E",  "F",
                                                     "F#", "G",  "G#", "A",  "A#", "B" };
 
-inline const std::array<juce::String, 2> kModes = { "Major", "Minor" };
+// Indices 0/1 must stay Major/Minor (saved sessions store the choice index).
+inline const std::array<juce::String, kNumModes> kModes = { "Major",    "Minor",      "Dorian",         "Phrygian",
+                                                            "Lydian",   "Mixolydian", "Harmonic Minor", "Melodic Minor",
+                                                            "Major Pentatonic", "Minor Pentatonic" };
 inline const std::array<juce::String, 4> kLengths = { "4", "8", "12", "16" };
-inline const std::array<juce::String, 3> kTypes = { "Chord", "Melody", "Hybrid" };
+inline const std::array<juce::String, 4> kTypes = { "Chord", "Melody", "Hybrid", "Markov" };
 
 inline constexpr int kEditorWidth = 800;
 inline constexpr int kEditorHeight = 600;
@@ -0,0 +1,147 @@
+#include "MarkovMelody.h"
+#include "AssetLibrary.h"
+
+namespace mfpr
+{
+// Weight of the all-template distribution, in observations, added to every genre row.
+static constexpr double kGenrePrior = 2.0;
+
+template <int Contexts, int Outcomes>
+using Counts = std::array<std::array<double, (size_t) Outcomes>, (size_t) Contexts>;
+
+// Adds `prior` observations spread like `global` (or like the column totals of `global`
+// where the context itself was never seen) and stores the rows in `table`.
+template <int Contexts, int Outcomes>
+static void buildRows(AliasTable<Contexts, Outcomes>& table, const Counts<Contexts, Outcomes>& counts, const Counts<Contexts, Outcomes>& global, double prior)
+{
+    std::array<double, Outcomes> marginal {};
+    for (const auto& row : global)
+        for (int o = 0; o < Outcomes; ++o)
+            marginal[(size_t) o] += row[(size_t) o];
+
+    for (int c = 0; c < Contexts; ++c)
+    {
+        const auto& g = global[(size_t) c];
+        double globalTotal = 0.0;
+        for (const auto w : g)
+            globalTotal += w;
+
+        const auto& backoff = globalTotal > 0.0 ? g : marginal;
+        double backoffTotal = 0.0;
+        for (const auto w : backoff)
+            backoffTotal += w;
+
+        std::array<double, Outcomes> weights {};
+        for (int o = 0; o < Outcomes; ++o)
+        {
+            weights[(size_t) o] = counts[(size_t) c][(size_t) o];
+            weights[(size_t) o] += backoffTotal > 0.0 ? prior * backoff[(size_t) o] / backoffTotal : 1.0;
+        }
+        table.setRow(c, weights);
+    }
+}
+
+void MarkovMelodyModel::train(const AssetLibrary& library)
+{
+    constexpr int intervalContexts = kNumIntervals + 1;
+    constexpr int gapContexts = kNumGaps + 1;
+
+    // Counts per genre, plus their sum over all genres. Large enough to keep off the stack.
+    struct TrainingCounts
+    {
+        Counts<intervalContexts, kNumIntervals> intervals {};
+        Counts<gapContexts, kNumGaps> gaps {};
+        Counts<kNumGaps, kMaxLength> lengths {};
+        double velocitySum = 0.0;
+        int numNotes = 0;
+    };
+
+    std::vector<TrainingCounts> counts((size_t) kNumGenres + 1);
+    auto& all = counts.back();
+
+    for (int i = 0; i < AssetLibrary::kMelodyCount; ++i)
+    {
+        const auto& tpl = library.getMelodyTemplate(i);
+        auto& genre = counts[(size_t) (i % kNumGenres)];
+
+        int previousInterval = kNoPrevious;
+        int previousGap = kNoPrevious;
+        for (size_t n = 0; n < tpl.notes.size(); ++n)
+        {
+            const auto& note = tpl.notes[n];
+            const auto gap = juce::jlimit(0, kMaxGap, n == 0 ? note.startStep : note.startStep - tpl.notes[n - 1].startStep);
+            const auto gapContext = (size_t) (previousGap == kNoPrevious ? kNumGaps : previousGap);
+
+            for (auto* c : { &genre, &all })
+            {
+                c->gaps[gapContext][(size_t) gap] += 1.0;
+                c->velocitySum += note.velocity;
+                ++c->numNotes;
+            }
+            previousGap = gap;
+
+            if (n > 0)
+            {
+                const auto interval = juce::jlimit(-kMaxInterval, kMaxInterval, note.noteNumber - tpl.notes[n - 1].noteNumber);
+                const auto context = (size_t) (previousInterval == kNoPrevious ? kNumIntervals : previousInterval + kMaxInterval);
+                for (auto* c : { &genre, &all })
+                    c->intervals[context][(size_t) (interval + kMaxInterval)] += 1.0;
+                previousInterval = interval;
+            }
+
+            // A note's length is learnt against the gap that follows it (the last note's
+            // against the rest of the template).
+            const auto nextStart = n + 1 < tpl.notes.size() ? tpl.notes[n + 1].startStep : tpl.lengthSteps;
+            const auto nextGap = juce::jlimit(0, kMaxGap, nextStart - note.startStep);
+            const auto length = juce::jlimit(1, kMaxLength, note.lengthSteps);
+            for (auto* c : { &genre, &all })
+                c->lengths[(size_t) nextGap][(size_t) (length - 1)] += 1.0;
+        }
+    }
+
+    // Two stacked notes in a row would let sampling stall on one step (sampleGap() also
+    // guards against it, for contexts that only have smoothed counts).
+    for (auto& c : counts)
+        c.gaps[0][0] = 0.0;
+
+    for (int g = 0; g < kNumGenres; ++g)
+    {
+        const auto& c = counts[(size_t) g];
+        auto& t = genres[(size_t) g];
+        buildRows(t.intervals, c.intervals, all.intervals, kGenrePrior);
+        buildRows(t.gaps, c.gaps, all.gaps, kGenrePrior);
+        buildRows(t.lengths, c.lengths, all.lengths, kGenrePrior);
+
+        const auto& velocities = c.numNotes > 0 ? c : all;
+        t.meanVelocity = velocities.numNotes > 0 ? juce::jlimit(1, 127, juce::roundToInt(velocities.velocitySum / velocities.numNotes)) : 100;
+    }
+}
+
+const MarkovMelodyModel::GenreTables& MarkovMelodyModel::tablesFor(int genreIndex) const
+{
+    return genres[(size_t) juce::jlimit(0, kNumGenres - 1, genreIndex)];
+}
+
+int MarkovMelodyModel::sampleInterval(int genreIndex, int previousInterval, uint64_t randomBits) const
+{
+    const auto context = previousInterval == kNoPrevious ? kNumIntervals : juce::jlimit(0, kNumIntervals - 1, previousInterval + kMaxInterval);
+    return tablesFor(genreIndex).intervals.sample(context, randomBits) - kMaxInterval;
+}
+
+int MarkovMelodyModel::sampleGap(int genreIndex, int previousGap, uint64_t randomBits) const
+{
+    const auto context = previousGap == kNoPrevious ? kNumGaps : juce::jlimit(0, kMaxGap, previousGap);
+    const auto gap = tablesFor(genreIndex).gaps.sample(context, randomBits);
+    return (gap == 0 && previousGap == 0) ? 1 : gap;
+}
+
+int MarkovMelodyModel::sampleLength(int genreIndex, int gap, uint64_t randomBits) const
+{
+    return tablesFor(genreIndex).lengths.sample(juce::jlimit(0, kMaxGap, gap), randomBits) + 1;
+}
+
+int MarkovMelodyModel::getMeanVelocity(int genreIndex) const
+{
+    return tablesFor(genreIndex).meanVelocity;
+}
+} // namespace mfpr
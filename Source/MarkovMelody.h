@@ -0,0 +1,131 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "MFPRConstants.h"
+
+namespace mfpr
+{
+class AssetLibrary;
+
+// Walker/Vose alias tables: one row of Outcomes entries per context, sampled in O(1) from
+// 64 random bits (the high half picks a column, the low 16 bits decide column or alias).
+template <int Contexts, int Outcomes>
+class AliasTable
+{
+public:
+    static_assert(Outcomes <= 256, "aliases are stored as uint8_t");
+
+    // Weights must be >= 0 with a positive sum.
+    void setRow(int context, const std::array<double, Outcomes>& weights)
+    {
+        double total = 0.0;
+        for (const auto w : weights)
+            total += w;
+        jassert(total > 0.0);
+
+        std::array<double, Outcomes> scaled {};
+        std::array<uint8_t, Outcomes> small {}, large {};
+        int numSmall = 0, numLarge = 0;
+        for (int i = 0; i < Outcomes; ++i)
+        {
+            scaled[(size_t) i] = weights[(size_t) i] * Outcomes / total;
+            if (scaled[(size_t) i] < 1.0)
+                small[(size_t) numSmall++] = (uint8_t) i;
+            else
+                large[(size_t) numLarge++] = (uint8_t) i;
+        }
+
+        auto& row = rows[(size_t) context];
+        while (numSmall > 0 && numLarge > 0)
+        {
+            const auto s = small[(size_t) --numSmall];
+            const auto l = large[(size_t) (numLarge - 1)];
+            row[s] = { thresholdFor(scaled[s]), l };
+
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0)
+            {
+                --numLarge;
+                small[(size_t) numSmall++] = l;
+            }
+        }
+
+        // Whatever is left has probability 1 up to rounding.
+        while (numLarge > 0)
+        {
+            const auto l = large[(size_t) --numLarge];
+            row[l] = { 0xffff, l };
+        }
+        while (numSmall > 0)
+        {
+            const auto s = small[(size_t) --numSmall];
+            row[s] = { 0xffff, s };
+        }
+    }
+
+    int sample(int context, uint64_t randomBits) const
+    {
+        const auto column = (size_t) (((randomBits >> 32) * uint64_t(Outcomes)) >> 32);
+        const auto& e = rows[(size_t) context][column];
+        return (randomBits & 0xffff) < e.threshold ? (int) column : (int) e.alias;
+    }
+
+private:
+    struct Entry
+    {
+        uint16_t threshold = 0xffff; // keep the column if the low 16 random bits are below this
+        uint8_t alias = 0;
+    };
+
+    static uint16_t thresholdFor(double probability)
+    {
+        return (uint16_t) juce::jlimit(0, 0xffff, (int) std::lround(probability * 65536.0));
+    }
+
+    std::array<std::array<Entry, Outcomes>, Contexts> rows {};
+};
+
+// First-order Markov tables of melody intervals, onset gaps and note lengths, trained per
+// genre from the embedded melody templates. Melody template i counts towards genre
+// i % kNumGenres (the same assignment the presets use); each genre's counts are smoothed
+// towards the all-template statistics so genres with few templates still vary.
+class MarkovMelodyModel final
+{
+public:
+    static constexpr int kMaxInterval = 12;                    // intervals are clamped to +-12 semitones
+    static constexpr int kNumIntervals = 2 * kMaxInterval + 1;
+    static constexpr int kMaxGap = 16;                         // onset gaps of 0..16 steps
+    static constexpr int kNumGaps = kMaxGap + 1;
+    static constexpr int kMaxLength = 16;                      // lengths of 1..16 steps
+
+    // The "previous" value passed for a pattern's first draw.
+    static constexpr int kNoPrevious = std::numeric_limits<int>::min();
+
+    void train(const AssetLibrary& library);
+
+    // Semitones from the previous melody note, given the previous interval (or kNoPrevious).
+    int sampleInterval(int genreIndex, int previousInterval, uint64_t randomBits) const;
+
+    // Steps to the next onset, given the previous gap (or kNoPrevious, for the first onset).
+    // A zero gap (stacked notes) never follows another zero gap.
+    int sampleGap(int genreIndex, int previousGap, uint64_t randomBits) const;
+
+    // Length in steps of a note followed by a gap of `gap` steps.
+    int sampleLength(int genreIndex, int gap, uint64_t randomBits) const;
+
+    int getMeanVelocity(int genreIndex) const;
+
+private:
+    struct GenreTables
+    {
+        AliasTable<kNumIntervals + 1, kNumIntervals> intervals; // context: previous interval, or start
+        AliasTable<kNumGaps + 1, kNumGaps> gaps;                // context: previous gap, or start
+        AliasTable<kNumGaps, kMaxLength> lengths;               // context: the gap after the note
+        int meanVelocity = 100;
+    };
+
+    const GenreTables& tablesFor(int genreIndex) const;
+
+    std::array<GenreTables, kNumGenres> genres {};
+};
+} // namespace mfpr
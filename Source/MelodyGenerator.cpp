@@ -1,65 +1,145 @@
 #include "MelodyGenerator.h"
 #include "AssetLibrary.h"
+#include "CounterRng.h"
+#include "ScaleTables.h"
 
 namespace mfpr
 {
 static constexpr int stepsPerBar = 16;
 
-static const std::array<int, 7> majorScale = { 0, 2, 4, 5, 7, 9, 11 };
-static const std::array<int, 7> minorScale = { 0, 2, 3, 5, 7, 8, 10 };
+// CounterRng streams of the generator. Melody draws are indexed by the note's ordinal in the
+// melody part, so each note's choices depend only on the seed and its position.
+enum class RandomStream : uint32_t
+{
+    chordStyle,
+    followChord,
+    chordTone,
+    velocityAmount,
+    velocitySign,
+    markovInterval,
+    markovGap,
+    markovLength
+};
+
+static CounterRng randomFor(const GenerationParams& params, RandomStream stream)
+{
+    return CounterRng(params.seed, (uint32_t) stream);
+}
+
+static int pickVelocityVariation(uint32_t seed)
+{
+    static constexpr std::array<int, 5> variations = { 40, 55, 70, 85, 100 };
+    return variations[seed % variations.size()];
+}
+
+static int mixVelocity(int baseVelocity, int inputVelocity, int sensitivity0to100)
+{
+    const auto sens = juce::jlimit(0.0f, 1.0f, float(sensitivity0to100) / 100.0f);
+    const auto v = juce::roundToInt((1.0f - sens) * float(baseVelocity) + sens * float(inputVelocity));
+    return juce::jlimit(1, 127, v);
+}
 
-static int positiveMod(int value, int mod)
+// 98% hit-worthy filter: avoid big consecutive leaps (> minor 9th).
+static int limitLeap(int note, int lastNote, int keyRoot, int mode)
 {
-    const int m = value % mod;
-    return m < 0 ? (m + mod) : m;
+    int diff = std::abs(note - lastNote);
+    while (diff > 13)
+    {
+        note += (note > lastNote) ? -12 : 12;
+        note = snapToScale(note, keyRoot, mode);
+        diff = std::abs(note - lastNote);
+        if (diff <= 13)
+            break;
+        note = lastNote + juce::jlimit(-13, 13, note - lastNote);
+        note = snapToScale(note, keyRoot, mode);
+        diff = std::abs(note - lastNote);
+    }
+    return note;
 }
 
-static bool isPitchClassInScale(int pitchClass, int keyRoot, bool minor)
+// 5-15% velocity randomisation of the melody note with the given ordinal.
+static int randomiseVelocity(int velocity, const GenerationParams& params, uint64_t ordinal)
 {
-    const auto pc = positiveMod(pitchClass - keyRoot, 12);
-    const auto& scale = minor ? minorScale : majorScale;
-    return std::find(scale.begin(), scale.end(), pc) != scale.end();
+    const auto velRand = 0.05f + 0.10f * randomFor(params, RandomStream::velocityAmount).unitFloat(ordinal);
+    const auto sign = randomFor(params, RandomStream::velocitySign).coin(ordinal);
+    return juce::roundToInt(float(velocity) * (1.0f + (sign ? velRand : -velRand)));
 }
 
-static int snapToScale(int midiNote, int keyRoot, bool minor)
+// The note-count terms of MelodyGenerator::score().
+static double scoreBeforeLeaps(size_t numNotes, int lengthSteps, GeneratorType type)
 {
-    if (isPitchClassInScale(midiNote % 12, keyRoot, minor))
-        return juce::jlimit(0, 127, midiNote);
+    double s = 0.0;
+    s += double(numNotes) * 0.01;
+
+    // Prefer some rhythmic density, but avoid floods.
+    const double density = double(numNotes) / juce::jmax(1, lengthSteps);
+    const bool melodyOnly = type == GeneratorType::melody || type == GeneratorType::markov;
+    s -= std::abs(density - (melodyOnly ? 0.50 : 0.35)) * 2.0;
+    return s;
+}
 
-    for (int delta = 1; delta <= 2; ++delta)
+// The leap terms of MelodyGenerator::score(), fed one note at a time in pattern order.
+// They only ever subtract, so `value` is an upper bound on the final score at all times.
+struct LeapScorer
+{
+    GeneratorType type = GeneratorType::chord;
+    double value = 0.0;
+    double scoreToBeat = -std::numeric_limits<double>::infinity();
+    bool abandoned = false;
+
+    int lastMelNote = -1;
+    int lastStep = -999;
+
+    void add(const PackedNote& n)
     {
-        if (isPitchClassInScale((midiNote + delta) % 12, keyRoot, minor))
-            return juce::jlimit(0, 127, midiNote + delta);
-        if (isPitchClassInScale((midiNote - delta) % 12, keyRoot, minor))
-            return juce::jlimit(0, 127, midiNote - delta);
+        // Penalise large melodic jumps on the melody track (if present).
+        if (n.getTrack() != 4 && type == GeneratorType::hybrid)
+            return;
+        if ((type == GeneratorType::melody || type == GeneratorType::markov) && n.getTrack() != 0)
+            return;
+
+        if (lastMelNote >= 0 && n.getStartStep() != lastStep)
+        {
+            value -= std::max(0, std::abs(n.getNoteNumber() - lastMelNote) - 7) * 0.02;
+            abandoned = value <= scoreToBeat;
+        }
+
+        lastMelNote = n.getNoteNumber();
+        lastStep = n.getStartStep();
     }
+};
 
-    return juce::jlimit(0, 127, midiNote);
+static bool isAbandoned(const LeapScorer* scorer)
+{
+    return scorer != nullptr && scorer->abandoned;
 }
 
-static int pickVelocityVariation(uint32_t seed)
+static void addNote(GeneratedPattern& out, int note, int startStep, int lengthSteps, int vel, int channel, int track, LeapScorer* scorer)
 {
-    static constexpr std::array<int, 5> variations = { 40, 55, 70, 85, 100 };
-    return variations[seed % variations.size()];
+    out.notes.emplace_back(note, startStep, lengthSteps, vel, channel, track);
+    if (scorer != nullptr)
+        scorer->add(out.notes.back());
 }
 
-static int mixVelocity(int baseVelocity, int inputVelocity, int sensitivity0to100)
+static const AssetLibrary::TemplateSequence& chordTemplateFor(const GenerationParams& params, const AssetLibrary& library)
 {
-    const auto sens = juce::jlimit(0.0f, 1.0f, float(sensitivity0to100) / 100.0f);
-    const auto v = juce::roundToInt((1.0f - sens) * float(baseVelocity) + sens * float(inputVelocity));
-    return juce::jlimit(1, 127, v);
+    return library.getChordTemplate(int(params.seed % uint32_t(AssetLibrary::kChordCount)));
 }
 
-static void addNote(GeneratedPattern& out, int note, int startStep, int lengthSteps, int vel, int channel, int track)
+static const AssetLibrary::TemplateSequence& melodyTemplateFor(const GenerationParams& params, const AssetLibrary& library)
 {
-    MidiNote n;
-    n.noteNumber = juce::jlimit(0, 127, note);
-    n.startStep = juce::jmax(0, startStep);
-    n.lengthSteps = juce::jmax(1, lengthSteps);
-    n.velocity = juce::jlimit(1, 127, vel);
-    n.channel = juce::jlimit(1, 16, channel);
-    n.track = juce::jlimit(0, 15, track);
-    out.notes.push_back(n);
+    return library.getMelodyTemplate(int((params.seed * 17u + 3u) % uint32_t(AssetLibrary::kMelodyCount)));
+}
+
+// How many template notes the generation loops below emit for a pattern of totalSteps.
+static size_t countTemplateNotes(const AssetLibrary::TemplateSequence& tpl, int totalSteps)
+{
+    size_t count = 0;
+    for (int loopStart = 0; loopStart < totalSteps; loopStart += tpl.lengthSteps)
+        for (const auto& tn : tpl.notes)
+            if (loopStart + tn.startStep < totalSteps)
+                ++count;
+    return count;
 }
 
 static void generateChordPart(GeneratedPattern& out,
@@ -68,19 +148,18 @@ static void generateChordPart(GeneratedPattern& out,
                               int inputVelocity,
                               int channel,
                               AssetLibrary& library,
-                              juce::Random& rnd)
+                              LeapScorer* scorer)
 {
-    const bool minor = (params.modeIndex != 0);
+    const int mode = params.modeIndex;
     const int keyRoot = params.keyIndex;
     const int totalSteps = params.lengthBars * stepsPerBar;
     out.lengthSteps = totalSteps;
 
-    const auto templateIndex = int(params.seed % uint32_t(AssetLibrary::kChordCount));
-    const auto tpl = library.getChordTemplate(templateIndex);
+    const auto& tpl = chordTemplateFor(params, library);
     const auto baseVel = pickVelocityVariation(params.seed + 13u);
-    const bool arpeggio = (params.genreIndex % 2) == 1 || rnd.nextBool();
+    const bool arpeggio = (params.genreIndex % 2) == 1 || randomFor(params, RandomStream::chordStyle).coin(0);
 
-    const std::array<int, 4> intervals = minor ? std::array<int, 4>{ 0, 3, 7, 10 } : std::array<int, 4>{ 0, 4, 7, 11 };
+    const std::array<int, 4> intervals = isMinorMode(mode) ? std::array<int, 4>{ 0, 3, 7, 10 } : std::array<int, 4>{ 0, 4, 7, 11 };
 
     for (int loopStart = 0; loopStart < totalSteps; loopStart += tpl.lengthSteps)
     {
@@ -89,28 +168,31 @@ static void generateChordPart(GeneratedPattern& out,
             const int start = loopStart + tn.startStep;
             if (start >= totalSteps)
                 continue;
+            if (isAbandoned(scorer))
+                return;
 
             const int pitchClassOffset = tn.noteNumber % 12; // file encodes degrees as pitch class offsets from C
-            const int chordRoot = snapToScale(rootNote + pitchClassOffset, keyRoot, minor);
+            const int chordRoot = snapToScale(rootNote + pitchClassOffset, keyRoot, mode);
             const int vel = mixVelocity(baseVel, inputVelocity, params.velocitySensitivity);
             const int dur = juce::jlimit(1, totalSteps - start, tn.lengthSteps);
 
             if (!arpeggio)
             {
                 for (int v = 0; v < 4; ++v)
-                    addNote(out, snapToScale(chordRoot + intervals[v], keyRoot, minor), start, dur, vel, channel, v);
+                    addNote(out, snapToScale(chordRoot + intervals[v], keyRoot, mode), start, dur, vel, channel, v, scorer);
             }
             else
             {
                 const int arpLen = juce::jmax(1, juce::jmin(4, dur));
                 for (int v = 0; v < 4; ++v)
                     addNote(out,
-                            snapToScale(chordRoot + intervals[v], keyRoot, minor),
+                            snapToScale(chordRoot + intervals[v], keyRoot, mode),
                             start + (v % arpLen),
                             1,
                             vel,
                             channel,
-                            v);
+                            v,
+                            scorer);
             }
         }
     }
@@ -118,6 +200,43 @@ static void generateChordPart(GeneratedPattern& out,
     out.numTracks = 4;
 }
 
+// Distinct chord tones starting at each step, indexed once per hybrid pattern so the
+// melody pass can look them up in O(1) instead of rescanning the chord part per note.
+struct ChordToneMap
+{
+    static constexpr int kMaxSteps = 16 * stepsPerBar;
+    static constexpr int kMaxTonesPerStep = 8; // templates start at most one chord (4 voices) per step
+
+    struct Tones
+    {
+        uint8_t count = 0;
+        std::array<uint8_t, kMaxTonesPerStep> notes {};
+    };
+
+    void build(const GeneratedPattern& chordPart, int keyRoot, int mode)
+    {
+        for (const auto& n : chordPart.notes)
+        {
+            if (n.getStartStep() >= kMaxSteps)
+                continue;
+
+            auto& t = steps[(size_t) n.getStartStep()];
+            const auto note = snapToScale(n.getNoteNumber(), keyRoot, mode);
+            const auto end = t.notes.begin() + t.count;
+            if (t.count < kMaxTonesPerStep && std::find(t.notes.begin(), end, (uint8_t) note) == end)
+                t.notes[t.count++] = (uint8_t) note;
+        }
+    }
+
+    const Tones& at(int step) const
+    {
+        static const Tones none;
+        return (step >= 0 && step < kMaxSteps) ? steps[(size_t) step] : none;
+    }
+
+    std::array<Tones, kMaxSteps> steps {};
+};
+
 static void generateMelodyPart(GeneratedPattern& out,
                                const GenerationParams& params,
                                int rootNote,
@@ -125,18 +244,21 @@ static void generateMelodyPart(GeneratedPattern& out,
                                int channel,
                                int melodyTrack,
                                AssetLibrary& library,
-                               juce::Random& rnd,
-                               std::function<juce::Array<int>(int step)> chordTonesAtStep)
+                               const ChordToneMap* chordTones,
+                               LeapScorer* scorer)
 {
-    const bool minor = (params.modeIndex != 0);
+    const int mode = params.modeIndex;
     const int keyRoot = params.keyIndex;
     const int totalSteps = params.lengthBars * stepsPerBar;
     out.lengthSteps = totalSteps;
 
-    const auto templateIndex = int((params.seed * 17u + 3u) % uint32_t(AssetLibrary::kMelodyCount));
-    const auto tpl = library.getMelodyTemplate(templateIndex);
+    const auto& tpl = melodyTemplateFor(params, library);
 
-    int lastNote = snapToScale(rootNote, keyRoot, minor);
+    const auto followChord = randomFor(params, RandomStream::followChord);
+    const auto chordTone = randomFor(params, RandomStream::chordTone);
+    uint64_t ordinal = 0;
+
+    int lastNote = snapToScale(rootNote, keyRoot, mode);
     int lastStep = -999;
 
     for (int loopStart = 0; loopStart < totalSteps; loopStart += tpl.lengthSteps)
@@ -146,51 +268,93 @@ static void generateMelodyPart(GeneratedPattern& out,
             const int start = loopStart + tn.startStep;
             if (start >= totalSteps)
                 continue;
+            if (isAbandoned(scorer))
+                return;
 
             int note = rootNote + (tn.noteNumber - 60);
-            note = snapToScale(note, keyRoot, minor);
+            note = snapToScale(note, keyRoot, mode);
 
             // Hybrid "AI": 80% (or caller-defined) chance to stick to chord tones at the step.
-            if (chordTonesAtStep != nullptr && rnd.nextFloat() < params.melodyFollowChordChance)
+            if (chordTones != nullptr && followChord.unitFloat(ordinal) < params.melodyFollowChordChance)
             {
-                const auto tones = chordTonesAtStep(start);
-                if (tones.size() > 0)
-                    note = tones[rnd.nextInt(tones.size())];
+                const auto& tones = chordTones->at(start);
+                if (tones.count > 0)
+                    note = tones.notes[(size_t) chordTone.below(ordinal, (int) tones.count)];
             }
 
-            // 98% hit-worthy filter: avoid big consecutive leaps (> minor 9th).
             if (start != lastStep)
-            {
-                int diff = std::abs(note - lastNote);
-                while (diff > 13)
-                {
-                    note += (note > lastNote) ? -12 : 12;
-                    note = snapToScale(note, keyRoot, minor);
-                    diff = std::abs(note - lastNote);
-                    if (diff <= 13)
-                        break;
-                    note = lastNote + juce::jlimit(-13, 13, note - lastNote);
-                    note = snapToScale(note, keyRoot, minor);
-                    diff = std::abs(note - lastNote);
-                }
-            }
+                note = limitLeap(note, lastNote, keyRoot, mode);
 
-            // 5-15% velocity randomisation + velocity sensitivity blend
-            const auto velRand = 0.05f + 0.10f * rnd.nextFloat();
-            const auto rawVel = juce::roundToInt(float(tn.velocity) * (1.0f + (rnd.nextBool() ? velRand : -velRand)));
-            const auto vel = mixVelocity(rawVel, inputVelocity, params.velocitySensitivity);
+            const auto vel = mixVelocity(randomiseVelocity(tn.velocity, params, ordinal), inputVelocity, params.velocitySensitivity);
 
             const int dur = juce::jlimit(1, totalSteps - start, tn.lengthSteps);
-            addNote(out, note, start, dur, vel, channel, melodyTrack);
+            addNote(out, note, start, dur, vel, channel, melodyTrack, scorer);
 
             lastNote = note;
             lastStep = start;
+            ++ordinal;
         }
     }
 
     out.numTracks = juce::jmax(out.numTracks, melodyTrack + 1);
 }
 
+// Markov melody on track 0: onsets, lengths and intervals are sampled from the library's
+// per-genre tables (draw i of each stream belongs to the i-th note), then go through the
+// same scale snap and leap filter as template melodies.
+static void generateMarkovPart(GeneratedPattern& out,
+                               const GenerationParams& params,
+                               int rootNote,
+                               int inputVelocity,
+                               int channel,
+                               const AssetLibrary& library)
+{
+    const int mode = params.modeIndex;
+    const int keyRoot = params.keyIndex;
+    const int totalSteps = params.lengthBars * stepsPerBar;
+    out.lengthSteps = totalSteps;
+
+    const auto& model = library.getMarkovModel();
+    const int genre = params.genreIndex;
+    const auto intervals = randomFor(params, RandomStream::markovInterval);
+    const auto gaps = randomFor(params, RandomStream::markovGap);
+    const auto lengths = randomFor(params, RandomStream::markovLength);
+    constexpr auto none = MarkovMelodyModel::kNoPrevious;
+
+    const int home = snapToScale(rootNote, keyRoot, mode);
+    int lastNote = home;
+    int previousInterval = none;
+
+    // The first onset is the gap from the pattern start, and the context of the next one.
+    int start = model.sampleGap(genre, none, gaps.bits(0));
+    int previousGap = start;
+    for (uint64_t ordinal = 0; start < totalSteps; ++ordinal)
+    {
+        int note = home;
+        if (ordinal > 0)
+        {
+            // Steps that would end more than an octave from the root are turned back towards it.
+            int interval = model.sampleInterval(genre, previousInterval, intervals.bits(ordinal));
+            if (std::abs(lastNote + interval - home) > 12)
+                interval = lastNote + interval > home ? -std::abs(interval) : std::abs(interval);
+
+            note = snapToScale(lastNote + interval, keyRoot, mode);
+            if (previousGap != 0)
+                note = limitLeap(note, lastNote, keyRoot, mode);
+            previousInterval = interval;
+        }
+
+        const int gap = model.sampleGap(genre, previousGap, gaps.bits(ordinal + 1));
+        const int dur = juce::jlimit(1, totalSteps - start, model.sampleLength(genre, gap, lengths.bits(ordinal)));
+        const auto vel = mixVelocity(randomiseVelocity(model.getMeanVelocity(genre), params, ordinal), inputVelocity, params.velocitySensitivity);
+        addNote(out, note, start, dur, vel, channel, 0, nullptr);
+
+        lastNote = note;
+        previousGap = gap;
+        start += gap;
+    }
+}
+
 GeneratedPattern MelodyGenerator::generate(const GenerationParams& params,
                                           int inputRootMidiNote,
                                           int inputVelocity,
@@ -198,51 +362,112 @@ GeneratedPattern MelodyGenerator::generate(const GenerationParams& params,
                                           AssetLibrary& library) const
 {
     GeneratedPattern out;
+    generateInto(out, params, inputRootMidiNote, inputVelocity, outputChannel, library);
+    return out;
+}
+
+// Shared by generateInto() and generateScored(). With a scorer, the note-count terms of the
+// score are known before any note is emitted (the template loops fix the count), and generation
+// stops as soon as the running score can no longer beat scorer->scoreToBeat.
+static void generatePattern(GeneratedPattern& out,
+                            const GenerationParams& params,
+                            int inputRootMidiNote,
+                            int inputVelocity,
+                            int outputChannel,
+                            AssetLibrary& library,
+                            LeapScorer* scorer)
+{
+    out.numTracks = 1;
+    out.notes.clear();
     out.notes.reserve(2048);
 
-    juce::Random rnd(params.seed);
+    if (scorer != nullptr && params.type != GeneratorType::markov)
+    {
+        const int totalSteps = params.lengthBars * stepsPerBar;
+        size_t numNotes = 0;
+        if (params.type != GeneratorType::melody)
+            numNotes += 4 * countTemplateNotes(chordTemplateFor(params, library), totalSteps);
+        if (params.type != GeneratorType::chord)
+            numNotes += countTemplateNotes(melodyTemplateFor(params, library), totalSteps);
+
+        scorer->type = params.type;
+        scorer->value = numNotes > 0 ? scoreBeforeLeaps(numNotes, totalSteps, params.type) : -1.0;
+        scorer->abandoned = scorer->value <= scorer->scoreToBeat;
+        if (scorer->abandoned)
+            return;
+    }
+
     const int root = juce::jlimit(0, 127, inputRootMidiNote);
     const int velIn = juce::jlimit(1, 127, inputVelocity);
     const int channel = juce::jlimit(1, 16, outputChannel);
 
     if (params.type == GeneratorType::chord)
     {
-        generateChordPart(out, params, root, velIn, channel, library, rnd);
+        generateChordPart(out, params, root, velIn, channel, library, scorer);
         out.numTracks = 4;
-        return out;
+        return;
+    }
+
+    if (params.type == GeneratorType::markov)
+    {
+        // The note count is only known once the melody has been sampled, so the score is
+        // accumulated afterwards and nothing is abandoned early.
+        generateMarkovPart(out, params, root, velIn, channel, library);
+        out.numTracks = 1;
+
+        if (scorer != nullptr)
+        {
+            scorer->type = params.type;
+            scorer->value = out.notes.empty() ? -1.0 : scoreBeforeLeaps(out.notes.size(), out.lengthSteps, params.type);
+            scorer->abandoned = scorer->value <= scorer->scoreToBeat;
+            for (const auto& n : out.notes)
+                scorer->add(n);
+        }
+        return;
     }
 
     if (params.type == GeneratorType::melody)
     {
-        generateMelodyPart(out, params, root, velIn, channel, 0, library, rnd, nullptr);
+        generateMelodyPart(out, params, root, velIn, channel, 0, library, nullptr, scorer);
         out.numTracks = 1;
-        return out;
+        return;
     }
 
-    // Hybrid: chord + melody, with chord-tone adherence.
-    GeneratedPattern chordPart;
-    chordPart.notes.reserve(1024);
-    generateChordPart(chordPart, params, root, velIn, channel, library, rnd);
+    // Hybrid: chord + melody, with chord-tone adherence. The chord part goes straight into
+    // `out`; the melody is appended after it, on track 4.
+    generateChordPart(out, params, root, velIn, channel, library, scorer);
+    if (isAbandoned(scorer))
+        return;
 
-    auto tonesAtStep = [minor = (params.modeIndex != 0), keyRoot = params.keyIndex, &chordPart](int step) -> juce::Array<int>
-    {
-        juce::Array<int> tones;
-        for (const auto& n : chordPart.notes)
-        {
-            if (n.startStep == step)
-            {
-                const auto note = snapToScale(n.noteNumber, keyRoot, minor);
-                if (!tones.contains(note))
-                    tones.add(note);
-            }
-        }
-        return tones;
-    };
+    ChordToneMap chordTones;
+    chordTones.build(out, params.keyIndex, params.modeIndex);
 
-    out = chordPart;
-    generateMelodyPart(out, params, root, velIn, channel, 4, library, rnd, tonesAtStep);
+    generateMelodyPart(out, params, root, velIn, channel, 4, library, &chordTones, scorer);
     out.numTracks = 5;
-    return out;
+}
+
+void MelodyGenerator::generateInto(GeneratedPattern& out,
+                                   const GenerationParams& params,
+                                   int inputRootMidiNote,
+                                   int inputVelocity,
+                                   int outputChannel,
+                                   AssetLibrary& library) const
+{
+    generatePattern(out, params, inputRootMidiNote, inputVelocity, outputChannel, library, nullptr);
+}
+
+double MelodyGenerator::generateScored(GeneratedPattern& out,
+                                       const GenerationParams& params,
+                                       int inputRootMidiNote,
+                                       int inputVelocity,
+                                       int outputChannel,
+                                       AssetLibrary& library,
+                                       double scoreToBeat) const
+{
+    LeapScorer scorer;
+    scorer.scoreToBeat = scoreToBeat;
+    generatePattern(out, params, inputRootMidiNote, inputVelocity, outputChannel, library, &scorer);
+    return scorer.abandoned ? -std::numeric_limits<double>::infinity() : scorer.value;
 }
 
 double MelodyGenerator::score(const GeneratedPattern& pattern, const GenerationParams& params) const
@@ -250,29 +475,13 @@ double MelodyGenerator::score(const GeneratedPattern& pattern, const GenerationP
     if (pattern.notes.empty())
         return -1.0;
 
-    double s = 0.0;
-    s += double(pattern.notes.size()) * 0.01;
-
-    // Prefer some rhythmic density, but avoid floods.
-    const double density = double(pattern.notes.size()) / juce::jmax(1, pattern.lengthSteps);
-    s -= std::abs(density - (params.type == GeneratorType::melody ? 0.50 : 0.35)) * 2.0;
+    LeapScorer scorer;
+    scorer.type = params.type;
+    scorer.value = scoreBeforeLeaps(pattern.notes.size(), pattern.lengthSteps, params.type);
 
-    // Penalise large melodic jumps on the melody track (if present).
-    int lastMelNote = -1, lastStep = -999;
     for (const auto& n : pattern.notes)
-    {
-        if (n.track != 4 && params.type == GeneratorType::hybrid)
-            continue;
-        if (params.type == GeneratorType::melody && n.track != 0)
-            continue;
-
-        if (lastMelNote >= 0 && n.startStep != lastStep)
-            s -= std::max(0, std::abs(n.noteNumber - lastMelNote) - 7) * 0.02;
+        scorer.add(n);
 
-        lastMelNote = n.noteNumber;
-        lastStep = n.startStep;
-    }
-
-    return s;
+    return scorer.value;
 }
 } // namespace mfpr
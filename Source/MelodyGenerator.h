@@ -8,7 +8,8 @@ enum class GeneratorType
 {
     chord = 0,
     melody = 1,
-    hybrid = 2
+    hybrid = 2,
+    markov = 3  // melody sampled from the library's Markov tables instead of a single template
 };
 
 struct MidiNote
@@ -21,18 +22,91 @@ struct MidiNote
     int track = 0;        // 0..15
 };
 
+// The stored form of a note: 8 bytes instead of MidiNote's 24. Values are clamped to
+// their MidiNote ranges on construction (steps to 0..65535).
+class PackedNote
+{
+public:
+    static constexpr int kMaxSteps = 65535;
+
+    PackedNote() = default;
+
+    PackedNote(int noteNumber, int startStep, int lengthSteps, int velocity, int channel, int track) noexcept
+        : start((uint16_t) juce::jlimit(0, kMaxSteps, startStep))
+        , length((uint16_t) juce::jlimit(1, kMaxSteps, lengthSteps))
+        , note((uint8_t) juce::jlimit(0, 127, noteNumber))
+        , vel((uint8_t) juce::jlimit(1, 127, velocity))
+        , channelAndTrack((uint8_t) ((juce::jlimit(1, 16, channel) - 1) | (juce::jlimit(0, 15, track) << 4)))
+    {
+    }
+
+    explicit PackedNote(const MidiNote& n) noexcept
+        : PackedNote(n.noteNumber, n.startStep, n.lengthSteps, n.velocity, n.channel, n.track)
+    {
+    }
+
+    int getNoteNumber() const noexcept { return note; }
+    int getStartStep() const noexcept { return start; }
+    int getLengthSteps() const noexcept { return length; }
+    int getEndStep() const noexcept { return start + length; }
+    int getVelocity() const noexcept { return vel; }
+    int getChannel() const noexcept { return (channelAndTrack & 0x0f) + 1; }
+    int getTrack() const noexcept { return channelAndTrack >> 4; }
+
+    void setChannel(int channel) noexcept
+    {
+        channelAndTrack = (uint8_t) ((channelAndTrack & 0xf0) | (juce::jlimit(1, 16, channel) - 1));
+    }
+
+    MidiNote toMidiNote() const noexcept
+    {
+        return { getNoteNumber(), getStartStep(), getLengthSteps(), getVelocity(), getChannel(), getTrack() };
+    }
+
+    bool operator==(const PackedNote& other) const noexcept
+    {
+        return start == other.start && length == other.length && note == other.note && vel == other.vel
+            && channelAndTrack == other.channelAndTrack;
+    }
+    bool operator!=(const PackedNote& other) const noexcept { return !(*this == other); }
+
+private:
+    uint16_t start = 0;
+    uint16_t length = 1;
+    uint8_t note = 60;
+    uint8_t vel = 100;
+    uint8_t channelAndTrack = 0; // low nibble: channel - 1, high nibble: track
+};
+
+static_assert(sizeof(PackedNote) == 8, "PackedNote must stay 8 bytes");
+
 struct GeneratedPattern
 {
     int lengthSteps = 64;  // 4 bars @ 16 steps/bar
     int numTracks = 1;     // 1..16
-    std::vector<MidiNote> notes;
+    std::vector<PackedNote> notes;
 };
 
+// Conversions for code that wants plain MidiNote fields.
+inline std::vector<PackedNote> packNotes(const std::vector<MidiNote>& notes)
+{
+    return std::vector<PackedNote>(notes.begin(), notes.end());
+}
+
+inline std::vector<MidiNote> unpackNotes(const std::vector<PackedNote>& notes)
+{
+    std::vector<MidiNote> out;
+    out.reserve(notes.size());
+    for (const auto& n : notes)
+        out.push_back(n.toMidiNote());
+    return out;
+}
+
 struct GenerationParams
 {
     int genreIndex = 0;             // 0..31
     int keyIndex = 0;               // 0..11 (C..B)
-    int modeIndex = 0;              // 0=Major, 1=Minor
+    int modeIndex = 0;              // index into kModes (0=Major, 1=Minor, ...)
     int lengthBars = 4;             // 4/8/12/16
     GeneratorType type = GeneratorType::chord;
     int velocitySensitivity = 80;   // 0..100
@@ -54,6 +128,26 @@ public:
                               int outputChannel,
                               AssetLibrary& library) const;
 
+    // Same as generate(), but overwrites `out` and reuses its note storage, so a caller
+    // that keeps the pattern around between calls generates without heap allocations.
+    void generateInto(GeneratedPattern& out,
+                      const GenerationParams& params,
+                      int inputRootMidiNote,
+                      int inputVelocity,
+                      int outputChannel,
+                      AssetLibrary& library) const;
+
+    // generateInto() that also returns score(out, params), accumulated while the notes are
+    // emitted. If the score can no longer end up above scoreToBeat, generation stops early
+    // and -infinity is returned (`out` is then incomplete).
+    double generateScored(GeneratedPattern& out,
+                          const GenerationParams& params,
+                          int inputRootMidiNote,
+                          int inputVelocity,
+                          int outputChannel,
+                          AssetLibrary& library,
+                          double scoreToBeat = -std::numeric_limits<double>::infinity()) const;
+
     double score(const GeneratedPattern& pattern, const GenerationParams& params) const;
 };
 } // namespace mfpr
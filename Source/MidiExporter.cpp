@@ -2,27 +2,169 @@
 
 namespace mfpr
 {
-static void addTimeSigAndTempo(juce::MidiMessageSequence& track,
-                               int numerator,
-                               int denominator,
-                               double bpm,
-                               int ticksPerQuarter)
+static int toTicksFromSteps(int step, int ticksPerQuarter)
 {
-    const auto metaTimeSig = juce::MidiMessage::timeSignatureMetaEvent(numerator, denominator);
-    track.addEvent(metaTimeSig, 0.0);
+    const auto stepTicks = ticksPerQuarter / 4;
+    return step * stepTicks;
+}
 
-    const auto mpqn = int(60'000'000.0 / juce::jmax(1.0, bpm));
-    const auto metaTempo = juce::MidiMessage::tempoMetaEvent(mpqn);
-    track.addEvent(metaTempo, 0.0);
+// One channel event (or a placeholder for the track-0 meta events) awaiting encoding.
+struct SmfEvent
+{
+    int track = 0;
+    int tick = 0;
+    uint32_t order = 0; // insertion order: equal ticks keep it, like MidiMessageSequence::addEvent
+    juce::uint8 status = 0;
+    juce::uint8 data1 = 0;
+    juce::uint8 data2 = 0;
+};
+
+// Appends big-endian SMF data to a MemoryBlock without per-event objects.
+class SmfByteWriter
+{
+public:
+    explicit SmfByteWriter(juce::MemoryBlock& destination, size_t expectedSize) : block(destination)
+    {
+        block.setSize(expectedSize, false);
+    }
 
-    track.updateMatchedPairs();
-    juce::ignoreUnused(ticksPerQuarter);
-}
+    void writeByte(juce::uint8 b)
+    {
+        if (size == block.getSize())
+            block.setSize(size * 2 + 64, false);
+        static_cast<juce::uint8*>(block.getData())[size++] = b;
+    }
 
-static int toTicksFromSteps(int step, int ticksPerQuarter)
+    void writeBytes(const juce::uint8* data, int numBytes)
+    {
+        for (int i = 0; i < numBytes; ++i)
+            writeByte(data[i]);
+    }
+
+    void writeTag(const char* tag)
+    {
+        writeBytes(reinterpret_cast<const juce::uint8*>(tag), 4);
+    }
+
+    void writeInt32(uint32_t v)
+    {
+        writeByte(juce::uint8(v >> 24));
+        writeByte(juce::uint8(v >> 16));
+        writeByte(juce::uint8(v >> 8));
+        writeByte(juce::uint8(v));
+    }
+
+    void writeInt16(uint32_t v)
+    {
+        writeByte(juce::uint8(v >> 8));
+        writeByte(juce::uint8(v));
+    }
+
+    // Same encoding as juce::MidiFile (at most four bytes).
+    void writeVariableLengthInt(uint32_t v)
+    {
+        auto buffer = v & 0x7f;
+        while ((v >>= 7) != 0)
+        {
+            buffer <<= 8;
+            buffer |= ((v & 0x7f) | 0x80);
+        }
+
+        for (;;)
+        {
+            writeByte(juce::uint8(buffer));
+            if ((buffer & 0x80) == 0)
+                break;
+            buffer >>= 8;
+        }
+    }
+
+    void patchInt32(size_t position, uint32_t v)
+    {
+        auto* d = static_cast<juce::uint8*>(block.getData()) + position;
+        d[0] = juce::uint8(v >> 24);
+        d[1] = juce::uint8(v >> 16);
+        d[2] = juce::uint8(v >> 8);
+        d[3] = juce::uint8(v);
+    }
+
+    size_t getPosition() const { return size; }
+    void finish() { block.setSize(size, false); }
+
+private:
+    juce::MemoryBlock& block;
+    size_t size = 0;
+};
+
+// Encodes one MTrk chunk. Mirrors what juce::MidiMessageSequence::updateMatchedPairs() followed by
+// juce::MidiFile::writeTo() produce: a note-on that re-triggers a still-sounding note of the same
+// channel/pitch first gets a note-off at the same tick, and running status is used for channel events.
+static void writeTrack(SmfByteWriter& out,
+                       const SmfEvent* begin,
+                       const SmfEvent* end,
+                       const juce::MidiMessage* metaEvents)
 {
-    const auto stepTicks = ticksPerQuarter / 4;
-    return step * stepTicks;
+    out.writeTag("MTrk");
+    const auto lengthPos = out.getPosition();
+    out.writeInt32(0);
+    const auto dataStart = out.getPosition();
+
+    std::array<bool, 16 * 128> sounding {};
+    int lastTick = 0;
+    juce::uint8 lastStatus = 0;
+    int numWritten = 0;
+
+    auto writeDelta = [&](int tick)
+    {
+        out.writeVariableLengthInt((uint32_t) juce::jmax(0, tick - lastTick));
+        lastTick = tick;
+    };
+
+    auto writeChannelEvent = [&](int tick, juce::uint8 status, juce::uint8 d1, juce::uint8 d2)
+    {
+        writeDelta(tick);
+        if (status != lastStatus || numWritten == 0)
+            out.writeByte(status);
+        out.writeByte(d1);
+        out.writeByte(d2);
+        lastStatus = status;
+        ++numWritten;
+    };
+
+    for (auto* e = begin; e != end; ++e)
+    {
+        if (e->status == 0xff)
+        {
+            const auto& meta = metaEvents[e->data1];
+            writeDelta(e->tick);
+            out.writeBytes(meta.getRawData(), meta.getRawDataSize());
+            lastStatus = 0xff;
+            ++numWritten;
+            continue;
+        }
+
+        const auto channel = e->status & 0x0f;
+        auto& isSounding = sounding[(size_t) (channel * 128 + e->data1)];
+
+        if ((e->status & 0xf0) == 0x90)
+        {
+            if (isSounding)
+                writeChannelEvent(e->tick, juce::uint8(0x80 | channel), e->data1, 0);
+            isSounding = true;
+        }
+        else
+        {
+            isSounding = false;
+        }
+
+        writeChannelEvent(e->tick, e->status, e->data1, e->data2);
+    }
+
+    const auto endOfTrack = juce::MidiMessage::endOfTrack();
+    out.writeByte(0);
+    out.writeBytes(endOfTrack.getRawData(), endOfTrack.getRawDataSize());
+
+    out.patchInt32(lengthPos, (uint32_t) (out.getPosition() - dataStart));
 }
 
 juce::MemoryBlock MidiExporter::renderPatternToMidiFileBytes(const GeneratedPattern& pattern, const Settings& settings)
@@ -32,41 +174,72 @@ juce::MemoryBlock MidiExporter::renderPatternToMidiFileBytes(const GeneratedPatt
     const auto requestedTracks = settings.forceNumTracks > 0 ? settings.forceNumTracks : pattern.numTracks;
     const auto numTracks = juce::jlimit(1, 16, requestedTracks);
 
-    juce::MidiFile midi;
-    midi.setTicksPerQuarterNote(ticksPerQuarter);
+    const juce::MidiMessage metaEvents[] = {
+        juce::MidiMessage::timeSignatureMetaEvent(settings.timeSigNumerator, settings.timeSigDenominator),
+        juce::MidiMessage::tempoMetaEvent(int(60'000'000.0 / juce::jmax(1.0, settings.bpm))),
+    };
 
-    std::vector<juce::MidiMessageSequence> tracks;
-    tracks.resize((size_t) numTracks);
+    // Reused between calls on the same thread, so steady-state export does not allocate here.
+    thread_local std::vector<SmfEvent> events;
+    events.clear();
+    events.reserve(pattern.notes.size() * 2 + 2);
 
-    addTimeSigAndTempo(tracks[0], settings.timeSigNumerator, settings.timeSigDenominator, settings.bpm, ticksPerQuarter);
+    uint32_t order = 0;
+    events.push_back({ 0, 0, order++, 0xff, 0, 0 }); // time signature
+    events.push_back({ 0, 0, order++, 0xff, 1, 0 }); // tempo
 
     for (const auto& n : pattern.notes)
     {
-        const auto tr = juce::jlimit(0, numTracks - 1, n.track);
-        const auto startTick = toTicksFromSteps(n.startStep, ticksPerQuarter);
-        const auto endTick = toTicksFromSteps(n.startStep + juce::jmax(1, n.lengthSteps), ticksPerQuarter);
+        const auto tr = juce::jmin(numTracks - 1, n.getTrack());
+        const auto startTick = toTicksFromSteps(n.getStartStep(), ticksPerQuarter);
+        const auto endTick = toTicksFromSteps(n.getEndStep(), ticksPerQuarter);
+        const auto channel = juce::uint8(n.getChannel() - 1);
+        const auto note = juce::uint8(n.getNoteNumber());
+
+        events.push_back({ tr, startTick, order++, juce::uint8(0x90 | channel), note, juce::uint8(n.getVelocity()) });
+        events.push_back({ tr, endTick, order++, juce::uint8(0x80 | channel), note, 0 });
+    }
 
-        auto on = juce::MidiMessage::noteOn(n.channel, n.noteNumber, (juce::uint8) juce::jlimit(1, 127, n.velocity));
-        on.setTimeStamp((double) startTick);
-        tracks[(size_t) tr].addEvent(on);
+    std::sort(events.begin(), events.end(), [](const SmfEvent& a, const SmfEvent& b)
+    {
+        if (a.track != b.track)
+            return a.track < b.track;
+        if (a.tick != b.tick)
+            return a.tick < b.tick;
+        return a.order < b.order;
+    });
 
-        auto off = juce::MidiMessage::noteOff(n.channel, n.noteNumber);
-        off.setTimeStamp((double) endTick);
-        tracks[(size_t) tr].addEvent(off);
-    }
+    juce::MemoryBlock mb;
+    SmfByteWriter out(mb, 14 + (size_t) numTracks * 12 + events.size() * 4 + 32);
+
+    out.writeTag("MThd");
+    out.writeInt32(6);
+    out.writeInt16(1); // type 1: simultaneous tracks
+    out.writeInt16((uint32_t) numTracks);
+    out.writeInt16((uint32_t) ticksPerQuarter);
 
-    for (auto& t : tracks)
+    const auto* e = events.data();
+    const auto* const end = e + events.size();
+    for (int t = 0; t < numTracks; ++t)
     {
-        t.updateMatchedPairs();
-        midi.addTrack(t);
+        const auto* trackEnd = e;
+        while (trackEnd != end && trackEnd->track == t)
+            ++trackEnd;
+
+        writeTrack(out, e, trackEnd, metaEvents);
+        e = trackEnd;
     }
 
-    juce::MemoryBlock mb;
-    juce::MemoryOutputStream mos(mb, false);
-    midi.writeTo(mos);
+    out.finish();
     return mb;
 }
 
+bool MidiExporter::writePatternToStream(const GeneratedPattern& pattern, juce::OutputStream& stream, const Settings& settings)
+{
+    const auto bytes = renderPatternToMidiFileBytes(pattern, settings);
+    return stream.write(bytes.getData(), bytes.getSize());
+}
+
 bool MidiExporter::writePatternToFile(const GeneratedPattern& pattern, const juce::File& file, const Settings& settings)
 {
     file.getParentDirectory().createDirectory();
@@ -74,4 +247,3 @@ bool MidiExporter::writePatternToFile(const GeneratedPattern& pattern, const juc
     return file.replaceWithData(bytes.getData(), bytes.getSize());
 }
 } // namespace mfpr
-
@@ -20,6 +20,10 @@ public:
     };
 
     static bool writePatternToFile(const GeneratedPattern& pattern, const juce::File& file, const Settings& settings);
+    static bool writePatternToStream(const GeneratedPattern& pattern, juce::OutputStream& stream, const Settings& settings);
+
+    // Encodes the Standard MIDI File directly (no juce::MidiFile / MidiMessage per note).
+    // The bytes are identical to what juce::MidiFile::writeTo produces for the same tracks.
     static juce::MemoryBlock renderPatternToMidiFileBytes(const GeneratedPattern& pattern, const Settings& settings);
 };
 } // namespace mfpr
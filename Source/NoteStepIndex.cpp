@@ -0,0 +1,39 @@
+#include "NoteStepIndex.h"
+
+namespace mfpr
+{
+void NoteStepIndex::build(const std::vector<PackedNote>& notes)
+{
+    source = &notes;
+
+    int endStep = 0;
+    for (const auto& n : notes)
+        endStep = juce::jmax(endStep, n.getEndStep());
+    const int numBuckets = (endStep + kBucketSteps - 1) / kBucketSteps;
+
+    // Counting sort into buckets: count, turn counts into offsets, then fill.
+    bucketStart.assign((size_t) numBuckets + 1, 0);
+    for (const auto& n : notes)
+        for (int b = n.getStartStep() / kBucketSteps; b <= (n.getEndStep() - 1) / kBucketSteps; ++b)
+            ++bucketStart[(size_t) b + 1];
+
+    for (int b = 0; b < numBuckets; ++b)
+        bucketStart[(size_t) b + 1] += bucketStart[(size_t) b];
+
+    entries.resize((size_t) bucketStart.back());
+    std::vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+    for (int i = 0; i < (int) notes.size(); ++i)
+    {
+        const auto& n = notes[(size_t) i];
+        for (int b = n.getStartStep() / kBucketSteps; b <= (n.getEndStep() - 1) / kBucketSteps; ++b)
+            entries[(size_t) fill[(size_t) b]++] = i;
+    }
+}
+
+void NoteStepIndex::clear()
+{
+    source = nullptr;
+    bucketStart.clear();
+    entries.clear();
+}
+} // namespace mfpr
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "MelodyGenerator.h"
+
+namespace mfpr
+{
+// Finds the notes of a pattern that overlap a range of steps, in time proportional to the
+// buckets the range covers and the notes found, however long the pattern is. Each note is
+// filed under every kBucketSteps-step bucket it overlaps.
+class NoteStepIndex final
+{
+public:
+    static constexpr int kBucketSteps = 16; // one bar
+
+    // Indexes `notes`, which must stay unchanged while the index is used.
+    void build(const std::vector<PackedNote>& notes);
+    void clear();
+
+    // Calls fn(const PackedNote&) once for each indexed note overlapping [fromStep, toStep),
+    // in no particular order.
+    template <typename Fn>
+    void forEachInRange(int fromStep, int toStep, Fn&& fn) const
+    {
+        if (source == nullptr || toStep <= fromStep)
+            return;
+
+        const int numBuckets = (int) bucketStart.size() - 1;
+        const int first = juce::jmax(0, fromStep / kBucketSteps);
+        const int last = juce::jmin(numBuckets - 1, (toStep - 1) / kBucketSteps);
+        for (int b = first; b <= last; ++b)
+        {
+            for (int i = bucketStart[(size_t) b]; i < bucketStart[(size_t) b + 1]; ++i)
+            {
+                const auto& n = (*source)[(size_t) entries[(size_t) i]];
+
+                // A note spanning several buckets is reported from the first one in the range.
+                if (b > first && n.getStartStep() / kBucketSteps < b)
+                    continue;
+                if (n.getEndStep() > fromStep && n.getStartStep() < toStep)
+                    fn(n);
+            }
+        }
+    }
+
+private:
+    const std::vector<PackedNote>* source = nullptr;
+    std::vector<int> bucketStart; // entries of bucket b are [bucketStart[b], bucketStart[b + 1])
+    std::vector<int> entries;     // indices into *source
+};
+} // namespace mfpr
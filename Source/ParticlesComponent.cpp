@@ -6,19 +6,25 @@ ParticlesComponent::ParticlesComponent()
 {
     setInterceptsMouseClicks(false, false);
     particles.resize(64);
+}
+
+void ParticlesComponent::resized()
+{
+    // Scattered over the new area.
     for (auto& p : particles)
         resetParticle(p, rnd);
 }
 
 void ParticlesComponent::setEnabled(bool shouldAnimate)
 {
+    if (shouldAnimate == enabled)
+        return;
+
     enabled = shouldAnimate;
     setVisible(enabled);
-    if (enabled)
-        startTimerHz(30);
-    else
-        stopTimer();
-    repaint();
+    rateIndex = 0;
+    lastFrameMs = 0.0;
+    lastVisibilityCheckMs = 0.0;
 }
 
 void ParticlesComponent::resetParticle(Particle& p, juce::Random& r)
@@ -31,26 +37,139 @@ void ParticlesComponent::resetParticle(Particle& p, juce::Random& r)
     const auto speed = 8.0f + 26.0f * r.nextFloat();
     p.vel = { std::cos(angle) * speed, std::sin(angle) * speed };
     p.alpha = 0.04f + 0.12f * r.nextFloat();
-    p.size = 1.0f + 2.0f * r.nextFloat();
+    p.sprite = r.nextInt(kNumSprites);
 }
 
-void ParticlesComponent::timerCallback()
+juce::Rectangle<int> ParticlesComponent::boundsOf(const Particle& p) const
 {
-    if (!enabled)
-        return;
+    const auto cell = kMaxSize + 2.0f * kPadding;
+    return juce::Rectangle<float>(p.pos.x - kPadding, p.pos.y - kPadding, cell, cell).getSmallestIntegerContainer();
+}
 
+void ParticlesComponent::advance(double seconds)
+{
     const auto w = (float) juce::jmax(1, getWidth());
     const auto h = (float) juce::jmax(1, getHeight());
-    const float dt = 1.0f / 30.0f;
+    const auto dt = (float) seconds;
 
+    // Dots under opaque siblings can't be seen, so moving them needs no repaint.
+    juce::RectangleList<int> covered;
+    if (auto* parent = getParentComponent())
+        for (auto* c : parent->getChildren())
+            if (c != this && c->isVisible() && c->isOpaque())
+                covered.add(getLocalArea(parent, c->getBounds()));
+
+    repainted.clear();
     for (auto& p : particles)
     {
+        auto dirty = boundsOf(p);
         p.pos += p.vel * dt;
         if (p.pos.x < -10.0f || p.pos.x > w + 10.0f || p.pos.y < -10.0f || p.pos.y > h + 10.0f)
+        {
+            if (!covered.containsRectangle(dirty))
+                repainted.add(dirty);
             resetParticle(p, rnd);
+            dirty = boundsOf(p);
+        }
+        else
+        {
+            dirty = dirty.getUnion(boundsOf(p));
+        }
+
+        if (!covered.containsRectangle(dirty))
+            repainted.add(dirty);
+    }
+
+    repainted.clipTo(getLocalBounds());
+    for (const auto& r : repainted)
+        repaint(r);
+}
+
+bool ParticlesComponent::isOnScreen() const
+{
+    // Not showing covers hidden and minimised windows.
+    auto* peer = getPeer();
+    if (!isShowing() || peer == nullptr)
+        return false;
+
+    // Covered when another window lies over every sample point.
+    const auto& top = peer->getComponent();
+    const auto area = getLocalBounds().reduced(4);
+    for (const auto p : { area.getCentre(), area.getTopLeft(), area.getTopRight(), area.getBottomLeft(), area.getBottomRight() })
+        if (peer->contains(top.getLocalPoint(this, p), true))
+            return true;
+    return false;
+}
+
+void ParticlesComponent::adaptFrameRate(double elapsedMs, double costMs)
+{
+    smoothedCostMs += 0.2 * (costMs - smoothedCostMs);
+    smoothedLateMs += 0.2 * (juce::jmax(0.0, elapsedMs - 1000.0 / getFrameRateHz()) - smoothedLateMs);
+
+    // Slow down as soon as frames cost too much or arrive late (the message thread is busy);
+    // speed up again after two seconds within budget.
+    const bool overBudget = smoothedCostMs > kFrameBudgetMs || smoothedLateMs > 500.0 / getFrameRateHz();
+    if (overBudget)
+    {
+        calmFrames = 0;
+        rateIndex = juce::jmin(rateIndex + 1, (int) kFrameRates.size() - 1);
+    }
+    else if (rateIndex > 0 && ++calmFrames >= 2 * getFrameRateHz())
+    {
+        calmFrames = 0;
+        --rateIndex;
     }
+}
+
+bool ParticlesComponent::update(double nowMs)
+{
+    if (!enabled)
+        return false;
+
+    if (nowMs - lastVisibilityCheckMs >= 500.0)
+    {
+        lastVisibilityCheckMs = nowMs;
+        onScreen = isOnScreen();
+    }
+
+    if (!onScreen)
+    {
+        lastFrameMs = 0.0;
+        return false;
+    }
+
+    // A couple of milliseconds' slack keeps 30 Hz on every second 60 Hz vblank despite jitter.
+    const auto intervalMs = 1000.0 / getFrameRateHz();
+    if (lastFrameMs > 0.0 && nowMs - lastFrameMs < intervalMs - 2.0)
+        return false;
+
+    const auto elapsedMs = lastFrameMs > 0.0 ? nowMs - lastFrameMs : intervalMs;
+    lastFrameMs = nowMs;
 
-    repaint();
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+    advance(juce::jmin(elapsedMs, 100.0) / 1000.0);
+    const auto costMs = juce::Time::getMillisecondCounterHiRes() - start + paintMs;
+    paintMs = 0.0;
+
+    adaptFrameRate(elapsedMs, costMs);
+    return !repainted.isEmpty();
+}
+
+void ParticlesComponent::renderAtlas(float scale)
+{
+    atlasScale = scale;
+
+    const int cell = juce::roundToInt(std::ceil((kMaxSize + 2.0f * kPadding) * scale));
+    atlas = juce::Image(juce::Image::ARGB, cell * kNumSprites, cell, true);
+
+    juce::Graphics g(atlas);
+    g.setColour(kAccent);
+    for (int i = 0; i < kNumSprites; ++i)
+    {
+        const auto size = kMinSize + (kMaxSize - kMinSize) * float(i) / float(kNumSprites - 1);
+        g.fillEllipse(float(i * cell) + kPadding * scale, kPadding * scale, size * scale, size * scale);
+        sprites[(size_t) i] = atlas.getClippedImage({ i * cell, 0, cell, cell });
+    }
 }
 
 void ParticlesComponent::paint(juce::Graphics& g)
@@ -58,14 +177,24 @@ void ParticlesComponent::paint(juce::Graphics& g)
     if (!enabled)
         return;
 
-    g.setColour(kAccent.withAlpha(0.10f));
-    g.fillAll(juce::Colours::transparentBlack);
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+
+    const auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (scale != atlasScale)
+        renderAtlas(scale);
 
+    // Only the dots inside the area being repainted.
+    const auto clip = g.getClipBounds();
+    const auto toLogical = juce::AffineTransform::scale(1.0f / atlasScale);
     for (const auto& p : particles)
     {
-        g.setColour(kAccent.withAlpha(p.alpha));
-        g.fillEllipse(p.pos.x, p.pos.y, p.size, p.size);
+        if (!clip.intersects(boundsOf(p)))
+            continue;
+
+        g.setOpacity(p.alpha);
+        g.drawImageTransformed(sprites[(size_t) p.sprite], toLogical.translated(p.pos.x - kPadding, p.pos.y - kPadding));
     }
+
+    paintMs += juce::Time::getMillisecondCounterHiRes() - start;
 }
 } // namespace mfpr
-
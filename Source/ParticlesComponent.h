@@ -5,15 +5,32 @@
 
 namespace mfpr
 {
-class ParticlesComponent final : public juce::Component, private juce::Timer
+// Dots drifting behind the editor. Each dot is drawn from a small sprite atlas rendered once at
+// the display's pixel scale, and a frame repaints only the dots' old and new bounds, so the
+// editor beneath redraws a few small rectangles instead of all of itself.
+//
+// The animation drops to a lower frame rate while its frames or the message thread run over
+// budget, and pauses while the editor is hidden, minimised or covered by other windows.
+class ParticlesComponent final : public juce::Component
 {
 public:
     ParticlesComponent();
 
     void setEnabled(bool shouldAnimate);
 
+    // Once per display frame, at `nowMs` (Time::getMillisecondCounterHiRes()): runs a particle
+    // frame if one is due at the current frame rate. Returns whether it repainted.
+    bool update(double nowMs);
+
+    // Moves the particles on by `seconds` and repaints where they were and now are.
+    void advance(double seconds);
+
+    // What the last advance() repainted, in local coordinates.
+    const juce::RectangleList<int>& getLastRepaintedArea() const { return repainted; }
+    int getFrameRateHz() const { return kFrameRates[(size_t) rateIndex]; }
+
     void paint(juce::Graphics& g) override;
-    void resized() override {}
+    void resized() override;
 
 private:
     struct Particle
@@ -21,15 +38,41 @@ private:
         juce::Point<float> pos;
         juce::Point<float> vel;
         float alpha = 0.0f;
-        float size = 1.0f;
+        int sprite = 0;
     };
 
-    void timerCallback() override;
     void resetParticle(Particle& p, juce::Random& rnd);
+    juce::Rectangle<int> boundsOf(const Particle& p) const;
+
+    // False when nothing of the editor can be seen.
+    bool isOnScreen() const;
+    void adaptFrameRate(double elapsedMs, double costMs);
+    void renderAtlas(float scale);
+
+    static constexpr int kNumSprites = 8;     // diameters from kMinSize to kMaxSize
+    static constexpr float kMinSize = 1.0f;
+    static constexpr float kMaxSize = 3.0f;
+    static constexpr float kPadding = 1.0f;   // around each sprite, for antialiasing
+    static constexpr std::array<int, 4> kFrameRates { 30, 20, 15, 10 }; // whole numbers of 60 Hz frames
+    static constexpr double kFrameBudgetMs = 1.0; // stepping and painting one frame
 
     bool enabled = false;
     juce::Random rnd;
     std::vector<Particle> particles;
+
+    juce::Image atlas; // one row of sprites at the physical pixel scale
+    std::array<juce::Image, kNumSprites> sprites; // views into the atlas
+    float atlasScale = 0.0f;
+
+    juce::RectangleList<int> repainted;
+
+    int rateIndex = 0;            // into kFrameRates
+    bool onScreen = true;
+    double lastFrameMs = 0.0;     // when the last frame ran, or 0 after a pause
+    double lastVisibilityCheckMs = 0.0;
+    double smoothedCostMs = 0.0;
+    double smoothedLateMs = 0.0;  // how far behind the timer fires
+    double paintMs = 0.0;         // spent painting since the last frame
+    int calmFrames = 0;           // frames in a row within budget
 };
 } // namespace mfpr
-
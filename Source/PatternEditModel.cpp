@@ -0,0 +1,315 @@
+#include "PatternEditModel.h"
+#include "CounterRng.h"
+#include <functional>
+
+namespace mfpr
+{
+// A treap: a search tree on the note key that is also a heap on a priority hashed from it,
+// which keeps it balanced (O(log n) deep) whatever order notes arrive in. Nodes are never
+// changed once shared; an edit copies the nodes on its path and points at the rest.
+struct PersistentNoteSet::Node
+{
+    PackedNote note;
+    uint64_t key = 0;
+    uint64_t priority = 0;
+    int count = 1;   // notes in this subtree
+    int maxEnd = 0;  // latest end step in this subtree
+    NodePtr left, right;
+};
+
+static uint64_t keyOf(const PackedNote& n)
+{
+    return (uint64_t(n.getStartStep()) << 40) | (uint64_t(n.getNoteNumber()) << 32) | (uint64_t(n.getTrack()) << 28)
+         | (uint64_t(n.getLengthSteps()) << 12) | (uint64_t(n.getVelocity()) << 4) | uint64_t(n.getChannel() - 1);
+}
+
+int PersistentNoteSet::countOf(const NodePtr& t)
+{
+    return t != nullptr ? t->count : 0;
+}
+
+int PersistentNoteSet::maxEndOf(const NodePtr& t)
+{
+    return t != nullptr ? t->maxEnd : 0;
+}
+
+PersistentNoteSet::NodePtr PersistentNoteSet::makeNode(const Node& from, NodePtr left, NodePtr right)
+{
+    auto n = std::make_shared<Node>();
+    n->note = from.note;
+    n->key = from.key;
+    n->priority = from.priority;
+    n->count = 1 + countOf(left) + countOf(right);
+    n->maxEnd = juce::jmax(from.note.getEndStep(), maxEndOf(left), maxEndOf(right));
+    n->left = std::move(left);
+    n->right = std::move(right);
+    return n;
+}
+
+PersistentNoteSet::NodePtr PersistentNoteSet::leaf(const PackedNote& note)
+{
+    Node n;
+    n.note = note;
+    n.key = keyOf(note);
+    n.priority = CounterRng(n.key, 0).bits(0);
+    return makeNode(n, nullptr, nullptr);
+}
+
+void PersistentNoteSet::split(const NodePtr& t, uint64_t key, NodePtr& less, NodePtr& notLess)
+{
+    if (t == nullptr)
+    {
+        less = notLess = nullptr;
+        return;
+    }
+
+    if (t->key < key)
+    {
+        NodePtr rightLess;
+        split(t->right, key, rightLess, notLess);
+        less = makeNode(*t, t->left, rightLess);
+    }
+    else
+    {
+        NodePtr leftNotLess;
+        split(t->left, key, less, leftNotLess);
+        notLess = makeNode(*t, leftNotLess, t->right);
+    }
+}
+
+PersistentNoteSet::NodePtr PersistentNoteSet::merge(const NodePtr& a, const NodePtr& b)
+{
+    if (a == nullptr)
+        return b;
+    if (b == nullptr)
+        return a;
+
+    if (a->priority >= b->priority)
+        return makeNode(*a, a->left, merge(a->right, b));
+    return makeNode(*b, merge(a, b->left), b->right);
+}
+
+void PersistentNoteSet::findIn(const NodePtr& t, int step, int noteNumber, int track, std::optional<PackedNote>& best)
+{
+    // Nothing below sounds at `step` if it all ends by then.
+    if (t == nullptr || t->maxEnd <= step)
+        return;
+
+    findIn(t->left, step, noteNumber, track, best);
+    if (t->note.getStartStep() > step)
+        return; // this note and everything right of it starts later
+
+    const auto& n = t->note;
+    if (n.getNoteNumber() == noteNumber && n.getEndStep() > step && (track < 0 || n.getTrack() == track)
+        && (!best.has_value() || n.getStartStep() >= best->getStartStep()))
+        best = n;
+
+    findIn(t->right, step, noteNumber, track, best);
+}
+
+PersistentNoteSet PersistentNoteSet::fromNotes(const std::vector<PackedNote>& notes)
+{
+    std::vector<std::pair<uint64_t, PackedNote>> sorted;
+    sorted.reserve(notes.size());
+    for (const auto& n : notes)
+        sorted.emplace_back(keyOf(n), n);
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // Sorted keys give the treap in one pass (a Cartesian tree on the priorities). Nodes are
+    // still private to this function, so it links them in place before they are shared.
+    std::vector<std::shared_ptr<Node>> spine; // right spine, root first
+    for (const auto& [key, note] : sorted)
+    {
+        auto node = std::make_shared<Node>();
+        node->note = note;
+        node->key = key;
+        node->priority = CounterRng(key, 0).bits(0);
+
+        std::shared_ptr<Node> last;
+        while (!spine.empty() && spine.back()->priority < node->priority)
+        {
+            last = spine.back();
+            spine.pop_back();
+        }
+        node->left = last;
+        if (!spine.empty())
+            spine.back()->right = node;
+        spine.push_back(node);
+    }
+
+    // Subtree counts and ends, children first.
+    std::function<void(Node&)> finish = [&](Node& n)
+    {
+        for (const auto* child : { &n.left, &n.right })
+            if (*child != nullptr)
+                finish(const_cast<Node&>(**child));
+        n.count = 1 + countOf(n.left) + countOf(n.right);
+        n.maxEnd = juce::jmax(n.note.getEndStep(), maxEndOf(n.left), maxEndOf(n.right));
+    };
+    if (spine.empty())
+        return {};
+    finish(*spine.front());
+    return PersistentNoteSet(spine.front());
+}
+
+int PersistentNoteSet::size() const
+{
+    return countOf(root);
+}
+
+PersistentNoteSet PersistentNoteSet::with(const PackedNote& note) const
+{
+    NodePtr less, notLess;
+    split(root, keyOf(note), less, notLess);
+    return PersistentNoteSet(merge(merge(less, leaf(note)), notLess));
+}
+
+PersistentNoteSet PersistentNoteSet::without(const PackedNote& note) const
+{
+    if (!contains(note))
+        return *this;
+
+    const auto key = keyOf(note);
+    NodePtr less, notLess, equal, greater;
+    split(root, key, less, notLess);
+    split(notLess, key + 1, equal, greater);
+
+    // Drop one of the equal notes: the root of their subtree.
+    equal = merge(equal->left, equal->right);
+    return PersistentNoteSet(merge(less, merge(equal, greater)));
+}
+
+bool PersistentNoteSet::contains(const PackedNote& note) const
+{
+    const auto key = keyOf(note);
+    for (auto* t = root.get(); t != nullptr; t = (key < t->key ? t->left : t->right).get())
+        if (t->key == key)
+            return true;
+    return false;
+}
+
+std::optional<PackedNote> PersistentNoteSet::findAt(int step, int noteNumber, int track) const
+{
+    std::optional<PackedNote> best;
+    findIn(root, step, noteNumber, track, best);
+    return best;
+}
+
+void PersistentNoteSet::appendTo(std::vector<PackedNote>& out) const
+{
+    out.reserve(out.size() + (size_t) size());
+
+    std::vector<const Node*> stack;
+    for (auto* t = root.get(); t != nullptr || !stack.empty();)
+    {
+        if (t != nullptr)
+        {
+            stack.push_back(t);
+            t = t->left.get();
+            continue;
+        }
+
+        t = stack.back();
+        stack.pop_back();
+        out.push_back(t->note);
+        t = t->right.get();
+    }
+}
+
+//==============================================================================
+void PatternEditModel::reset(const GeneratedPattern& pattern)
+{
+    current = { PersistentNoteSet::fromNotes(pattern.notes), pattern.lengthSteps, pattern.numTracks };
+    gestureStart.reset();
+    gestureDepth = 0;
+    changed = false;
+    undoStack.clear();
+    redoStack.clear();
+}
+
+std::unique_ptr<GeneratedPattern> PatternEditModel::takePattern()
+{
+    if (!changed)
+        return nullptr;
+
+    changed = false;
+    auto pattern = std::make_unique<GeneratedPattern>();
+    pattern->lengthSteps = current.lengthSteps;
+    pattern->numTracks = current.numTracks;
+    current.notes.appendTo(pattern->notes);
+    return pattern;
+}
+
+void PatternEditModel::beginGesture()
+{
+    if (gestureDepth++ == 0)
+        gestureStart = current;
+}
+
+void PatternEditModel::endGesture()
+{
+    if (gestureDepth == 0 || --gestureDepth > 0)
+        return;
+
+    if (!gestureStart->notes.sharesRootWith(current.notes))
+    {
+        undoStack.push_back(std::move(*gestureStart));
+        if ((int) undoStack.size() > kMaxUndoSteps)
+            undoStack.pop_front();
+        redoStack.clear();
+    }
+    gestureStart.reset();
+}
+
+void PatternEditModel::set(const PersistentNoteSet& notes)
+{
+    if (notes.sharesRootWith(current.notes))
+        return;
+
+    current.notes = notes;
+    changed = true;
+}
+
+void PatternEditModel::add(const PackedNote& note)
+{
+    beginGesture();
+    set(current.notes.with(note));
+    endGesture();
+}
+
+void PatternEditModel::remove(const PackedNote& note)
+{
+    beginGesture();
+    set(current.notes.without(note));
+    endGesture();
+}
+
+void PatternEditModel::replace(const PackedNote& oldNote, const PackedNote& newNote)
+{
+    beginGesture();
+    set(current.notes.without(oldNote).with(newNote));
+    endGesture();
+}
+
+void PatternEditModel::undo()
+{
+    if (undoStack.empty() || gestureDepth > 0)
+        return;
+
+    redoStack.push_back(current);
+    current = std::move(undoStack.back());
+    undoStack.pop_back();
+    changed = true;
+}
+
+void PatternEditModel::redo()
+{
+    if (redoStack.empty() || gestureDepth > 0)
+        return;
+
+    undoStack.push_back(current);
+    current = std::move(redoStack.back());
+    redoStack.pop_back();
+    changed = true;
+}
+} // namespace mfpr
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "MelodyGenerator.h"
+#include <deque>
+#include <optional>
+
+namespace mfpr
+{
+// An immutable, ordered set of notes. Adding or removing a note builds a new set in
+// O(log n) that shares everything but one root-to-leaf path with the old one, so keeping
+// many versions (for undo) costs little more than keeping one.
+//
+// Notes are ordered by start step, then pitch, track, length, velocity and channel;
+// identical notes may appear more than once.
+class PersistentNoteSet final
+{
+public:
+    PersistentNoteSet() = default;
+
+    // O(n log n); the notes need not be sorted.
+    static PersistentNoteSet fromNotes(const std::vector<PackedNote>& notes);
+
+    int size() const;
+    bool isEmpty() const { return root == nullptr; }
+
+    PersistentNoteSet with(const PackedNote& note) const;
+    PersistentNoteSet without(const PackedNote& note) const; // one copy; unchanged if absent
+    bool contains(const PackedNote& note) const;
+
+    // A note at this pitch (on `track`, or any track if -1) sounding at `step`, preferring
+    // the one that starts last. O(log n + notes sounding at `step`).
+    std::optional<PackedNote> findAt(int step, int noteNumber, int track = -1) const;
+
+    // Appends the notes in order.
+    void appendTo(std::vector<PackedNote>& out) const;
+
+    bool sharesRootWith(const PersistentNoteSet& other) const { return root == other.root; }
+
+private:
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    explicit PersistentNoteSet(NodePtr r) : root(std::move(r)) {}
+
+    static int countOf(const NodePtr& t);
+    static int maxEndOf(const NodePtr& t);
+    static NodePtr makeNode(const Node& from, NodePtr left, NodePtr right);
+    static NodePtr leaf(const PackedNote& note);
+
+    // Splits t into keys < key and keys >= key.
+    static void split(const NodePtr& t, uint64_t key, NodePtr& less, NodePtr& notLess);
+    // Every key in a must be <= every key in b.
+    static NodePtr merge(const NodePtr& a, const NodePtr& b);
+    static void findIn(const NodePtr& t, int step, int noteNumber, int track, std::optional<PackedNote>& best);
+
+    NodePtr root;
+};
+
+// The piano roll's editable copy of the current pattern, with undo and redo.
+//
+// Edits are grouped into gestures (a click, or everything from mouse-down to mouse-up of a
+// drag), and each finished gesture that changed something becomes one undo step. History
+// holds snapshots that share structure, so each step costs O(log n) memory; it keeps the
+// last kMaxUndoSteps of them.
+class PatternEditModel final
+{
+public:
+    static constexpr int kMaxUndoSteps = 200;
+
+    // Starts over from a pattern that did not come from this model, forgetting history.
+    void reset(const GeneratedPattern& pattern);
+
+    const PersistentNoteSet& getNotes() const { return current.notes; }
+    int getLengthSteps() const { return current.lengthSteps; }
+
+    // Changes since the last takePattern(), as a pattern to publish; null if there are none.
+    std::unique_ptr<GeneratedPattern> takePattern();
+
+    void beginGesture();
+    void endGesture();
+
+    // Within a gesture (a lone edit is its own gesture).
+    void add(const PackedNote& note);
+    void remove(const PackedNote& note);
+    void replace(const PackedNote& oldNote, const PackedNote& newNote);
+
+    bool canUndo() const { return !undoStack.empty(); }
+    bool canRedo() const { return !redoStack.empty(); }
+    void undo();
+    void redo();
+
+private:
+    struct Snapshot
+    {
+        PersistentNoteSet notes;
+        int lengthSteps = 64;
+        int numTracks = 1;
+    };
+
+    void set(const PersistentNoteSet& notes);
+
+    Snapshot current;
+    std::optional<Snapshot> gestureStart; // set between beginGesture() and endGesture()
+    int gestureDepth = 0;
+    bool changed = false; // since the last takePattern()
+
+    std::deque<Snapshot> undoStack; // oldest first
+    std::vector<Snapshot> redoStack;
+};
+} // namespace mfpr
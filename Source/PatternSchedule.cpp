@@ -0,0 +1,29 @@
+#include "PatternSchedule.h"
+
+namespace mfpr
+{
+PatternSchedule::PatternSchedule(const GeneratedPattern& pattern)
+    : lengthSteps(juce::jlimit(1, PackedNote::kMaxSteps, pattern.lengthSteps))
+{
+    events.reserve(pattern.notes.size() * 2);
+    for (const auto& n : pattern.notes)
+    {
+        const int on = n.getStartStep();
+        if (on >= lengthSteps)
+            continue;
+
+        const int off = juce::jlimit(on + 1, lengthSteps, n.getEndStep());
+        events.push_back({ (uint16_t) on, (uint8_t) n.getNoteNumber(), (uint8_t) juce::jlimit(1, 127, n.getVelocity()) });
+        events.push_back({ (uint16_t) off, (uint8_t) n.getNoteNumber(), 0 });
+    }
+
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b)
+    {
+        if (a.step != b.step)
+            return a.step < b.step;
+        if ((a.velocity != 0) != (b.velocity != 0))
+            return a.velocity == 0; // offs first, so a re-struck note is not cut
+        return a.noteNumber < b.noteNumber;
+    });
+}
+} // namespace mfpr
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "MelodyGenerator.h"
+
+namespace mfpr
+{
+// A pattern compiled for playback: its note-ons and note-offs as one list in time order
+// (note-offs first within a step), so playing it is a walk along an array.
+class PatternSchedule final
+{
+public:
+    struct Event
+    {
+        uint16_t step = 0;
+        uint8_t noteNumber = 0;
+        uint8_t velocity = 0; // 0 for a note-off
+    };
+
+    PatternSchedule() = default;
+
+    // Notes are cut at the pattern's end so every repeat is self-contained.
+    explicit PatternSchedule(const GeneratedPattern& pattern);
+
+    const std::vector<Event>& getEvents() const { return events; }
+    int getLengthSteps() const { return lengthSteps; }
+
+private:
+    std::vector<Event> events;
+    int lengthSteps = 16;
+};
+} // namespace mfpr
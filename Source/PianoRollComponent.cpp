@@ -1,153 +1,536 @@
 #include "PianoRollComponent.h"
 #include "PluginProcessor.h"
+#include "ScaleTables.h"
 #include <algorithm>
 
 namespace mfpr
 {
-static constexpr int minNote = 36;
-static constexpr int maxNote = 84;
+// Below this many pixels per step, notes are drawn as plain rectangles in one batch.
+static constexpr float kDetailedStepWidth = 3.0f;
 
-static int positiveModulo(int a, int b)
+static int lengthOf(const GeneratedPattern* p)
 {
-    int result = a % b;
-    return result >= 0 ? result : result + b;
+    return p != nullptr ? p->lengthSteps : 64;
 }
 
-static bool isInScale(int midiNote, int keyIndex, int modeIndex)
+PianoRollComponent::PianoRollComponent(MelodyForgeProAudioProcessor& p) : processor(p)
 {
-    static constexpr std::array<int, 7> major = { 0, 2, 4, 5, 7, 9, 11 };
-    static constexpr std::array<int, 7> minor = { 0, 2, 3, 5, 7, 8, 10 };
-    const auto pc = positiveModulo((midiNote % 12) - keyIndex, 12);
-    const auto& scale = (modeIndex != 0) ? minor : major;
-    return std::find(scale.begin(), scale.end(), pc) != scale.end();
+    setOpaque(true);
+    setWantsKeyboardFocus(true);
+
+    for (auto* bar : { &horizontalBar, &verticalBar })
+    {
+        bar->setAutoHide(false);
+        bar->addListener(this);
+        addAndMakeVisible(*bar);
+    }
+
+    processor.getPlaybackEvents().setListening(true);
 }
 
-PianoRollComponent::PianoRollComponent(MelodyForgeProAudioProcessor& p) : processor(p)
+PianoRollComponent::~PianoRollComponent()
 {
-    startTimerHz(20);
+    processor.getPlaybackEvents().setListening(false);
 }
 
-PianoRollComponent::~PianoRollComponent()
+juce::Rectangle<int> PianoRollComponent::getRollArea() const
+{
+    return getLocalBounds().withTrimmedRight(kScrollBarThickness).withTrimmedBottom(kScrollBarThickness);
+}
+
+float PianoRollComponent::stepWidth() const
+{
+    return float(getRollArea().getWidth()) / float(viewSteps);
+}
+
+float PianoRollComponent::rowHeight() const
+{
+    return float(getRollArea().getHeight()) / float(kVisibleRows);
+}
+
+void PianoRollComponent::setView(double newStart, double newSteps, int newLowNote)
+{
+    const auto len = double(juce::jmax(1, lengthOf(pattern.get())));
+    viewSteps = juce::jlimit(juce::jmin(4.0, len), len, newSteps);
+    viewStart = juce::jlimit(0.0, len - viewSteps, newStart);
+    lowNote = juce::jlimit(0, 128 - kVisibleRows, newLowNote);
+
+    horizontalBar.setRangeLimits(0.0, len, juce::dontSendNotification);
+    horizontalBar.setCurrentRange(viewStart, viewSteps, juce::dontSendNotification);
+    verticalBar.setRangeLimits(0.0, 128.0, juce::dontSendNotification);
+    verticalBar.setCurrentRange(double(127 - topNote()), double(kVisibleRows), juce::dontSendNotification);
+
+    backgroundValid = false;
+    repaint();
+}
+
+void PianoRollComponent::zoomAround(int x, double factor)
+{
+    const auto len = double(lengthOf(pattern.get()));
+    const auto anchor = double(x) / double(juce::jmax(1, getRollArea().getWidth()));
+    const auto anchorStep = viewStart + anchor * viewSteps;
+    const auto newSteps = juce::jlimit(juce::jmin(4.0, len), len, viewSteps / factor);
+
+    fitToPattern = newSteps >= len;
+    setView(anchorStep - anchor * newSteps, newSteps, lowNote);
+}
+
+void PianoRollComponent::scrollBarMoved(juce::ScrollBar* bar, double newRangeStart)
+{
+    if (bar == &horizontalBar)
+        setView(newRangeStart, viewSteps, lowNote);
+    else
+        setView(viewStart, viewSteps, 127 - juce::roundToInt(newRangeStart) - kVisibleRows + 1);
+}
+
+void PianoRollComponent::mouseWheelMove(const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel)
+{
+    if (e.mods.isCommandDown() || e.mods.isCtrlDown())
+    {
+        zoomAround(e.x, std::pow(2.0, double(wheel.deltaY) * 2.0));
+    }
+    else if (e.mods.isShiftDown() || std::abs(wheel.deltaX) > std::abs(wheel.deltaY))
+    {
+        const auto delta = wheel.deltaX != 0.0f ? wheel.deltaX : wheel.deltaY;
+        setView(viewStart - double(delta) * viewSteps * 0.5, viewSteps, lowNote);
+    }
+    else if (wheel.deltaY != 0.0f)
+    {
+        const int rows = juce::roundToInt(wheel.deltaY * 20.0f);
+        setView(viewStart, viewSteps, lowNote + (rows != 0 ? rows : (wheel.deltaY > 0.0f ? 1 : -1)));
+    }
+}
+
+void PianoRollComponent::mouseMagnify(const juce::MouseEvent& e, float scaleFactor)
 {
-    stopTimer();
+    zoomAround(e.x, double(scaleFactor));
 }
 
 int PianoRollComponent::yToMidiNote(int y) const
 {
-    const auto h = juce::jmax(1, getHeight());
-    const auto norm = juce::jlimit(0.0, 1.0, double(y) / double(h));
-    const auto note = maxNote - int(norm * double(maxNote - minNote + 1));
-    return juce::jlimit(minNote, maxNote, note);
+    const auto row = int(std::floor(float(y) / rowHeight()));
+    return juce::jlimit(0, 127, topNote() - row);
 }
 
 int PianoRollComponent::xToStep(int x) const
 {
-    const auto w = juce::jmax(1, getWidth());
-    const auto len = pattern != nullptr ? pattern->lengthSteps : 64;
-    const auto norm = juce::jlimit(0.0, 1.0, double(x) / double(w));
-    const auto step = int(norm * double(len));
+    const auto len = lengthOf(pattern.get());
+    const auto step = int(std::floor(viewStart + double(x) / double(stepWidth())));
     return juce::jlimit(0, juce::jmax(0, len - 1), step);
 }
 
-juce::Rectangle<float> PianoRollComponent::noteToRect(const MidiNote& n, int minN, int maxN) const
+juce::Rectangle<float> PianoRollComponent::noteToRect(const PackedNote& n) const
 {
-    const auto len = juce::jmax(1, pattern != nullptr ? pattern->lengthSteps : 64);
-    const auto w = float(getWidth());
-    const auto h = float(getHeight());
-    const auto noteCount = float(maxN - minN + 1);
+    const auto sw = stepWidth();
+    const auto rh = rowHeight();
 
-    const auto x = (float(n.startStep) / float(len)) * w;
-    const auto ww = (float(juce::jmax(1, n.lengthSteps)) / float(len)) * w;
+    const auto x = float(double(n.getStartStep()) - viewStart) * sw;
+    const auto w = float(n.getLengthSteps()) * sw;
+    const auto y = float(topNote() - n.getNoteNumber()) * rh;
+    return { x, y, w, rh };
+}
 
-    const auto y = (float(maxN - n.noteNumber) / noteCount) * h;
-    const auto hh = h / noteCount;
-    return { x, y, ww, hh };
+void PianoRollComponent::collectNoteKeys(const GeneratedPattern* p, std::vector<uint64_t>& keys)
+{
+    keys.clear();
+    if (p == nullptr)
+        return;
+
+    for (const auto& n : p->notes)
+        keys.push_back((uint64_t(n.getNoteNumber()) << 32) | (uint64_t(n.getStartStep()) << 16) | uint64_t(n.getLengthSteps()));
+    std::sort(keys.begin(), keys.end());
 }
 
-void PianoRollComponent::timerCallback()
+void PianoRollComponent::repaintNote(uint64_t key)
 {
-    pattern = processor.getCurrentPattern();
-    keyIndex = processor.getKeyIndex();
-    modeIndex = processor.getModeIndex();
-    repaint();
+    const PackedNote n(int(key >> 32), int((key >> 16) & 0xffff), int(key & 0xffff), 100, 1, 0);
+    const auto r = noteToRect(n).getSmallestIntegerContainer().expanded(1).getIntersection(getRollArea());
+    if (!r.isEmpty())
+        repaint(r);
+}
+
+void PianoRollComponent::resized()
+{
+    const auto roll = getRollArea();
+    horizontalBar.setBounds(roll.getX(), roll.getBottom(), roll.getWidth(), kScrollBarThickness);
+    verticalBar.setBounds(roll.getRight(), roll.getY(), kScrollBarThickness, roll.getHeight());
+    setView(viewStart, viewSteps, lowNote);
+}
+
+juce::Rectangle<int> PianoRollComponent::stepColumn(int step) const
+{
+    const auto sw = double(stepWidth());
+    const int x0 = int(std::floor((double(step) - viewStart) * sw));
+    const int x1 = int(std::ceil((double(step + 1) - viewStart) * sw));
+    return juce::Rectangle<int>(x0, 0, x1 - x0, getRollArea().getHeight()).getIntersection(getRollArea());
+}
+
+juce::Rectangle<int> PianoRollComponent::keyCell(int note) const
+{
+    const auto rh = rowHeight();
+    return juce::Rectangle<float>(0.0f, float(topNote() - note) * rh, 6.0f, rh).getSmallestIntegerContainer();
+}
+
+bool PianoRollComponent::update()
+{
+    publishEdits();
+    const bool patternChanged = updatePattern();
+    const bool playbackChanged = updatePlayback();
+    return patternChanged || playbackChanged;
+}
+
+void PianoRollComponent::publishEdits()
+{
+    // However many edits a drag made since the last frame, the processor gets one pattern.
+    if (auto edited = editModel.takePattern())
+        publishedEdit = processor.setEditedPattern(std::move(*edited));
+}
+
+bool PianoRollComponent::updatePlayback()
+{
+    int step = playheadStep;
+    bool notesChanged = false;
+    bool repainted = false;
+    const auto noteChanged = [&](int note)
+    {
+        notesChanged = true;
+        if (note >= lowNote && note <= topNote())
+        {
+            repaint(keyCell(note));
+            repainted = true;
+        }
+    };
+
+    // Events were lost while the editor was not keeping up: start again from silence, before
+    // the events queued since.
+    auto& events = processor.getPlaybackEvents();
+    if (events.takeOverflow())
+    {
+        sounding.fill(false);
+        repaint();
+        repainted = true;
+    }
+
+    events.drain([&](const PlaybackEvent& e)
+    {
+        switch (e.type)
+        {
+            case PlaybackEvent::Type::step:
+                step = e.step;
+                break;
+            case PlaybackEvent::Type::noteOn:
+                sounding[e.note] = true;
+                noteChanged(e.note);
+                break;
+            case PlaybackEvent::Type::noteOff:
+                sounding[e.note] = false;
+                noteChanged(e.note);
+                break;
+        }
+    });
+
+    if (step != playheadStep)
+    {
+        if (playheadStep >= 0)
+            repaint(stepColumn(playheadStep));
+        playheadStep = step;
+        notesChanged = true;
+        repainted = true;
+    }
+    if (notesChanged && playheadStep >= 0)
+    {
+        repaint(stepColumn(playheadStep));
+        repainted = true;
+    }
+    return repainted;
+}
+
+bool PianoRollComponent::updatePattern()
+{
+    // The version spares idle frames taking the processor's pattern lock.
+    const auto version = processor.getPatternVersion();
+    const int key = processor.getKeyIndex();
+    const int mode = processor.getModeIndex();
+    if (pattern != nullptr && version == patternVersion && key == keyIndex && mode == modeIndex)
+        return false;
+
+    patternVersion = version;
+    auto next = processor.getCurrentPattern();
+    if (next == pattern && key == keyIndex && mode == modeIndex)
+        return false;
+
+    collectNoteKeys(next.get(), nextNotes);
+    const bool lengthChanged = lengthOf(next.get()) != lengthOf(pattern.get());
+
+    // Scale rows change with key and mode; then everything is redrawn.
+    if (key != keyIndex || mode != modeIndex || lengthChanged)
+    {
+        backgroundValid = false;
+        repaint();
+    }
+    else
+    {
+        // Otherwise only notes that appeared or disappeared are redrawn.
+        size_t i = 0, j = 0;
+        while (i < shownNotes.size() || j < nextNotes.size())
+        {
+            if (j == nextNotes.size() || (i < shownNotes.size() && shownNotes[i] < nextNotes[j]))
+                repaintNote(shownNotes[i++]);
+            else if (i == shownNotes.size() || nextNotes[j] < shownNotes[i])
+                repaintNote(nextNotes[j++]);
+            else
+            {
+                ++i;
+                ++j;
+            }
+        }
+    }
+
+    // Patterns from elsewhere (generation, a preset) replace the edit model's and its history.
+    if (next != nullptr && next != pattern && next != publishedEdit)
+    {
+        dragMode = DragMode::none; // a drag in progress was editing the old pattern
+        editModel.reset(*next);
+    }
+
+    pattern = std::move(next);
+    keyIndex = key;
+    modeIndex = mode;
+    std::swap(shownNotes, nextNotes);
+
+    if (pattern != nullptr)
+        noteIndex.build(pattern->notes);
+    else
+        noteIndex.clear();
+
+    if (lengthChanged)
+        setView(viewStart, fitToPattern ? double(lengthOf(pattern.get())) : viewSteps, lowNote);
+    return true;
 }
 
 void PianoRollComponent::mouseDown(const juce::MouseEvent& e)
 {
-    if (pattern == nullptr)
+    if (pattern == nullptr || !getRollArea().contains(e.getPosition()))
         return;
 
-    auto edited = *pattern;
+    grabKeyboardFocus();
 
     const int note = yToMidiNote(e.y);
     const int step = xToStep(e.x);
+    dragStartStep = step;
+    dragStartNote = note;
+    dragMoved = false;
+
+    editModel.beginGesture();
+    if (const auto hit = editModel.getNotes().findAt(step, note))
+    {
+        const auto r = noteToRect(*hit);
+        dragMode = (r.getWidth() >= 10.0f && float(e.x) >= r.getRight() - 5.0f) ? DragMode::resize : DragMode::move;
+        dragOriginal = dragCurrent = *hit;
+        return;
+    }
 
     const int desiredTrack = processor.getTypeIndex() == int(GeneratorType::hybrid) ? 4 : 0;
+    dragMode = DragMode::create;
+    dragOriginal = dragCurrent = PackedNote(note, step, 1, 100, 1, desiredTrack);
+    editModel.add(dragCurrent);
+}
+
+void PianoRollComponent::mouseDrag(const juce::MouseEvent& e)
+{
+    if (dragMode == DragMode::none)
+        return;
+
+    const int note = yToMidiNote(e.y);
+    const int step = xToStep(e.x);
+    dragMoved = dragMoved || step != dragStartStep || note != dragStartNote;
 
-    auto it = std::find_if(edited.notes.begin(), edited.notes.end(), [&](const MidiNote& n)
-                           { return n.noteNumber == note && n.startStep == step && n.track == desiredTrack; });
+    const auto& o = dragOriginal;
+    const int len = editModel.getLengthSteps();
+    int start = o.getStartStep();
+    int length = o.getLengthSteps();
+    int pitch = o.getNoteNumber();
 
-    if (it != edited.notes.end())
-        edited.notes.erase(it);
+    if (dragMode == DragMode::move)
+    {
+        start = juce::jlimit(0, juce::jmax(0, len - length), start + step - dragStartStep);
+        pitch = juce::jlimit(0, 127, pitch + note - dragStartNote);
+    }
     else
-        edited.notes.push_back(MidiNote{ note, step, 1, 100, 1, desiredTrack });
+    {
+        length = juce::jlimit(1, juce::jmax(1, len - start), step + 1 - start);
+    }
 
-    processor.setEditedPattern(std::move(edited));
+    const PackedNote next(pitch, start, length, o.getVelocity(), o.getChannel(), o.getTrack());
+    if (next != dragCurrent)
+    {
+        editModel.replace(dragCurrent, next);
+        dragCurrent = next;
+    }
 }
 
-void PianoRollComponent::paint(juce::Graphics& g)
+void PianoRollComponent::mouseUp(const juce::MouseEvent&)
 {
+    if (dragMode == DragMode::none)
+        return;
+
+    // A click on a note, without dragging it, removes it.
+    if (dragMode == DragMode::move && !dragMoved)
+        editModel.remove(dragOriginal);
+
+    editModel.endGesture();
+    dragMode = DragMode::none;
+}
+
+bool PianoRollComponent::keyPressed(const juce::KeyPress& key)
+{
+    if (dragMode != DragMode::none)
+        return false;
+
+    const auto undoKey = juce::KeyPress('z', juce::ModifierKeys::commandModifier, 0);
+    const auto redoKey = juce::KeyPress('z', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0);
+    if (key == undoKey && editModel.canUndo())
+    {
+        editModel.undo();
+        return true;
+    }
+    if ((key == redoKey || key == juce::KeyPress('y', juce::ModifierKeys::commandModifier, 0)) && editModel.canRedo())
+    {
+        editModel.redo();
+        return true;
+    }
+    return false;
+}
+
+void PianoRollComponent::renderBackground(float scale)
+{
+    const auto roll = getRollArea();
+    const int w = juce::jmax(1, juce::roundToInt(float(roll.getWidth()) * scale));
+    const int h = juce::jmax(1, juce::roundToInt(float(roll.getHeight()) * scale));
+    if (background.getWidth() != w || background.getHeight() != h)
+        background = juce::Image(juce::Image::RGB, w, h, false);
+
+    juce::Graphics g(background);
+    g.addTransform(juce::AffineTransform::scale(scale));
     g.fillAll(kBackground.brighter(0.02f));
 
-    const auto b = getLocalBounds().toFloat();
+    const auto b = roll.toFloat();
+    const auto rowH = rowHeight();
+    const auto sw = stepWidth();
 
     // Scale highlighting rows
-    const int numNotes = maxNote - minNote + 1;
-    const float rowH = b.getHeight() / float(numNotes);
-    for (int i = 0; i < numNotes; ++i)
+    for (int i = 0; i < kVisibleRows; ++i)
     {
-        const int note = maxNote - i;
-        if (isInScale(note, keyIndex, modeIndex))
+        if (isPitchClassInScale(topNote() - i, keyIndex, modeIndex))
         {
             g.setColour(kAccent.withAlpha(0.04f));
             g.fillRect(0.0f, rowH * float(i), b.getWidth(), rowH);
         }
     }
 
-    // Grid
+    // Grid: bar lines always, beats and steps once they are far enough apart to read.
     g.setColour(juce::Colours::white.withAlpha(0.08f));
-    for (int i = 0; i <= numNotes; ++i)
+    for (int i = 0; i <= kVisibleRows; ++i)
         g.drawHorizontalLine(int(rowH * float(i)), 0.0f, b.getWidth());
 
-    const int steps = pattern != nullptr ? pattern->lengthSteps : 64;
-    for (int s = 0; s <= steps; ++s)
+    const int every = sw >= 6.0f ? 1 : (sw * 4.0f >= 6.0f ? 4 : 16);
+    const int firstStep = int(std::ceil(viewStart / every)) * every;
+    for (int s = firstStep; s <= int(viewStart + viewSteps); s += every)
     {
-        const float x = (float(s) / float(steps)) * b.getWidth();
+        const float x = float(double(s) - viewStart) * sw;
         const float alpha = (s % 16 == 0) ? 0.18f : ((s % 4 == 0) ? 0.10f : 0.05f);
         g.setColour(juce::Colours::white.withAlpha(alpha));
         g.drawVerticalLine(int(x), 0.0f, b.getHeight());
     }
 
-    // Notes
-    if (pattern != nullptr)
+    backgroundScale = scale;
+    backgroundValid = true;
+}
+
+void PianoRollComponent::paintNotes(juce::Graphics& g)
+{
+    if (pattern == nullptr)
+        return;
+
+    // Only notes in the repainted part of the view are visited.
+    const auto clip = g.getClipBounds().getIntersection(getRollArea()).toFloat();
+    const auto sw = double(stepWidth());
+    const int fromStep = int(std::floor(viewStart + double(clip.getX()) / sw));
+    const int toStep = int(std::ceil(viewStart + double(clip.getRight()) / sw)) + 1;
+    const bool detailed = stepWidth() >= kDetailedStepWidth;
+
+    lodNotes.clear();
+    noteIndex.forEachInRange(fromStep, toStep, [&](const PackedNote& n)
     {
-        for (const auto& n : pattern->notes)
+        if (n.getNoteNumber() < lowNote || n.getNoteNumber() > topNote())
+            return;
+
+        const auto r = noteToRect(n);
+        if (!r.intersects(clip))
+            return;
+
+        if (!detailed)
         {
-            if (n.noteNumber < minNote || n.noteNumber > maxNote)
-                continue;
+            lodNotes.addRectangle(r);
+            return;
+        }
+
+        const auto inner = r.reduced(0.5f, 0.5f);
+        g.setColour(kAccent.withAlpha(0.70f));
+        g.fillRoundedRectangle(inner, 2.0f);
 
-            const auto r = noteToRect(n, minNote, maxNote).reduced(0.5f, 0.5f);
-            g.setColour(kAccent.withAlpha(0.70f));
-            g.fillRoundedRectangle(r, 2.0f);
+        g.setColour(kBackground.withAlpha(0.35f));
+        g.drawRoundedRectangle(inner, 2.0f, 1.0f);
+    });
 
-            g.setColour(kBackground.withAlpha(0.35f));
-            g.drawRoundedRectangle(r, 2.0f, 1.0f);
+    // Zoomed out, the notes are a single fill.
+    if (!detailed)
+    {
+        g.setColour(kAccent.withAlpha(0.70f));
+        g.fillPath(lodNotes);
+    }
+}
+
+void PianoRollComponent::paint(juce::Graphics& g)
+{
+    const auto roll = getRollArea();
+    g.setColour(kBackground.brighter(0.02f));
+    g.fillRect(getLocalBounds().withLeft(roll.getRight()));
+    g.fillRect(getLocalBounds().withTop(roll.getBottom()));
+
+    const auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (!backgroundValid || scale != backgroundScale)
+        renderBackground(scale);
+    g.drawImage(background, roll.toFloat());
+
+    {
+        const juce::Graphics::ScopedSaveState state(g);
+        g.reduceClipRegion(roll);
+        paintNotes(g);
+
+        // Playhead: the step now playing, with the rows of the notes sounding in it lit.
+        const auto rowH = rowHeight();
+        if (playheadStep >= 0)
+        {
+            const auto column = stepColumn(playheadStep).toFloat();
+            g.setColour(juce::Colours::white.withAlpha(0.10f));
+            g.fillRect(column);
+
+            g.setColour(kAccent.withAlpha(0.55f));
+            for (int note = lowNote; note <= topNote(); ++note)
+                if (sounding[(size_t) note])
+                    g.fillRect(column.withY(float(topNote() - note) * rowH).withHeight(rowH));
         }
+
+        // Keys of every note the plugin is sounding, slots and layers included.
+        g.setColour(juce::Colours::white.withAlpha(0.85f));
+        for (int note = lowNote; note <= topNote(); ++note)
+            if (sounding[(size_t) note])
+                g.fillRect(juce::Rectangle<float>(0.0f, float(topNote() - note) * rowH, 6.0f, rowH));
     }
 
     g.setColour(juce::Colours::white.withAlpha(0.8f));
     g.setFont(juce::Font(13.0f, juce::Font::bold));
-    g.drawText("Piano Roll (click to toggle notes)", getLocalBounds().reduced(8).removeFromTop(18), juce::Justification::left);
+    g.drawText("Piano Roll (click or drag to edit, cmd-Z to undo)", getLocalBounds().reduced(8).removeFromTop(18), juce::Justification::left);
 }
 } // namespace mfpr
-
@@ -3,34 +3,123 @@
 #include "JuceIncludes.h"
 #include "MFPRConstants.h"
 #include "MelodyGenerator.h"
+#include "NoteStepIndex.h"
+#include "PatternEditModel.h"
 
 namespace mfpr
 {
 class MelodyForgeProAudioProcessor;
 
-class PianoRollComponent final : public juce::Component, private juce::Timer
+// The current pattern on a zoomable, scrollable grid. The wheel scrolls through pitches
+// (with shift, through time); cmd/ctrl-wheel or a pinch zooms in time around the mouse.
+// Until zoomed the view fits the whole pattern.
+//
+// Clicking an empty cell adds a note and dragging sizes it; dragging a note moves it, or
+// resizes it from its right edge; clicking a note removes it. Cmd-Z undoes, cmd-shift-Z
+// (or cmd-Y) redoes. Edits are published to the processor once per display frame.
+class PianoRollComponent final : public juce::Component, private juce::ScrollBar::Listener
 {
 public:
     explicit PianoRollComponent(MelodyForgeProAudioProcessor& processor);
     ~PianoRollComponent() override;
 
     void paint(juce::Graphics& g) override;
-    void resized() override {}
+    void resized() override;
 
     void mouseDown(const juce::MouseEvent& e) override;
+    void mouseDrag(const juce::MouseEvent& e) override;
+    void mouseUp(const juce::MouseEvent& e) override;
+    bool keyPressed(const juce::KeyPress& key) override;
+    void mouseWheelMove(const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel) override;
+    void mouseMagnify(const juce::MouseEvent& e, float scaleFactor) override;
+
+    // Once per display frame: publishes edits and picks up pattern and scale changes and the
+    // playback events of the blocks since the last frame, repainting only what they changed.
+    // Returns whether anything was repainted.
+    bool update();
 
 private:
-    void timerCallback() override;
+    void publishEdits();
+    bool updatePattern();
+    bool updatePlayback();
+
+    void scrollBarMoved(juce::ScrollBar* bar, double newRangeStart) override;
+
+    // The grid, without the scroll bars.
+    juce::Rectangle<int> getRollArea() const;
+
+    // Visible steps [viewStart, viewStart + viewSteps) and pitches [lowNote, lowNote + kVisibleRows).
+    void setView(double newStart, double newSteps, int newLowNote);
+    void zoomAround(int x, double factor);
+    float stepWidth() const;
+    float rowHeight() const;
+    int topNote() const { return lowNote + kVisibleRows - 1; }
 
     int yToMidiNote(int y) const;
     int xToStep(int x) const;
-    juce::Rectangle<float> noteToRect(const MidiNote& n, int minNote, int maxNote) const;
+    juce::Rectangle<float> noteToRect(const PackedNote& n) const;
+
+    // Scale rows and grid for the current view, drawn at the display's pixel scale.
+    void renderBackground(float scale);
+    void paintNotes(juce::Graphics& g);
+
+    // Sorted positions (note, start, length) of the pattern's notes.
+    static void collectNoteKeys(const GeneratedPattern* p, std::vector<uint64_t>& keys);
+    void repaintNote(uint64_t key);
+
+    juce::Rectangle<int> stepColumn(int step) const;
+    juce::Rectangle<int> keyCell(int note) const;
+
+    static constexpr int kVisibleRows = 49;
+    static constexpr int kScrollBarThickness = 10;
 
     MelodyForgeProAudioProcessor& processor;
     std::shared_ptr<const GeneratedPattern> pattern;
+    uint32_t patternVersion = 0; // processor's, when `pattern` was taken
+    NoteStepIndex noteIndex; // over pattern->notes
 
     int keyIndex = 0;
     int modeIndex = 0;
+
+    PatternEditModel editModel;
+    std::shared_ptr<const GeneratedPattern> publishedEdit; // the last pattern the model published
+
+    enum class DragMode
+    {
+        none,
+        create, // sizing a note added by this click
+        move,
+        resize
+    };
+    DragMode dragMode = DragMode::none;
+    PackedNote dragOriginal; // the note as it was at mouse-down
+    PackedNote dragCurrent;  // the note as the drag has left it
+    int dragStartStep = 0;
+    int dragStartNote = 0;
+    bool dragMoved = false;
+
+    double viewStart = 0.0;
+    double viewSteps = 64.0;
+    int lowNote = 36;
+    bool fitToPattern = true; // until zoomed, the view follows the pattern's length
+
+    juce::ScrollBar horizontalBar { false };
+    juce::ScrollBar verticalBar { true };
+
+    // Redrawn only after a resize, a scroll or zoom, a key/mode or pattern length change,
+    // or a move to a display with another pixel scale.
+    juce::Image background;
+    float backgroundScale = 0.0f;
+    bool backgroundValid = false;
+
+    juce::Path lodNotes; // zoomed-out notes, refilled by every paint
+
+    std::vector<uint64_t> shownNotes; // keys of the notes on screen
+    std::vector<uint64_t> nextNotes;  // scratch for the incoming pattern's keys
+
+    int playheadStep = -1;             // step now playing, or -1
+    // Pitches of the plugin's output now sounding. A pitch struck twice on one channel is
+    // still ended by a single note-off, so this is not a count.
+    std::array<bool, 128> sounding {};
 };
 } // namespace mfpr
-
@@ -0,0 +1,28 @@
+#include "PlaybackEventFifo.h"
+
+namespace mfpr
+{
+void PlaybackEventFifo::setListening(bool shouldListen)
+{
+    if (shouldListen && !isListening())
+    {
+        drain([](const PlaybackEvent&) {});
+        overflowed.store(false);
+    }
+    listening.store(shouldListen);
+}
+
+void PlaybackEventFifo::push(const PlaybackEvent& e)
+{
+    int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
+    fifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 + size2 == 0)
+    {
+        overflowed.store(true);
+        return;
+    }
+
+    events[(size_t) (size1 > 0 ? start1 : start2)] = e;
+    fifo.finishedWrite(1);
+}
+} // namespace mfpr
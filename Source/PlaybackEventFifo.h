@@ -0,0 +1,69 @@
+#pragma once
+
+#include "JuceIncludes.h"
+
+namespace mfpr
+{
+// What the editor needs to follow playback: the pattern step now playing and the notes
+// the plugin starts and ends.
+struct PlaybackEvent
+{
+    enum class Type : uint8_t
+    {
+        step,    // `step` is the pattern step now playing, or -1 when the pattern is not playing
+        noteOn,  // `note` started sounding
+        noteOff  // `note` stopped sounding
+    };
+
+    Type type = Type::step;
+    uint8_t note = 0;
+    int32_t step = -1;
+};
+
+// Single-producer, single-consumer queue of playback events from the audio thread to the
+// editor. push() never locks or allocates; when the queue is full the event is dropped and
+// the next drain() reports it, so the consumer can reset what it shows.
+//
+// Nothing is pushed until a consumer calls setListening(true), so a closed editor costs
+// the audio thread nothing and never leaves stale events behind.
+class PlaybackEventFifo final
+{
+public:
+    static constexpr int kCapacity = 2048;
+
+    // Message thread. Starts or stops collecting; starting discards anything left over.
+    void setListening(bool shouldListen);
+    bool isListening() const { return listening.load(std::memory_order_relaxed); }
+
+    // Audio thread.
+    void push(const PlaybackEvent& e);
+
+    // Message thread. True (once) if events were dropped since the last call or drain().
+    // A consumer that resets what it shows calls this first, so the reset comes before the
+    // events queued after the gap rather than undoing them.
+    bool takeOverflow() { return overflowed.exchange(false); }
+
+    // Message thread. Calls fn(const PlaybackEvent&) for every queued event, oldest first.
+    // Returns false if events were dropped since the previous drain() or takeOverflow().
+    template <typename Fn>
+    bool drain(Fn&& fn)
+    {
+        const bool complete = !takeOverflow();
+        const int numReady = fifo.getNumReady();
+        int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
+        fifo.prepareToRead(numReady, start1, size1, start2, size2);
+        for (int i = start1; i < start1 + size1; ++i)
+            fn(events[(size_t) i]);
+        for (int i = start2; i < start2 + size2; ++i)
+            fn(events[(size_t) i]);
+        fifo.finishedRead(size1 + size2);
+        return complete;
+    }
+
+private:
+    juce::AbstractFifo fifo { kCapacity };
+    std::array<PlaybackEvent, kCapacity> events {};
+    std::atomic<bool> listening { false };
+    std::atomic<bool> overflowed { false };
+};
+} // namespace mfpr
@@ -3,35 +3,8 @@
 
 namespace mfpr
 {
-static void addItems(juce::ComboBox& cb, const std::array<juce::String, 32>& items)
-{
-    int id = 1;
-    for (const auto& s : items)
-        cb.addItem(s, id++);
-}
-
-static void addItems(juce::ComboBox& cb, const std::array<juce::String, 12>& items)
-{
-    int id = 1;
-    for (const auto& s : items)
-        cb.addItem(s, id++);
-}
-
-static void addItems(juce::ComboBox& cb, const std::array<juce::String, 4>& items)
-{
-    int id = 1;
-    for (const auto& s : items)
-        cb.addItem(s, id++);
-}
-
-static void addItems(juce::ComboBox& cb, const std::array<juce::String, 3>& items)
-{
-    int id = 1;
-    for (const auto& s : items)
-        cb.addItem(s, id++);
-}
-
-static void addItems(juce::ComboBox& cb, const std::array<juce::String, 2>& items)
+template <size_t N>
+static void addItems(juce::ComboBox& cb, const std::array<juce::String, N>& items)
 {
     int id = 1;
     for (const auto& s : items)
@@ -70,9 +43,9 @@ MelodyForgeProAudioEditor::MelodyForgeProAudioEditor(MelodyForgeProAudioProcesso
     auto& apvts = processor.getAPVTS();
     genreAttach = std::make_unique<APVTS::ComboBoxAttachment>(apvts, "genre", genreBox);
     keyAttach = std::make_unique<APVTS::ComboBoxAttachment>(apvts, "key", keyBox);
-    modeAttach = std::make_unique<APVTS::ComboBoxAttachment>(apvts, "mode", modeBox);
+    modeAttach = std::make_unique<APVTS::ComboBoxAttachment>(apvts, "scale", modeBox);
     lengthAttach = std::make_unique<APVTS::ComboBoxAttachment>(apvts, "length", lengthBox);
-    typeAttach = std::make_unique<APVTS::ComboBoxAttachment>(apvts, "type", typeBox);
+    typeAttach = std::make_unique<APVTS::ComboBoxAttachment>(apvts, "generator", typeBox);
 
     // Left action panel
     addAndMakeVisible(leftActions);
@@ -119,12 +92,10 @@ MelodyForgeProAudioEditor::MelodyForgeProAudioEditor(MelodyForgeProAudioProcesso
     presetList.selectRow(0);
 
     setWantsKeyboardFocus(true);
-    startTimerHz(10);
 }
 
 MelodyForgeProAudioEditor::~MelodyForgeProAudioEditor()
 {
-    stopTimer();
     setLookAndFeel(nullptr);
 }
 
@@ -308,9 +279,16 @@ void MelodyForgeProAudioEditor::updateParticles()
     particles.setEnabled(animationToggle.getToggleState());
 }
 
-void MelodyForgeProAudioEditor::timerCallback()
+int MelodyForgeProAudioEditor::update(double nowMs)
 {
     // Keep particles in sync if host resets UI state.
     updateParticles();
+    processor.getLayerEngine().releaseFinished();
+
+    int repainted = 0;
+    repainted += pianoRoll.update() ? 1 : 0;
+    repainted += samplerSlots.update() ? 1 : 0;
+    repainted += particles.update(nowMs) ? 1 : 0;
+    return repainted;
 }
 } // namespace mfpr
@@ -13,8 +13,7 @@ class MelodyForgeProAudioProcessor;
 
 class MelodyForgeProAudioEditor final : public juce::AudioProcessorEditor,
                                         public juce::DragAndDropContainer,
-                                        private juce::ListBoxModel,
-                                        private juce::Timer
+                                        private juce::ListBoxModel
 {
 public:
     explicit MelodyForgeProAudioEditor(MelodyForgeProAudioProcessor&);
@@ -24,6 +23,11 @@ public:
     void resized() override;
     bool keyPressed(const juce::KeyPress& key) override;
 
+    // All of the editor's periodic work, run once per display frame at `nowMs`
+    // (Time::getMillisecondCounterHiRes()). Each component repaints only if what it shows has
+    // changed; returns how many did.
+    int update(double nowMs);
+
 private:
     // ListBoxModel
     int getNumRows() override;
@@ -31,8 +35,6 @@ private:
     void selectedRowsChanged(int lastRowSelected) override;
     void listBoxItemClicked(int row, const juce::MouseEvent& e) override;
 
-    void timerCallback() override;
-
     void configureComboBox(juce::ComboBox& cb);
     void configureMacroSlider(juce::Slider& s, const juce::String& name);
 
@@ -74,6 +76,9 @@ private:
 
     juce::Component leftActions;
     juce::Component macroArea;
+
+    // Last, so it stops before the components it updates are destroyed.
+    juce::VBlankAttachment vblank { this, [this] { update(juce::Time::getMillisecondCounterHiRes()); } };
 };
 } // namespace mfpr
 
@@ -69,13 +69,41 @@ static FxParams fxParamsFromMacros(const std::array<int, 13>& macros)
     return p;
 }
 
+// Runs the candidate search for triggered patterns, so the audio thread never waits for
+// generation (or for the WorkerPool helping with it).
+class MelodyForgeProAudioProcessor::GenerationThread final : public juce::Thread
+{
+public:
+    explicit GenerationThread(MelodyForgeProAudioProcessor& p)
+        : juce::Thread("MFPR generation")
+        , processor(p)
+    {
+    }
+
+    ~GenerationThread() override { stopThread(4000); }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+            if (!processor.generateNext())
+                wait(-1);
+    }
+
+private:
+    MelodyForgeProAudioProcessor& processor;
+};
+
 MelodyForgeProAudioProcessor::MelodyForgeProAudioProcessor()
     : AudioProcessor(BusesProperties().withOutput("Output", juce::AudioChannelSet::stereo(), true))
     , apvts(*this, nullptr, "Parameters", createParameterLayout())
     , assetLibrary()
     , presetManager(assetLibrary, apvts)
+    , generationThread(std::make_unique<GenerationThread>(*this))
+    , slotLoader(assetLibrary, [this](int slot, std::unique_ptr<SlotContent> content) { publishSlotContent(slot, std::move(content)); })
 {
     currentPattern = std::make_shared<GeneratedPattern>();
+    scoringModel.loadFromFile(ScoringModel::getUserWeightsFile());
+    generationThread->startThread();
 }
 
 MelodyForgeProAudioProcessor::~MelodyForgeProAudioProcessor() = default;
@@ -126,7 +154,11 @@ void MelodyForgeProAudioProcessor::changeProgramName(int, const juce::String&) {
 
 void MelodyForgeProAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    internalPpq = 0.0;
+    transportScheduler.prepare(sampleRate);
+    generatedEvents.ensureSize(16384);
+    layerEvents.ensureSize(16384);
+    samplesElapsed = 0;
+    numRecentNoteOns = 0;
 
     synth.prepare(sampleRate, samplesPerBlock, getTotalNumOutputChannels());
     fxChain.prepare(sampleRate, samplesPerBlock, getTotalNumOutputChannels());
@@ -166,7 +198,7 @@ int MelodyForgeProAudioProcessor::getKeyIndex() const
 
 int MelodyForgeProAudioProcessor::getModeIndex() const
 {
-    return (int) apvts.getRawParameterValue("mode")->load();
+    return (int) apvts.getRawParameterValue("scale")->load();
 }
 
 int MelodyForgeProAudioProcessor::getLengthBars() const
@@ -176,7 +208,7 @@ int MelodyForgeProAudioProcessor::getLengthBars() const
 
 int MelodyForgeProAudioProcessor::getTypeIndex() const
 {
-    return (int) apvts.getRawParameterValue("type")->load();
+    return (int) apvts.getRawParameterValue("generator")->load();
 }
 
 void MelodyForgeProAudioProcessor::triggerGenerateFromUI()
@@ -200,12 +232,27 @@ std::shared_ptr<const GeneratedPattern> MelodyForgeProAudioProcessor::getCurrent
     return currentPattern;
 }
 
-void MelodyForgeProAudioProcessor::setEditedPattern(GeneratedPattern edited)
+std::shared_ptr<const GeneratedPattern> MelodyForgeProAudioProcessor::setEditedPattern(GeneratedPattern edited)
 {
     edited.lengthSteps = juce::jmax(16, edited.lengthSteps);
     edited.numTracks = juce::jlimit(1, 16, edited.numTracks);
-    std::lock_guard<std::mutex> lock(patternMutex);
-    currentPattern = std::make_shared<GeneratedPattern>(std::move(edited));
+    auto pattern = std::make_shared<const GeneratedPattern>(std::move(edited));
+
+    {
+        std::lock_guard<std::mutex> lock(patternMutex);
+        publishPattern(pattern, currentGeneration);
+    }
+    ++patternVersion;
+    return pattern;
+}
+
+void MelodyForgeProAudioProcessor::publishPattern(std::shared_ptr<const GeneratedPattern> pattern, uint32_t generation)
+{
+    // Under the lock, so the audio thread gets patterns in the order the editor sees them.
+    currentPattern = pattern;
+    currentGeneration = generation;
+    playback.publish(std::make_unique<PlayingPattern>(PlayingPattern { std::move(pattern), generation }));
+    publishedGeneration.store(generation);
 }
 
 GenerationParams MelodyForgeProAudioProcessor::readGenerationParams(uint32_t seed) const
@@ -223,38 +270,90 @@ GenerationParams MelodyForgeProAudioProcessor::readGenerationParams(uint32_t see
     return p;
 }
 
-void MelodyForgeProAudioProcessor::generateAndSwapPattern(int rootNote, int velocity, int channel, bool chordInput)
+// A trigger as the audio thread posts it to the generation thread: the seed in the low 32
+// bits, then root note, velocity, channel and chord flag. Bit 63 keeps a request nonzero.
+static uint64_t packRequest(uint32_t seed, int rootNote, int velocity, int channel, bool chordInput)
+{
+    return uint64_t(seed)
+         | uint64_t(juce::jlimit(0, 127, rootNote)) << 32
+         | uint64_t(juce::jlimit(0, 127, velocity)) << 39
+         | uint64_t(juce::jlimit(1, 16, channel) - 1) << 46
+         | uint64_t(chordInput ? 1 : 0) << 50
+         | uint64_t(1) << 63;
+}
+
+void MelodyForgeProAudioProcessor::requestPattern(const Trigger& trigger, const TransportScheduler::Block& transport)
 {
-    auto baseSeed = seedCounter.fetch_add(1u);
+    lastRootNote.store(trigger.rootNote);
+    lastInputVelocity.store(trigger.velocity);
+    lastOutputChannel.store(trigger.channel);
 
-    auto params = readGenerationParams(baseSeed);
+    awaitedGeneration = seedCounter.fetch_add(1u);
+    triggerPpq = transport.ppqAt(trigger.samplePos);
+    pendingRequest.store(packRequest(awaitedGeneration, trigger.rootNote, trigger.velocity, trigger.channel, trigger.chordInput));
+    generationThread->notify();
+}
+
+bool MelodyForgeProAudioProcessor::generateNext()
+{
+    generating.store(true);
+    const auto request = pendingRequest.exchange(0);
+    if (request == 0)
+    {
+        generating.store(false);
+        return false;
+    }
+
+    const auto seed = uint32_t(request);
+    const int rootNote = int(request >> 32) & 127;
+    const int velocity = int(request >> 39) & 127;
+    const int channel = (int(request >> 46) & 15) + 1;
+    const bool chordInput = ((request >> 50) & 1) != 0;
+
+    auto params = readGenerationParams(seed);
     if (chordInput)
     {
         params.type = GeneratorType::hybrid;
         params.melodyFollowChordChance = 0.70f;
     }
 
-    // Button triggers 10 variations: pick best-scoring.
-    double bestScore = -1.0e9;
-    GeneratedPattern best;
+    // Button triggers N variations (10 by default): pick best-scoring.
+    CandidateSearchSettings search;
+    search.numCandidates = (int) apvts.getRawParameterValue("candidates")->load();
+    search.earlyStopScore = earlyStopScore.load();
+    search.scoringModel = &scoringModel;
+
+    const auto& best = candidateSearch.run(generator, params, rootNote, velocity, channel, assetLibrary, search, &workerPool.get());
 
-    for (uint32_t i = 0; i < 10; ++i)
+    // A newer trigger arrived meanwhile: its pattern replaces this one before it could play.
+    if (pendingRequest.load() == 0)
     {
-        params.seed = baseSeed + i;
-        auto candidate = generator.generate(params, rootNote, velocity, channel, assetLibrary);
-        const auto s = generator.score(candidate, params);
-        if (s > bestScore)
+        // Copying the winner out of the search's reusable buffers sizes it to its notes.
+        auto published = std::make_shared<const GeneratedPattern>(best);
         {
-            bestScore = s;
-            best = std::move(candidate);
+            std::lock_guard<std::mutex> lock(patternMutex);
+            publishPattern(std::move(published), seed);
         }
+        ++patternVersion;
     }
 
+    generating.store(false);
+    return true;
+}
+
+int MelodyForgeProAudioProcessor::findGridLine(const TransportScheduler::Block& transport, double& ppq) const
+{
+    for (int r = 0; r < transport.numRanges; ++r)
     {
-        std::lock_guard<std::mutex> lock(patternMutex);
-        currentPattern = std::make_shared<GeneratedPattern>(std::move(best));
+        const auto& range = transport.ranges[(size_t) r];
+        const auto line = triggerPpq + std::ceil((range.startPpq - EmissionRange::kTolerancePpq - triggerPpq) * 4.0) * 0.25;
+        if (range.contains(line))
+        {
+            ppq = line;
+            return juce::jlimit(range.fromSample, range.toSample - 1, range.sampleAt(line));
+        }
     }
-    gateOpen.store(true);
+    return -1;
 }
 
 static int floorDiv(int a, int b)
@@ -269,64 +368,144 @@ static int floorDiv(int a, int b)
 
 void MelodyForgeProAudioProcessor::buildPatternMidi(juce::MidiBuffer& out,
                                                    const GeneratedPattern& pattern,
-                                                   int patStartStep,
-                                                   int blockStartStep,
-                                                   double blockStartPpq,
-                                                   double samplesPerQuarter,
-                                                   int numSamples,
+                                                   double patStartPpq,
+                                                   bool repeat,
+                                                   const EmissionRange& range,
                                                    double swingAmount,
-                                                   juce::Random& rnd,
-                                                   bool humanize) const
+                                                   const CounterRng& jitter,
+                                                   bool humanize,
+                                                   ActiveNoteTable& active) const
 {
-    const int blockEndStep = blockStartStep + int(std::ceil((double) numSamples / (samplesPerQuarter / 4.0))) + 1;
+    // Range tests are done in PPQ against the same boundary the next range starts from, so
+    // every event lands in exactly one range however the host sizes its blocks.
+    if (range.isEmpty() || range.endPpq <= range.startPpq)
+        return;
+
     const int L = juce::jmax(1, pattern.lengthSteps);
+    const double swingPpq = 0.25 * swingAmount; // off-steps are delayed by this much
+
+    // Steps (counted from the pattern start, repeats included) that can land in the range.
+    // A repeating pattern also runs before its start, in phase with it, so it plays on after
+    // a loop wrap or a jump back to before its trigger.
+    const int minRepeat = repeat ? std::numeric_limits<int>::min() : 0;
+    const int maxRepeat = repeat ? std::numeric_limits<int>::max() : 0;
+    int firstStep = int(std::floor((range.startPpq - EmissionRange::kTolerancePpq - patStartPpq - swingPpq) * 4.0));
+    if (!repeat)
+        firstStep = juce::jmax(0, firstStep);
+    const int lastStep = int(std::ceil((range.endPpq - patStartPpq) * 4.0));
+    if (lastStep < firstStep)
+        return;
 
     const int maxJitterSamples = humanize ? int(std::round(getSampleRate() * 0.010)) : 0; // ±10ms
 
-    auto addEventAtStep = [&](const juce::MidiMessage& msg, int step, bool applyJitter)
+    // The jitter of a note-on is keyed by the note's index and the step it lands on, so it
+    // differs between repeats of the pattern but not between re-renders of the same block.
+    // Jitter never moves an event out of its range, so cutting notes at a range boundary
+    // always comes after them.
+    auto addEventAtStep = [&](const juce::MidiMessage& msg, int step, size_t noteIndex, bool applyJitter)
     {
-        const double eventPpq = double(step) / 4.0;
-        const double deltaPpq = eventPpq - blockStartPpq;
-        int samplePos = (int) std::llround(deltaPpq * samplesPerQuarter);
-        if (applyJitter && maxJitterSamples > 0)
-            samplePos += rnd.nextInt(juce::Range<int>(-maxJitterSamples, maxJitterSamples + 1));
+        const double eventPpq = patStartPpq + double(step) * 0.25 + ((step & 1) == 1 ? swingPpq : 0.0);
+        if (!range.contains(eventPpq))
+            return;
 
-        if ((step & 1) == 1) // swing off-steps
-            samplePos += int(std::llround((samplesPerQuarter / 4.0) * swingAmount));
+        int samplePos = range.sampleAt(eventPpq);
+        if (applyJitter && maxJitterSamples > 0)
+            samplePos += jitter.between((uint64_t(uint32_t(step)) << 32) | noteIndex, -maxJitterSamples, maxJitterSamples + 1);
 
-        samplePos = juce::jlimit(0, numSamples - 1, samplePos);
+        samplePos = juce::jlimit(range.fromSample, range.toSample - 1, samplePos);
         out.addEvent(msg, samplePos);
+
+        if (msg.isNoteOn())
+            active.noteOn(msg.getChannel(), msg.getNoteNumber());
+        else
+            active.noteOff(msg.getChannel(), msg.getNoteNumber());
     };
 
-    for (const auto& n : pattern.notes)
+    for (size_t i = 0; i < pattern.notes.size(); ++i)
     {
-        const int baseOn = patStartStep + n.startStep;
-        const int baseOff = baseOn + juce::jmax(1, n.lengthSteps);
+        const auto& n = pattern.notes[i];
+        const int baseOn = n.getStartStep();
+        const int baseOff = baseOn + n.getLengthSteps();
 
-        const int kOnStart = floorDiv(blockStartStep - baseOn, L);
-        for (int k = kOnStart; k < kOnStart + 4; ++k)
+        // Offs first, so a note re-struck where its previous repeat ends is not cut short.
+        for (int k = juce::jmax(minRepeat, floorDiv(firstStep - baseOff, L)); k <= maxRepeat && baseOff + k * L <= lastStep; ++k)
         {
-            const int onStep = baseOn + k * L;
-            if (onStep < blockStartStep || onStep >= blockEndStep)
-                continue;
-
-            auto on = juce::MidiMessage::noteOn(n.channel, n.noteNumber, (juce::uint8) juce::jlimit(1, 127, n.velocity));
-            addEventAtStep(on, onStep, humanize);
+            auto off = juce::MidiMessage::noteOff(n.getChannel(), n.getNoteNumber());
+            addEventAtStep(off, baseOff + k * L, i, false);
         }
 
-        const int kOffStart = floorDiv(blockStartStep - baseOff, L);
-        for (int k = kOffStart; k < kOffStart + 4; ++k)
+        for (int k = juce::jmax(minRepeat, floorDiv(firstStep - baseOn, L)); k <= maxRepeat && baseOn + k * L <= lastStep; ++k)
         {
-            const int offStep = baseOff + k * L;
-            if (offStep < blockStartStep || offStep >= blockEndStep)
-                continue;
-
-            auto off = juce::MidiMessage::noteOff(n.channel, n.noteNumber);
-            addEventAtStep(off, offStep, false);
+            auto on = juce::MidiMessage::noteOn(n.getChannel(), n.getNoteNumber(), (juce::uint8) n.getVelocity());
+            addEventAtStep(on, baseOn + k * L, i, humanize);
         }
     }
 }
 
+void MelodyForgeProAudioProcessor::renderPattern(juce::MidiBuffer& out,
+                                                const GeneratedPattern& pattern,
+                                                double patStartPpq,
+                                                bool repeat,
+                                                const TransportScheduler::Block& transport,
+                                                int fromSample,
+                                                int toSample,
+                                                double swingAmount,
+                                                const CounterRng& jitter,
+                                                bool humanize,
+                                                ActiveNoteTable& active) const
+{
+    for (int r = 0; r < transport.numRanges; ++r)
+    {
+        const auto range = transport.ranges[(size_t) r].clippedTo(fromSample, toSample);
+        if (range.isEmpty())
+            continue;
+
+        // Notes still sounding when a host loop jumps back are cut there.
+        if (range.fromSample == transport.loopWrapSample())
+            active.releaseAll(out, range.fromSample);
+
+        buildPatternMidi(out, pattern, patStartPpq, repeat, range, swingAmount, jitter, humanize, active);
+    }
+}
+
+bool MelodyForgeProAudioProcessor::detectTrigger(int note, int velocity, int channel, juce::int64 time, Trigger& trigger, juce::int64& chordStartTime)
+{
+    recentNoteOns[numRecentNoteOns++ % recentNoteOns.size()] = { note, velocity, time };
+
+    const auto window = juce::int64(std::llround(getSampleRate() * kChordWindowMs / 1000.0));
+    const auto numRecent = juce::jmin(numRecentNoteOns, recentNoteOns.size());
+
+    // Note-ons (this one included) within the window before this one, newest first.
+    int inWindow = 0;
+    int lowest = 127, loudest = 0;
+    chordStartTime = time;
+    for (size_t back = 0; back < numRecent; ++back)
+    {
+        const auto& r = recentNoteOns[(numRecentNoteOns - 1 - back) % recentNoteOns.size()];
+        if (time - r.time > window)
+            break;
+
+        ++inWindow;
+        lowest = juce::jmin(lowest, r.note);
+        loudest = juce::jmax(loudest, r.velocity);
+        chordStartTime = r.time;
+    }
+
+    trigger.channel = channel;
+    if (inWindow == kChordNotes)
+    {
+        trigger.rootNote = lowest;
+        trigger.velocity = loudest;
+        trigger.chordInput = true;
+        return true;
+    }
+
+    trigger.rootNote = note;
+    trigger.velocity = velocity;
+    trigger.chordInput = false;
+    return inWindow == 1;
+}
+
 void MelodyForgeProAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
@@ -343,159 +522,139 @@ void MelodyForgeProAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer
     synth.setParams(synthParamsFromMacros(macros));
     fxChain.setParams(fxParamsFromMacros(macros));
 
-    double bpm = 120.0;
-    double blockStartPpq = internalPpq;
-    bool havePos = false;
+    generatedEvents.clear();
 
-    if (auto* ph = getPlayHead())
+    // Stops and relocations cut whatever scheduled playback left sounding; a stop also ends
+    // the pattern (and any still being generated) until it is triggered again. (The sampler
+    // bank does the same for its slots.)
+    const auto transport = transportScheduler.advance(getPlayHead(), numSamples);
+    if (transport.stopped || transport.relocated)
+        patternNotes.releaseAll(generatedEvents, 0);
+    if (transport.stopped)
     {
-        if (auto posInfo = ph->getPosition())
-        {
-            if (auto bpmOpt = posInfo->getBpm())
-            {
-                bpm = *bpmOpt;
-                havePos = true;
-            }
-            if (auto ppqOpt = posInfo->getPpqPosition())
-            {
-                blockStartPpq = *ppqOpt;
-            }
-        }
+        gateOpen.store(false);
+        awaitedGeneration = 0;
+    }
+    if (transport.clockOffsetPpq != 0.0)
+    {
+        patternStartPpq.store(patternStartPpq.load() + transport.clockOffsetPpq);
+        triggerPpq += transport.clockOffsetPpq;
     }
-
-    const double samplesPerQuarter = (sr > 0.0) ? (sr * 60.0 / bpm) : 22050.0;
-    const double blockPpqLen = double(numSamples) / samplesPerQuarter;
-    const double blockEndPpq = blockStartPpq + blockPpqLen;
-    internalPpq = blockEndPpq;
-
-    const int blockStartStep = int(std::floor(blockStartPpq * 4.0));
 
     // Pending generate from UI thread.
     if (pendingGenerate.exchange(false))
     {
-        const int root = lastRootNote.load();
-        const int vel = lastInputVelocity.load();
-        const int ch = lastOutputChannel.load();
-        generateAndSwapPattern(root, vel, ch, false);
-        patternStartStep.store(blockStartStep);
+        Trigger t;
+        t.rootNote = lastRootNote.load();
+        t.velocity = lastInputVelocity.load();
+        t.channel = lastOutputChannel.load();
+        requestPattern(t, transport);
     }
 
-    // Detect incoming triggers.
-    struct NoteOn { int note = 60; int vel = 100; int ch = 1; int samplePos = 0; };
-    std::vector<NoteOn> noteOns;
-    noteOns.reserve(16);
-
-    for (const auto metadata : midiMessages)
+    // Live harmoniser: incoming notes get their chord tones at the same sample position
+    // instead of triggering a new pattern.
+    const bool harmonise = apvts.getRawParameterValue("harmonise")->load() > 0.5f;
+    if (harmonise)
     {
-        const auto m = metadata.getMessage();
-        if (m.isNoteOn())
-        {
-            noteOns.push_back({ m.getNoteNumber(), (int) m.getVelocity(), m.getChannel(), metadata.samplePosition });
-        }
+        const Harmoniser::Settings harmony { getKeyIndex(), getModeIndex(), getGenreIndex() };
+        for (const auto metadata : midiMessages)
+            harmoniser.process(metadata.getMessage(), metadata.samplePosition, harmony, generatedEvents);
     }
-
-    const auto isChordInput = [&]()
-    {
-        if ((int) noteOns.size() < 4)
-            return false;
-        const int first = noteOns.front().samplePos;
-        int near = 0;
-        for (const auto& n : noteOns)
-            if (std::abs(n.samplePos - first) <= 64)
-                ++near;
-        return near >= 4;
-    }();
-
-    if (!noteOns.empty())
+    else if (wasHarmonising)
     {
-        const int ch = noteOns.front().ch;
-        int root = noteOns.front().note;
-        int vel = noteOns.front().vel;
+        harmoniser.releaseAll(generatedEvents, 0);
+    }
+    wasHarmonising = harmonise;
 
-        if (isChordInput)
+    // Detect incoming triggers; only the block's last one is generated. A chord completing
+    // inside the block starts where its first note did; one completing in a later block
+    // starts at that block's first sample.
+    if (!harmonise)
+    {
+        Trigger latest;
+        bool triggered = false;
+        for (const auto metadata : midiMessages)
         {
-            root = 127;
-            vel = 0;
-            for (const auto& n : noteOns)
-            {
-                root = std::min(root, n.note);
-                vel = std::max(vel, n.vel);
-            }
-        }
+            const auto m = metadata.getMessage();
+            if (!m.isNoteOn())
+                continue;
 
-        lastRootNote.store(root);
-        lastInputVelocity.store(vel);
-        lastOutputChannel.store(ch);
+            Trigger t;
+            juce::int64 chordStartTime = 0;
+            if (!detectTrigger(m.getNoteNumber(), (int) m.getVelocity(), m.getChannel(), samplesElapsed + metadata.samplePosition, t, chordStartTime))
+                continue;
 
-        generateAndSwapPattern(root, vel, ch, isChordInput);
-        patternStartStep.store(blockStartStep);
-    }
+            t.samplePos = t.chordInput ? (int) juce::jmax(juce::int64(0), chordStartTime - samplesElapsed) : metadata.samplePosition;
+            latest = t;
+            triggered = true;
+        }
 
-    // Build generated MIDI and merge.
-    juce::MidiBuffer generated;
-    juce::Random rnd(seedCounter.load());
+        if (triggered)
+            requestPattern(latest, transport);
+    }
 
+    // Build generated MIDI and merge. The running pattern plays on until the awaited one is
+    // ready and its grid reaches a 16th, and the block is split there. Edits of the running
+    // pattern take over at once.
     const auto swing = swingDiscreteFrom0to50((int) apvts.getRawParameterValue("swing")->load());
     const bool humanize = true;
 
-    if (gateOpen.load())
-    {
-        if (auto pat = getCurrentPattern())
-            buildPatternMidi(generated,
-                             *pat,
-                             patternStartStep.load(),
-                             blockStartStep,
-                             blockStartPpq,
-                             samplesPerQuarter,
-                             numSamples,
-                             swing,
-                             rnd,
-                             humanize);
-    }
+    const auto ready = publishedGeneration.load();
+    if (ready == playingGeneration && playback.update())
+        playingGeneration = playback.get()->generation;
+
+    double switchPpq = 0.0;
+    const int switchSample = (ready != playingGeneration && ready == awaitedGeneration) ? findGridLine(transport, switchPpq) : -1;
 
-    // Sampler slot one-shots (trigger notes 60..63).
-    for (auto metadata : midiMessages)
+    int segmentStart = 0;
+    int playingLength = 0;
+    const auto renderPatternUntil = [&](int segmentEnd)
     {
-        const auto m = metadata.getMessage();
-        if (!m.isNoteOn())
-            continue;
-        const int slot = m.getNoteNumber() - 60;
-        if (slot < 0 || slot >= 4)
-            continue;
-        if (!slots[(size_t) slot].hasPattern)
-            continue;
+        const auto* playing = playback.get();
+        if (gateOpen.load() && playing != nullptr)
+        {
+            playingLength = playing->pattern->lengthSteps;
+            renderPattern(generatedEvents,
+                          *playing->pattern,
+                          patternStartPpq.load(),
+                          true,
+                          transport,
+                          segmentStart,
+                          segmentEnd,
+                          swing,
+                          CounterRng(playingGeneration + 1u, 0),
+                          humanize,
+                          patternNotes);
+        }
+        segmentStart = segmentEnd;
+    };
 
-        slots[(size_t) slot].active = true;
-        slots[(size_t) slot].startStep = blockStartStep;
-        slots[(size_t) slot].channel = m.getChannel();
+    if (switchSample >= 0)
+    {
+        // With a publish in progress the switch waits for the next grid line.
+        renderPatternUntil(switchSample);
+        if (playback.update())
+        {
+            patternNotes.releaseAll(generatedEvents, switchSample);
+            playingGeneration = playback.get()->generation;
+            patternStartPpq.store(switchPpq);
+            gateOpen.store(true);
+        }
     }
+    renderPatternUntil(numSamples);
 
-    for (auto& s : slots)
-    {
-        if (!s.active || !s.hasPattern)
-            continue;
+    // Sampler slots: each note-on plays its slot's phrase once.
+    samplerBank.process(transport, midiMessages, seedCounter.load(), humanize ? int(std::round(sr * 0.010)) : 0, generatedEvents);
 
-        auto pat = s.pattern;
-        for (auto& n : pat.notes)
-            n.channel = s.channel;
-
-        buildPatternMidi(generated,
-                         pat,
-                         s.startStep,
-                         blockStartStep,
-                         blockStartPpq,
-                         samplesPerQuarter,
-                         numSamples,
-                         0.0,
-                         rnd,
-                         true);
-
-        const int endStep = s.startStep + pat.lengthSteps + 1;
-        if (blockStartStep > endStep)
-            s.active = false;
-    }
+    // Launched layers, merged in time order into their own buffer.
+    layerEvents.clear();
+    layerEngine.process(transport, swing, layerEvents);
+
+    midiMessages.addEvents(generatedEvents, 0, numSamples, 0);
+    midiMessages.addEvents(layerEvents, 0, numSamples, 0);
+    samplesElapsed += numSamples;
 
-    midiMessages.addEvents(generated, 0, numSamples, 0);
+    publishPlaybackEvents(transport, gateOpen.load() ? playingLength : 0);
 
     // Audio render
     synth.render(buffer, midiMessages, 0, numSamples);
@@ -508,11 +667,27 @@ void MelodyForgeProAudioProcessor::getStateInformation(juce::MemoryBlock& destDa
     apvts.state.writeToStream(mos);
 }
 
+// Sessions saved before a parameter got a new ID keep its value under the old one.
+static void renameLegacyParameter(juce::ValueTree& state, const juce::String& oldId, const juce::String& newId)
+{
+    if (state.getChildWithProperty("id", newId).isValid())
+        return;
+
+    auto legacy = state.getChildWithProperty("id", oldId);
+    if (legacy.isValid())
+        legacy.setProperty("id", newId, nullptr);
+}
+
 void MelodyForgeProAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
     auto tree = juce::ValueTree::readFromData(data, (size_t) sizeInBytes);
-    if (tree.isValid())
-        apvts.replaceState(tree);
+    if (!tree.isValid())
+        return;
+
+    // Choice indices are stored denormalised, and the old entries lead the new lists.
+    renameLegacyParameter(tree, "mode", "scale");
+    renameLegacyParameter(tree, "type", "generator");
+    apvts.replaceState(tree);
 }
 
 bool MelodyForgeProAudioProcessor::exportCurrentPatternToFile(const juce::File& file, int forceTracks) const
@@ -529,77 +704,126 @@ bool MelodyForgeProAudioProcessor::exportCurrentPatternToFile(const juce::File&
 
 void MelodyForgeProAudioProcessor::importMidiToSamplerSlot(int slotIndex, const juce::File& midiFile)
 {
-    const int idx = juce::jlimit(0, 3, slotIndex);
-    if (!midiFile.existsAsFile())
-        return;
-
-    juce::FileInputStream in(midiFile);
-    if (!in.openedOk())
-        return;
+    slotLoader.load(juce::jlimit(0, samplerBank.getNumSlots() - 1, slotIndex), midiFile);
+}
 
-    juce::MidiFile midi;
-    if (!midi.readFrom(in))
-        return;
+int MelodyForgeProAudioProcessor::importMidiToSamplerSlots(int firstSlot, const juce::Array<juce::File>& midiFiles)
+{
+    const int first = juce::jlimit(0, samplerBank.getNumSlots() - 1, firstSlot);
+    const int count = juce::jmin(midiFiles.size(), SamplerBank::kMaxSlots - first);
+    if (count <= 0)
+        return 0;
 
-    if (midi.getNumTracks() <= 0)
-        return;
+    if (first + count > samplerBank.getNumSlots())
+        samplerBank.setNumSlots(first + count);
+    slotLoader.load(first, midiFiles);
+    return count;
+}
 
-    auto* tr = midi.getTrack(0);
-    if (tr == nullptr)
+void MelodyForgeProAudioProcessor::publishPlaybackEvents(const TransportScheduler::Block& transport, int patternLength)
+{
+    if (!playbackEvents.isListening())
+    {
+        publishingPlayback = false;
         return;
+    }
 
-    juce::MidiMessageSequence seq(*tr);
-    seq.updateMatchedPairs();
-
-    auto match = assetLibrary.matchMidiToLibrary(seq);
+    // An editor that has just started listening gets the current step straight away.
+    if (!publishingPlayback)
+        publishedStep = -2;
+    publishingPlayback = true;
 
-    // Convert sequence -> GeneratedPattern (16th-quantised)
-    GeneratedPattern pat;
-    pat.notes.reserve(256);
-    const int tpq = midi.getTimeFormat() > 0 ? midi.getTimeFormat() : 960;
-    const double stepTicks = double(tpq) / 4.0;
-    double maxEndTick = 0.0;
+    // A repeating pattern also plays before its start (after a loop wrap, say).
+    int step = -1;
+    if (patternLength > 0)
+    {
+        const auto position = (transport.endPpq() - patternStartPpq.load()) * 4.0;
+        step = juce::jlimit(0, patternLength - 1, int(position - std::floor(position / patternLength) * patternLength));
+    }
+    if (step != publishedStep)
+        playbackEvents.push({ PlaybackEvent::Type::step, 0, step });
+    publishedStep = step;
 
-    for (int i = 0; i < seq.getNumEvents(); ++i)
+    for (const auto* events : { &generatedEvents, &layerEvents })
     {
-        auto* e = seq.getEventPointer(i);
-        if (e == nullptr)
-            continue;
-        const auto& m = e->message;
-        if (!m.isNoteOn())
-            continue;
-        if (auto* off = e->noteOffObject)
+        for (const auto metadata : *events)
         {
-            const auto startTick = m.getTimeStamp();
-            const auto endTick = off->message.getTimeStamp();
-            const int startStep = int(std::llround(startTick / stepTicks));
-            const int lenSteps = juce::jmax(1, int(std::llround((endTick - startTick) / stepTicks)));
-            pat.notes.push_back(MidiNote{ m.getNoteNumber(), startStep, lenSteps, juce::jlimit(1, 127, (int) m.getVelocity()), 1, 0 });
-            maxEndTick = std::max(maxEndTick, endTick);
+            const auto m = metadata.getMessage();
+            if (m.isNoteOn())
+                playbackEvents.push({ PlaybackEvent::Type::noteOn, (uint8_t) m.getNoteNumber(), 0 });
+            else if (m.isNoteOff())
+                playbackEvents.push({ PlaybackEvent::Type::noteOff, (uint8_t) m.getNoteNumber(), 0 });
         }
     }
+}
 
-    const int maxStep = int(std::ceil(maxEndTick / stepTicks));
-    pat.lengthSteps = juce::jmax(16, ((maxStep + 15) / 16) * 16);
-    pat.numTracks = 1;
-
-    auto& s = slots[(size_t) idx];
-    s.pattern = std::move(pat);
-    s.hasPattern = true;
+void MelodyForgeProAudioProcessor::publishSlotContent(int slot, std::unique_ptr<SlotContent> content)
+{
+    if (!juce::isPositiveAndBelow(slot, SamplerBank::kMaxSlots))
+        return;
 
-    s.info.label = midiFile.getFileName();
-    s.info.matchScore = match.matched ? match.score : 0.0;
-    if (match.matched)
     {
-        s.info.label = match.isChord ? juce::String::formatted("Matched Chords %03d", match.index)
-                                     : juce::String::formatted("Matched Melody %03d", match.index);
+        const juce::ScopedLock sl(slotInfoLock);
+        slotInfo[(size_t) slot] = { content->label, content->matchScore };
     }
+    samplerBank.publish(slot, std::move(content));
 }
 
 MelodyForgeProAudioProcessor::SamplerSlotInfo MelodyForgeProAudioProcessor::getSamplerSlotInfo(int slotIndex) const
 {
-    const int idx = juce::jlimit(0, 3, slotIndex);
-    return slots[(size_t) idx].hasPattern ? slots[(size_t) idx].info : SamplerSlotInfo{ "Empty — drop MIDI", 0.0 };
+    const int idx = juce::jlimit(0, SamplerBank::kMaxSlots - 1, slotIndex);
+
+    SamplerSlotInfo info { "Empty — drop MIDI", 0.0 };
+    {
+        const juce::ScopedLock sl(slotInfoLock);
+        if (slotInfo[(size_t) idx].label.isNotEmpty())
+        {
+            info = slotInfo[(size_t) idx];
+            info.hasPhrase = true;
+        }
+    }
+    info.loadProgress = slotLoader.getProgress(idx);
+    info.triggerNote = samplerBank.getTriggerNote(idx);
+    return info;
+}
+
+uint32_t MelodyForgeProAudioProcessor::getSamplerSlotsVersion() const
+{
+    // Both counters only move forward, so their sum moves whenever either does.
+    return samplerBank.getVersion() + slotLoader.getVersion();
+}
+
+bool MelodyForgeProAudioProcessor::updateSamplerSlotsSnapshot(SamplerSlotsSnapshot& snapshot) const
+{
+    // Read before the slots: a change made while they are copied moves it again, and the
+    // next update picks that up.
+    const auto version = getSamplerSlotsVersion();
+    if (!snapshot.slots.empty() && snapshot.version == version)
+        return false;
+
+    snapshot.version = version;
+    snapshot.slots.resize((size_t) samplerBank.getNumSlots());
+
+    std::array<int, SamplerBank::kMaxSlots> triggerNotes;
+    triggerNotes.fill(-1);
+    for (int note = 127; note >= 0; --note)
+    {
+        const int slot = samplerBank.getSlotForNote(note);
+        if (slot >= 0)
+            triggerNotes[(size_t) slot] = note;
+    }
+
+    const juce::ScopedLock sl(slotInfoLock);
+    for (size_t i = 0; i < snapshot.slots.size(); ++i)
+    {
+        auto& info = snapshot.slots[i];
+        info.hasPhrase = slotInfo[i].label.isNotEmpty();
+        info.label = info.hasPhrase ? slotInfo[i].label : juce::String("Empty — drop MIDI");
+        info.matchScore = info.hasPhrase ? slotInfo[i].matchScore : 0.0;
+        info.loadProgress = slotLoader.getProgress((int) i);
+        info.triggerNote = triggerNotes[i];
+    }
+    return true;
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout MelodyForgeProAudioProcessor::createParameterLayout()
@@ -608,12 +832,17 @@ juce::AudioProcessorValueTreeState::ParameterLayout MelodyForgeProAudioProcessor
 
     layout.add(std::make_unique<juce::AudioParameterChoice>("genre", "Genre", juce::StringArray(mfpr::kGenres.data(), (int) mfpr::kGenres.size()), 0));
     layout.add(std::make_unique<juce::AudioParameterChoice>("key", "Key", juce::StringArray(mfpr::kKeys.data(), (int) mfpr::kKeys.size()), 0));
-    layout.add(std::make_unique<juce::AudioParameterChoice>("mode", "Mode", juce::StringArray(mfpr::kModes.data(), (int) mfpr::kModes.size()), 0));
+    // "scale" replaced the two-entry "mode" when the modal scales were added: a new ID keeps
+    // host automation recorded against the old range from landing on a different mode.
+    layout.add(std::make_unique<juce::AudioParameterChoice>("scale", "Mode", juce::StringArray(mfpr::kModes.data(), (int) mfpr::kModes.size()), 0));
     layout.add(std::make_unique<juce::AudioParameterChoice>("length", "Length", juce::StringArray(mfpr::kLengths.data(), (int) mfpr::kLengths.size()), 0));
-    layout.add(std::make_unique<juce::AudioParameterChoice>("type", "Type", juce::StringArray(mfpr::kTypes.data(), (int) mfpr::kTypes.size()), 0));
+    // Likewise "generator" replaced the three-entry "type" when Markov was added.
+    layout.add(std::make_unique<juce::AudioParameterChoice>("generator", "Type", juce::StringArray(mfpr::kTypes.data(), (int) mfpr::kTypes.size()), 0));
 
     layout.add(std::make_unique<juce::AudioParameterInt>("velSens", "Velocity Sensitivity", 0, 100, 80));
     layout.add(std::make_unique<juce::AudioParameterInt>("swing", "Swing", 0, 50, 0));
+    layout.add(std::make_unique<juce::AudioParameterInt>("candidates", "Candidates", 1, CandidateSearchSettings::kMaxCandidates, 10));
+    layout.add(std::make_unique<juce::AudioParameterBool>("harmonise", "Live Harmoniser", false));
 
     for (int i = 1; i <= 13; ++i)
         layout.add(std::make_unique<juce::AudioParameterInt>(juce::String::formatted("macro%02d", i),
@@ -2,10 +2,21 @@
 
 #include "JuceIncludes.h"
 #include "AssetLibrary.h"
+#include "CandidateSearch.h"
+#include "CounterRng.h"
 #include "FxChain.h"
+#include "Harmoniser.h"
+#include "LayerEngine.h"
 #include "MelodyGenerator.h"
+#include "PlaybackEventFifo.h"
 #include "PresetManager.h"
+#include "RealtimeHandoff.h"
+#include "SamplerBank.h"
+#include "ScoringModel.h"
+#include "SlotLoader.h"
 #include "SynthEngine.h"
+#include "TransportScheduler.h"
+#include "WorkerPool.h"
 #include <mutex>
 
 namespace mfpr
@@ -50,7 +61,10 @@ public:
     //==============================================================================
     juce::AudioProcessorValueTreeState& getAPVTS() { return apvts; }
     AssetLibrary& getAssetLibrary() { return assetLibrary; }
+    LayerEngine& getLayerEngine() { return layerEngine; }
+    PlaybackEventFifo& getPlaybackEvents() { return playbackEvents; } // for one editor at a time
     PresetManager& getPresetManager() { return presetManager; }
+    SamplerBank& getSamplerBank() { return samplerBank; }
 
     // UI helpers
     int getGenreIndex() const;
@@ -61,17 +75,53 @@ public:
 
     void triggerGenerateFromUI();
 
+    // True while the generation thread has a triggered pattern still to finish.
+    bool isGeneratingPattern() const { return pendingRequest.load() != 0 || generating.load(); }
+    // False until the first generated pattern starts, and after the host stops.
+    bool isPatternPlaying() const { return gateOpen.load(); }
+
+    // Candidates scoring at or above this end the search early (default: never).
+    void setEarlyStopScore(double score) { earlyStopScore.store(score); }
+
     struct SamplerSlotInfo
     {
         juce::String label;
         double matchScore = 0.0;
+        float loadProgress = -1.0f; // 0..1 while a file is being imported into the slot
+        bool hasPhrase = false;
+        int triggerNote = -1;
+    };
+
+    // The slots as the editor shows them, taken when `version` was current.
+    struct SamplerSlotsSnapshot
+    {
+        uint32_t version = 0;
+        std::vector<SamplerSlotInfo> slots; // one per slot in the bank
     };
 
+    // Imports the file on a background thread; the slot switches to it once it has loaded.
     void importMidiToSamplerSlot(int slotIndex, const juce::File& midiFile);
+
+    // Imports the files in parallel into consecutive slots from firstSlot, growing the bank
+    // to fit them (up to its maximum). Each slot switches over as soon as its file has loaded.
+    // Returns the number of files queued.
+    int importMidiToSamplerSlots(int firstSlot, const juce::Array<juce::File>& midiFiles);
     SamplerSlotInfo getSamplerSlotInfo(int slotIndex) const;
+    float getSamplerSlotLoadProgress(int slotIndex) const { return slotLoader.getProgress(slotIndex); }
+
+    // Moves whenever the bank, a slot's phrase or the set of running imports changes
+    // (import progress aside).
+    uint32_t getSamplerSlotsVersion() const;
+
+    // Message thread. Refills the snapshot, reusing its storage, if the slots have changed
+    // since it was taken; returns whether they had.
+    bool updateSamplerSlotsSnapshot(SamplerSlotsSnapshot& snapshot) const;
 
     std::shared_ptr<const GeneratedPattern> getCurrentPattern() const;
-    void setEditedPattern(GeneratedPattern edited);
+    // Moves whenever the current pattern is replaced.
+    uint32_t getPatternVersion() const { return patternVersion.load(); }
+    // Replaces the current pattern; returns it as getCurrentPattern() will.
+    std::shared_ptr<const GeneratedPattern> setEditedPattern(GeneratedPattern edited);
 
     bool exportCurrentPatternToFile(const juce::File& file, int forceTracks = 0) const;
 
@@ -79,18 +129,70 @@ private:
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
     GenerationParams readGenerationParams(uint32_t seed) const;
-    void generateAndSwapPattern(int rootNote, int velocity, int channel, bool chordInput);
 
+    // Loader thread: makes freshly imported content the slot's next pattern.
+    void publishSlotContent(int slot, std::unique_ptr<SlotContent> content);
+
+    // Audio thread: the step playing at the end of the block and the block's output notes,
+    // for the editor. patternLength is 0 when no pattern is playing.
+    void publishPlaybackEvents(const TransportScheduler::Block& transport, int patternLength);
+
+    // Adds the events of `pattern` (started at patternStartPpq, looping if `repeat`) whose
+    // swung position falls in `range`, and records the notes they start and end in `active`.
+    // Humanize jitter moves note-ons afterwards, but never out of the range.
     void buildPatternMidi(juce::MidiBuffer& out,
                           const GeneratedPattern& pattern,
-                          int patternStartStep,
-                          int blockStartStep,
-                          double blockStartPpq,
-                          double samplesPerQuarter,
-                          int numSamples,
+                          double patternStartPpq,
+                          bool repeat,
+                          const EmissionRange& range,
                           double swingAmount,
-                          juce::Random& rnd,
-                          bool humanize) const;
+                          const CounterRng& jitter,
+                          bool humanize,
+                          ActiveNoteTable& active) const;
+
+    // buildPatternMidi() over samples [fromSample, toSample) of the block, across a loop wrap.
+    void renderPattern(juce::MidiBuffer& out,
+                       const GeneratedPattern& pattern,
+                       double patternStartPpq,
+                       bool repeat,
+                       const TransportScheduler::Block& transport,
+                       int fromSample,
+                       int toSample,
+                       double swingAmount,
+                       const CounterRng& jitter,
+                       bool humanize,
+                       ActiveNoteTable& active) const;
+
+    // A pattern (re)start found in the incoming MIDI.
+    struct Trigger
+    {
+        int samplePos = 0;
+        int rootNote = 60;
+        int velocity = 100;
+        int channel = 1;
+        bool chordInput = false;
+    };
+
+    // Audio thread. Asks the generation thread for a new pattern, on a 16th grid starting at
+    // the trigger; it replaces the playing one on the first grid line after it is ready.
+    void requestPattern(const Trigger& trigger, const TransportScheduler::Block& transport);
+
+    // Generation thread. Runs the candidate search for the latest request and publishes the
+    // winner; false if there was no request.
+    bool generateNext();
+
+    // Makes `pattern` current for the editor and passes it to the audio thread. Call with
+    // patternMutex held.
+    void publishPattern(std::shared_ptr<const GeneratedPattern> pattern, uint32_t generation);
+
+    // Audio thread. Where the first grid line of the latest trigger's 16th grid falls in the
+    // block, or -1 if none does.
+    int findGridLine(const TransportScheduler::Block& transport, double& ppq) const;
+
+    // Feeds one note-on (at an absolute sample time) to chord detection. Returns true and
+    // fills `trigger` (except samplePos) if it starts a pattern: the first note of a group,
+    // or the note completing a chord. `chordStartTime` is then the group's first note-on.
+    bool detectTrigger(int note, int velocity, int channel, juce::int64 time, Trigger& trigger, juce::int64& chordStartTime);
 
     //==============================================================================
     juce::AudioProcessorValueTreeState apvts;
@@ -98,35 +200,82 @@ private:
     PresetManager presetManager;
 
     MelodyGenerator generator;
+    CandidateSearch candidateSearch;
+    ScoringModel scoringModel; // loaded once from ScoringModel::getUserWeightsFile(), if present
+    juce::SharedResourcePointer<WorkerPool> workerPool;
     SynthEngine synth;
     FxChain fxChain;
+    Harmoniser harmoniser;
+    bool wasHarmonising = false;
+    LayerEngine layerEngine;
+
+    // Sized in prepareToPlay() and reused every block, so building a block's MIDI never allocates.
+    juce::MidiBuffer generatedEvents; // pattern, harmoniser and sampler-slot events
+    juce::MidiBuffer layerEvents;
+
+    PlaybackEventFifo playbackEvents;
+    bool publishingPlayback = false;
+    int publishedStep = -1;
 
     std::atomic<bool> pendingGenerate { false };
     std::atomic<uint32_t> seedCounter { 1u };
+    std::atomic<double> earlyStopScore { std::numeric_limits<double>::infinity() };
 
     std::atomic<int> lastRootNote { 60 };
     std::atomic<int> lastInputVelocity { 100 };
     std::atomic<int> lastOutputChannel { 1 };
 
-    std::atomic<int> patternStartStep { 0 };
+    std::atomic<double> patternStartPpq { 0.0 };
     std::atomic<bool> gateOpen { false };
+    ActiveNoteTable patternNotes;
+
+    // A pattern on its way to the audio thread. `generation` is the seed it was generated
+    // from; edits keep the generation of the pattern they edit.
+    struct PlayingPattern
+    {
+        std::shared_ptr<const GeneratedPattern> pattern;
+        uint32_t generation = 0;
+    };
+
+    class GenerationThread;
+
+    std::atomic<uint64_t> pendingRequest { 0 }; // the latest trigger, packed; 0: none
+    std::atomic<bool> generating { false };
+    uint32_t awaitedGeneration = 0;  // audio thread: the latest trigger's, 0 after a stop
+    uint32_t playingGeneration = 0;  // audio thread
+    double triggerPpq = 0.0;         // audio thread: where the latest trigger's grid starts
 
     mutable std::mutex patternMutex;
     std::shared_ptr<const GeneratedPattern> currentPattern;
+    uint32_t currentGeneration = 0;
+    std::atomic<uint32_t> publishedGeneration { 0 }; // of the pattern last passed to playback
+    RealtimeHandoff<PlayingPattern> playback;
+    std::atomic<uint32_t> patternVersion { 0 }; // moved after currentPattern is replaced
 
-    struct SlotState
-    {
-        GeneratedPattern pattern;
-        bool hasPattern = false;
-        SamplerSlotInfo info;
+    SamplerBank samplerBank; // its content arrives from slotLoader
 
-        bool active = false;
-        int startStep = 0;
-        int channel = 1;
+    juce::CriticalSection slotInfoLock; // guards slotInfo, written by the loader thread
+    std::array<SamplerSlotInfo, SamplerBank::kMaxSlots> slotInfo;
+
+    TransportScheduler transportScheduler;
+    juce::int64 samplesElapsed = 0; // since prepareToPlay(), for timing across blocks
+
+    // Note-ons this close together (and at least kChordNotes of them) are one chord input.
+    static constexpr double kChordWindowMs = 25.0;
+    static constexpr int kChordNotes = 4;
+
+    struct RecentNoteOn
+    {
+        int note = 0;
+        int velocity = 0;
+        juce::int64 time = 0;
     };
-    std::array<SlotState, 4> slots;
+    std::array<RecentNoteOn, 8> recentNoteOns {}; // ring, written at numRecentNoteOns % size
+    size_t numRecentNoteOns = 0;
 
-    double internalPpq = 0.0;
+    // Last, so their threads are stopped before anything they publish to is destroyed.
+    std::unique_ptr<GenerationThread> generationThread;
+    SlotLoader slotLoader;
 };
 } // namespace mfpr
 
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "JuceIncludes.h"
+
+namespace mfpr
+{
+// Passes objects from other threads to the audio thread. The audio side never locks,
+// allocates or frees: an object it replaces comes back through `retired` and is freed by a
+// later publish(), so at most three objects exist at a time.
+template <typename Content>
+class RealtimeHandoff final
+{
+public:
+    RealtimeHandoff() = default;
+
+    ~RealtimeHandoff()
+    {
+        delete pending.exchange(nullptr);
+        delete retired.exchange(nullptr);
+        delete current;
+    }
+
+    // Any thread. Replaces content the audio thread has not picked up yet.
+    void publish(std::unique_ptr<Content> content)
+    {
+        // `retired` is emptied after the new content is in place, so an update() that finds it
+        // full is always followed by a publish() that empties it.
+        delete pending.exchange(content.release());
+        delete retired.exchange(nullptr);
+    }
+
+    // Audio thread. Picks up newly published content; returns true if the current one changed.
+    bool update()
+    {
+        // With `retired` still full the swap waits until the publish() in progress empties it.
+        if (retired.load() != nullptr)
+            return false;
+
+        auto* next = pending.exchange(nullptr);
+        if (next == nullptr)
+            return false;
+
+        retired.store(current);
+        current = next;
+        return true;
+    }
+
+    // Audio thread. True if published content is still waiting for update().
+    bool hasPending() const { return pending.load() != nullptr; }
+
+    // Audio thread. The content picked up by the last update(), or null.
+    const Content* get() const { return current; }
+
+private:
+    std::atomic<Content*> pending { nullptr };
+    std::atomic<Content*> retired { nullptr };
+    Content* current = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(RealtimeHandoff)
+};
+} // namespace mfpr
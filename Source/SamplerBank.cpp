@@ -0,0 +1,243 @@
+#include "SamplerBank.h"
+
+namespace mfpr
+{
+SamplerBank::SamplerBank()
+{
+    for (auto& n : noteToSlot)
+        n.store(-1);
+    for (int i = 0; i < kMaxSlots; ++i)
+        noteToSlot[(size_t) ((kFirstTriggerNote + i) % 128)].store(i);
+    activeIndexOf.fill(-1);
+}
+
+void SamplerBank::setNumSlots(int newNumSlots)
+{
+    numSlots.store(juce::jlimit(1, kMaxSlots, newNumSlots));
+    ++version;
+}
+
+void SamplerBank::setTriggerNote(int slot, int noteNumber)
+{
+    if (!juce::isPositiveAndBelow(slot, kMaxSlots))
+        return;
+
+    for (auto& n : noteToSlot)
+    {
+        auto expected = slot;
+        n.compare_exchange_strong(expected, -1);
+    }
+    if (juce::isPositiveAndBelow(noteNumber, 128))
+        noteToSlot[(size_t) noteNumber].store(slot);
+    ++version;
+}
+
+int SamplerBank::getTriggerNote(int slot) const
+{
+    for (int note = 0; note < 128; ++note)
+        if (noteToSlot[(size_t) note].load() == slot)
+            return note;
+    return -1;
+}
+
+void SamplerBank::setSlotSettings(int slot, const SlotSettings& settings)
+{
+    if (!juce::isPositiveAndBelow(slot, kMaxSlots))
+        return;
+
+    slots[(size_t) slot].channel.store(juce::jlimit(0, 16, settings.channel));
+    slots[(size_t) slot].transpose.store(juce::jlimit(-48, 48, settings.transpose));
+    ++version;
+}
+
+SlotSettings SamplerBank::getSlotSettings(int slot) const
+{
+    if (!juce::isPositiveAndBelow(slot, kMaxSlots))
+        return {};
+    return { slots[(size_t) slot].channel.load(), slots[(size_t) slot].transpose.load() };
+}
+
+void SamplerBank::publish(int slot, std::unique_ptr<SlotContent> content)
+{
+    if (!juce::isPositiveAndBelow(slot, kMaxSlots) || content == nullptr)
+        return;
+
+    slots[(size_t) slot].content.publish(std::move(content));
+    contentPending.store(true);
+    ++version;
+}
+
+void SamplerBank::deactivate(int slot)
+{
+    const int index = activeIndexOf[(size_t) slot];
+    if (index < 0)
+        return;
+
+    const int last = activeSlots[(size_t) --numActive];
+    activeSlots[(size_t) index] = (uint8_t) last;
+    activeIndexOf[(size_t) last] = index;
+    activeIndexOf[(size_t) slot] = -1;
+}
+
+void SamplerBank::start(int slot,
+                        int channel,
+                        int samplePos,
+                        const TransportScheduler::Block& transport,
+                        uint32_t seed,
+                        int maxJitterSamples,
+                        juce::MidiBuffer& out)
+{
+    auto& s = slots[(size_t) slot];
+    if (activeIndexOf[(size_t) slot] >= 0)
+    {
+        // A retrigger cuts the previous run at the trigger's sample, like a new pattern does.
+        render(slot, transport, samplePos, seed, maxJitterSamples, out);
+        s.notes.releaseAll(out, samplePos);
+    }
+    else
+    {
+        activeIndexOf[(size_t) slot] = numActive;
+        activeSlots[(size_t) numActive++] = (uint8_t) slot;
+    }
+
+    const auto channelSetting = s.channel.load(std::memory_order_relaxed);
+    s.playChannel = channelSetting > 0 ? channelSetting : channel;
+    s.playTranspose = s.transpose.load(std::memory_order_relaxed);
+    s.startPpq = transport.ppqAt(samplePos);
+    s.renderedUntil = samplePos;
+}
+
+void SamplerBank::renderRange(Slot& s, const SlotContent& content, const EmissionRange& range, const CounterRng& jitter, int maxJitterSamples, juce::MidiBuffer& out)
+{
+    const auto& events = content.schedule.getEvents();
+    const auto ppqOf = [&s](const PatternSchedule::Event& e) { return s.startPpq + double(e.step) * 0.25; };
+
+    // Events are in time order, so the range's events are one run of the schedule.
+    auto it = std::lower_bound(events.begin(), events.end(), range.startPpq - EmissionRange::kTolerancePpq,
+                               [&](const PatternSchedule::Event& e, double t) { return ppqOf(e) < t; });
+
+    for (; it != events.end(); ++it)
+    {
+        const auto t = ppqOf(*it);
+        if (!range.contains(t))
+            break;
+
+        const int note = it->noteNumber + s.playTranspose;
+        if (note < 0 || note > 127)
+            continue;
+
+        int samplePos = range.sampleAt(t);
+        if (it->velocity > 0)
+        {
+            // Keyed by step and event index, so re-rendering a block jitters it the same way.
+            if (maxJitterSamples > 0)
+                samplePos += jitter.between((uint64_t(it->step) << 32) | uint64_t(it - events.begin()), -maxJitterSamples, maxJitterSamples + 1);
+            samplePos = juce::jlimit(range.fromSample, range.toSample - 1, samplePos);
+
+            out.addEvent(juce::MidiMessage::noteOn(s.playChannel, note, (juce::uint8) it->velocity), samplePos);
+            s.notes.noteOn(s.playChannel, note);
+        }
+        else
+        {
+            samplePos = juce::jlimit(range.fromSample, range.toSample - 1, samplePos);
+            out.addEvent(juce::MidiMessage::noteOff(s.playChannel, note), samplePos);
+            s.notes.noteOff(s.playChannel, note);
+        }
+    }
+}
+
+void SamplerBank::render(int slot, const TransportScheduler::Block& transport, int toSample, uint32_t seed, int maxJitterSamples, juce::MidiBuffer& out)
+{
+    auto& s = slots[(size_t) slot];
+    const auto* content = s.content.get();
+    if (content == nullptr)
+        return;
+
+    const CounterRng jitter(seed, uint32_t(1 + slot));
+    for (int r = 0; r < transport.numRanges; ++r)
+    {
+        const auto range = transport.ranges[(size_t) r].clippedTo(s.renderedUntil, toSample);
+        if (range.isEmpty())
+            continue;
+
+        // Notes still sounding when a host loop jumps back are cut there. A run started before
+        // the wrap goes on from the loop start, so its start moves back by the loop's length.
+        if (range.fromSample == transport.loopWrapSample())
+        {
+            s.notes.releaseAll(out, range.fromSample);
+            if (s.renderedUntil < range.fromSample)
+                s.startPpq -= transport.ranges[0].endPpq - transport.ranges[1].startPpq;
+        }
+
+        renderRange(s, *content, range, jitter, maxJitterSamples, out);
+    }
+    s.renderedUntil = juce::jmax(s.renderedUntil, toSample);
+}
+
+void SamplerBank::process(const TransportScheduler::Block& transport,
+                          const juce::MidiBuffer& input,
+                          uint32_t seed,
+                          int maxJitterSamples,
+                          juce::MidiBuffer& out)
+{
+    // Stops and relocations cut what the slots left sounding; a stop also ends every run.
+    for (int i = 0; i < numActive; ++i)
+    {
+        auto& s = slots[activeSlots[(size_t) i]];
+        s.startPpq += transport.clockOffsetPpq;
+        s.renderedUntil = 0;
+        if (transport.stopped || transport.relocated)
+            s.notes.releaseAll(out, 0);
+    }
+    if (transport.stopped)
+        while (numActive > 0)
+            deactivate(activeSlots[0]);
+
+    // Newly imported content takes over at the start of the block and ends the old run.
+    if (contentPending.exchange(false))
+    {
+        for (int slot = 0; slot < kMaxSlots; ++slot)
+        {
+            auto& s = slots[(size_t) slot];
+            if (s.content.update() && activeIndexOf[(size_t) slot] >= 0)
+            {
+                s.notes.releaseAll(out, 0);
+                deactivate(slot);
+            }
+            if (s.content.hasPending())
+                contentPending.store(true);
+        }
+    }
+
+    const int count = numSlots.load(std::memory_order_relaxed);
+    for (const auto metadata : input)
+    {
+        const auto m = metadata.getMessage();
+        if (!m.isNoteOn())
+            continue;
+
+        const int slot = noteToSlot[(size_t) m.getNoteNumber()].load(std::memory_order_relaxed);
+        if (slot < 0 || slot >= count || slots[(size_t) slot].content.get() == nullptr)
+            continue;
+
+        start(slot, m.getChannel(), metadata.samplePosition, transport, seed, maxJitterSamples, out);
+    }
+
+    // Backwards, so a finished slot can be swapped out of the list in place.
+    const int numSamples = transport.ranges[(size_t) transport.numRanges - 1].toSample;
+    for (int i = numActive; --i >= 0;)
+    {
+        const int slot = activeSlots[(size_t) i];
+        render(slot, transport, numSamples, seed, maxJitterSamples, out);
+
+        // Done once the timeline is past its single pass, trailing note-offs included.
+        auto& s = slots[(size_t) slot];
+        const auto endPpq = s.startPpq + double(s.content.get()->schedule.getLengthSteps()) * 0.25;
+        if (transport.endPpq() > endPpq + EmissionRange::kTolerancePpq)
+        {
+            s.notes.releaseAll(out, numSamples - 1);
+            deactivate(slot);
+        }
+    }
+}
+} // namespace mfpr
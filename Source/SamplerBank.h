@@ -0,0 +1,101 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "CounterRng.h"
+#include "SlotLoader.h"
+#include "TransportScheduler.h"
+
+namespace mfpr
+{
+// A sampler slot's playback settings. Changes are picked up at the slot's next trigger.
+struct SlotSettings
+{
+    int channel = 0;   // 1..16, or 0 for the trigger note's channel
+    int transpose = 0; // semitones; notes pushed outside 0..127 are dropped
+};
+
+// The sampler slots: up to kMaxSlots imported phrases, each played once from its trigger
+// note. Incoming notes find their slot through a 128-entry table, and each block only the
+// slots that are playing are visited, so a full bank costs no more than the few in use.
+//
+// Settings, trigger notes and the slot count are changed on the message thread; content
+// arrives from loader threads through each slot's SlotContentHandoff. process() runs on the
+// audio thread and never allocates or locks.
+class SamplerBank final
+{
+public:
+    static constexpr int kMaxSlots = SlotLoader::kMaxSlots;
+    static constexpr int kDefaultNumSlots = 4;
+    static constexpr int kFirstTriggerNote = 60; // slot i defaults to note (60 + i) % 128
+
+    SamplerBank();
+
+    // Message thread. Slots past the count keep their content but are not triggered.
+    void setNumSlots(int newNumSlots);
+    int getNumSlots() const { return numSlots.load(); }
+
+    // Message thread. A note triggers at most one slot: giving it to this slot takes it from
+    // any other. -1 leaves the slot without a trigger note.
+    void setTriggerNote(int slot, int noteNumber);
+    int getTriggerNote(int slot) const;
+    int getSlotForNote(int noteNumber) const { return noteToSlot[(size_t) (noteNumber & 127)].load(); } // -1 if none
+
+    // Message thread.
+    void setSlotSettings(int slot, const SlotSettings& settings);
+    SlotSettings getSlotSettings(int slot) const;
+
+    // Any thread. The content takes over at the start of the next block, ending the slot's run.
+    void publish(int slot, std::unique_ptr<SlotContent> content);
+
+    // Any thread. Moves on every change made by the calls above.
+    uint32_t getVersion() const { return version.load(); }
+
+    // Audio thread. Starts slots from the note-ons in `input` and adds this block's slot
+    // events to `out`, following the transport like scheduled pattern playback does. Note-ons
+    // are moved by up to maxJitterSamples, from a jitter stream keyed by `seed`.
+    void process(const TransportScheduler::Block& transport,
+                 const juce::MidiBuffer& input,
+                 uint32_t seed,
+                 int maxJitterSamples,
+                 juce::MidiBuffer& out);
+
+    // Audio thread. Number of slots playing after the last process().
+    int getNumActive() const { return numActive; }
+
+private:
+    struct Slot
+    {
+        SlotContentHandoff content;
+        std::atomic<int> channel { 0 };
+        std::atomic<int> transpose { 0 };
+
+        // Audio thread: the current run, with the settings it was triggered with.
+        double startPpq = 0.0;
+        int playChannel = 1;
+        int playTranspose = 0;
+        int renderedUntil = 0; // sample of this block the run has been played up to
+        ActiveNoteTable notes;
+    };
+
+    // Starts (or restarts) the slot's run at samplePos; a running one is cut there.
+    void start(int slot, int channel, int samplePos, const TransportScheduler::Block& transport, uint32_t seed, int maxJitterSamples, juce::MidiBuffer& out);
+    void deactivate(int slot);
+
+    // Plays the slot's run over samples [renderedUntil, toSample) of the block.
+    void render(int slot, const TransportScheduler::Block& transport, int toSample, uint32_t seed, int maxJitterSamples, juce::MidiBuffer& out);
+    void renderRange(Slot& s, const SlotContent& content, const EmissionRange& range, const CounterRng& jitter, int maxJitterSamples, juce::MidiBuffer& out);
+
+    std::array<Slot, kMaxSlots> slots;
+    std::atomic<int> numSlots { kDefaultNumSlots };
+    std::array<std::atomic<int>, 128> noteToSlot; // -1: no slot
+    std::atomic<bool> contentPending { false };
+    std::atomic<uint32_t> version { 0 };
+
+    // Audio thread: indices of the slots that are playing.
+    std::array<uint8_t, kMaxSlots> activeSlots {};
+    std::array<int, kMaxSlots> activeIndexOf {}; // position in activeSlots, or -1
+    int numActive = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(SamplerBank)
+};
+} // namespace mfpr
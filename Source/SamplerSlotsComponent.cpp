@@ -1,52 +1,185 @@
 #include "SamplerSlotsComponent.h"
-#include "PluginProcessor.h"
 
 namespace mfpr
 {
 SamplerSlotsComponent::SamplerSlotsComponent(MelodyForgeProAudioProcessor& p) : processor(p)
 {
     // Mouse move events are received automatically when mouseMove() is overridden
+    update();
+}
+
+static bool isMidiFile(const juce::File& f)
+{
+    return f.hasFileExtension("mid;midi");
 }
 
 bool SamplerSlotsComponent::isInterestedInFileDrag(const juce::StringArray& files)
 {
-    for (const auto& f : files)
-        if (f.endsWithIgnoreCase(".mid") || f.endsWithIgnoreCase(".midi"))
+    for (const auto& path : files)
+    {
+        const juce::File f(path);
+        if (isMidiFile(f) || f.isDirectory())
             return true;
+    }
     return false;
 }
 
 void SamplerSlotsComponent::filesDropped(const juce::StringArray& files, int x, int y)
 {
-    if (files.isEmpty())
-        return;
-
     const auto slot = hoveredSlot >= 0 ? hoveredSlot : slotAt(x, y);
     if (slot < 0)
         return;
 
-    const juce::File file(files[0]);
-    processor.importMidiToSamplerSlot(slot, file);
-    repaint();
+    // Files fill consecutive slots in the order dropped; a folder adds its MIDI files by name.
+    juce::Array<juce::File> midiFiles;
+    for (const auto& path : files)
+    {
+        const juce::File f(path);
+        if (f.isDirectory())
+        {
+            auto children = f.findChildFiles(juce::File::findFiles, false, "*.mid;*.midi");
+            children.sort();
+            midiFiles.addArray(children);
+        }
+        else if (isMidiFile(f))
+        {
+            midiFiles.add(f);
+        }
+    }
+
+    processor.importMidiToSamplerSlots(slot, midiFiles);
+}
+
+bool SamplerSlotsComponent::update()
+{
+    if (processor.updateSamplerSlotsSnapshot(snapshot))
+    {
+        loading = std::any_of(snapshot.slots.begin(), snapshot.slots.end(), [](const auto& info) { return info.loadProgress >= 0.0f; });
+        repaint();
+        return true;
+    }
+
+    // Imports move their progress bars without moving the version.
+    if (!loading)
+        return false;
+
+    bool repainted = false;
+    for (int i = 0; i < getNumSlots(); ++i)
+    {
+        auto& info = snapshot.slots[(size_t) i];
+        if (info.loadProgress < 0.0f)
+            continue;
+
+        const auto progress = processor.getSamplerSlotLoadProgress(i);
+        if (progress != info.loadProgress)
+        {
+            info.loadProgress = progress;
+            repaint(getSlotBounds(i));
+            repainted = true;
+        }
+    }
+    return repainted;
+}
+
+int SamplerSlotsComponent::getNumSlots() const
+{
+    return (int) snapshot.slots.size();
+}
+
+int SamplerSlotsComponent::getNumColumns() const
+{
+    // The default four slots are a 2x2 grid; bigger banks get roughly square cells.
+    if (getNumSlots() <= 4)
+        return 2;
+
+    const auto area = getSlotArea();
+    const auto aspect = double(juce::jmax(1, area.getWidth())) / double(juce::jmax(1, area.getHeight()));
+    return juce::jlimit(2, 16, (int) std::ceil(std::sqrt(double(getNumSlots()) * aspect)));
 }
 
 int SamplerSlotsComponent::slotAt(int x, int y) const
 {
-    for (int i = 0; i < 4; ++i)
-        if (getSlotBounds(i).contains(x, y))
-            return i;
-    return -1;
+    const auto area = getSlotArea();
+    if (!area.contains(x, y))
+        return -1;
+
+    const int cols = getNumColumns();
+    const int rows = (getNumSlots() + cols - 1) / cols;
+    const int col = (x - area.getX()) * cols / juce::jmax(1, area.getWidth());
+    const int row = (y - area.getY()) * rows / juce::jmax(1, area.getHeight());
+    const int slot = row * cols + col;
+    return slot < getNumSlots() && getSlotBounds(slot).contains(x, y) ? slot : -1;
 }
 
-juce::Rectangle<int> SamplerSlotsComponent::getSlotBounds(int slot) const
+juce::Rectangle<int> SamplerSlotsComponent::getSlotArea() const
 {
     auto r = getLocalBounds().reduced(6);
-    const int w = r.getWidth() / 2;
-    const int h = r.getHeight() / 2;
+    r.removeFromTop(22); // title
+    return r;
+}
+
+juce::Rectangle<int> SamplerSlotsComponent::getSlotBounds(int slot) const
+{
+    const auto r = getSlotArea();
+    const int cols = getNumColumns();
+    const int rows = juce::jmax(1, (getNumSlots() + cols - 1) / cols);
+
+    const int col = slot % cols;
+    const int row = slot / cols;
+    const int x0 = r.getX() + col * r.getWidth() / cols;
+    const int x1 = r.getX() + (col + 1) * r.getWidth() / cols;
+    const int y0 = r.getY() + row * r.getHeight() / rows;
+    const int y1 = r.getY() + (row + 1) * r.getHeight() / rows;
+    return juce::Rectangle<int>(x0, y0, x1 - x0, y1 - y0).reduced(cols > 4 ? 1 : 4);
+}
+
+void SamplerSlotsComponent::mouseDown(const juce::MouseEvent& e)
+{
+    if (e.mods.isPopupMenu())
+        showSlotMenu(slotAt(e.x, e.y));
+}
+
+void SamplerSlotsComponent::showSlotMenu(int slot)
+{
+    auto& bank = processor.getSamplerBank();
+
+    juce::PopupMenu m;
+    if (slot >= 0)
+    {
+        const auto settings = bank.getSlotSettings(slot);
+
+        juce::PopupMenu channels;
+        channels.addItem(100, "Trigger Note's Channel", true, settings.channel == 0);
+        for (int ch = 1; ch <= 16; ++ch)
+            channels.addItem(100 + ch, juce::String::formatted("Channel %d", ch), true, settings.channel == ch);
+
+        juce::PopupMenu transpose;
+        for (const int semitones : { -24, -12, -7, -5, 0, 5, 7, 12, 24 })
+            transpose.addItem(200 + semitones, semitones == 0 ? juce::String("No Transpose") : juce::String::formatted("%+d semitones", semitones), true, settings.transpose == semitones);
+
+        m.addSectionHeader(juce::String::formatted("Slot %d", slot + 1));
+        m.addSubMenu("Channel", channels, true);
+        m.addSubMenu("Transpose", transpose, true);
+        m.addSeparator();
+    }
+
+    juce::PopupMenu sizes;
+    for (const int n : { 4, 8, 16, 32, 64, 128 })
+        sizes.addItem(300 + n, juce::String::formatted("%d Slots", n), true, bank.getNumSlots() == n);
+    m.addSubMenu("Bank Size", sizes, true);
 
-    const int col = slot % 2;
-    const int row = slot / 2;
-    return juce::Rectangle<int>(r.getX() + col * w, r.getY() + row * h, w, h).reduced(4);
+    m.showMenuAsync(juce::PopupMenu::Options(), [this, slot](int result)
+    {
+        auto& b = processor.getSamplerBank();
+        if (result >= 100 && result <= 116)
+            b.setSlotSettings(slot, { result - 100, b.getSlotSettings(slot).transpose });
+        else if (result >= 176 && result <= 224)
+            b.setSlotSettings(slot, { b.getSlotSettings(slot).channel, result - 200 });
+        else if (result > 300)
+            b.setNumSlots(result - 300);
+        hoveredSlot = -1;
+        repaint();
+    });
 }
 
 void SamplerSlotsComponent::mouseMove(const juce::MouseEvent& e)
@@ -75,9 +208,10 @@ void SamplerSlotsComponent::paint(juce::Graphics& g)
 
     g.setFont(juce::Font(14.0f, juce::Font::bold));
     g.setColour(juce::Colours::white.withAlpha(0.85f));
-    g.drawText("Sampler Slots (Drop .mid) — Notes 60-63", getLocalBounds().reduced(10).removeFromTop(20), juce::Justification::left);
+    g.drawText("Sampler Slots (Drop .mid files or a folder) — right-click for options", getLocalBounds().reduced(10).removeFromTop(20), juce::Justification::left);
 
-    for (int i = 0; i < 4; ++i)
+    const bool compact = getNumColumns() > 4;
+    for (int i = 0; i < getNumSlots(); ++i)
     {
         auto r = getSlotBounds(i);
         const bool hot = (i == hoveredSlot);
@@ -88,14 +222,36 @@ void SamplerSlotsComponent::paint(juce::Graphics& g)
         g.setColour(hot ? kAccent.withAlpha(0.75f) : juce::Colours::white.withAlpha(0.18f));
         g.drawRoundedRectangle(r.toFloat(), 6.0f, 1.0f);
 
-        const auto info = processor.getSamplerSlotInfo(i);
+        const auto& info = snapshot.slots[(size_t) i];
+        const int note = info.triggerNote;
+
+        // Small cells only show the trigger note, lit when the slot holds a phrase.
+        if (compact)
+        {
+            g.setColour(info.loadProgress >= 0.0f ? kAccent.withAlpha(0.5f) : juce::Colours::white.withAlpha(info.hasPhrase ? 0.85f : 0.3f));
+            g.setFont(juce::Font(10.0f));
+            g.drawText(note >= 0 ? juce::String(note) : juce::String("-"), r, juce::Justification::centred);
+            continue;
+        }
+
         g.setColour(juce::Colours::white.withAlpha(0.85f));
         g.setFont(juce::Font(13.0f, juce::Font::bold));
-        g.drawText(juce::String::formatted("Slot %d (Note %d)", i + 1, 60 + i), r.removeFromTop(18), juce::Justification::centredLeft);
+        g.drawText(note >= 0 ? juce::String::formatted("Slot %d (Note %d)", i + 1, note) : juce::String::formatted("Slot %d", i + 1),
+                   r.removeFromTop(18),
+                   juce::Justification::centredLeft);
+
+        if (info.loadProgress >= 0.0f)
+        {
+            auto bar = r.removeFromBottom(6).reduced(2, 0).toFloat();
+            g.setColour(juce::Colours::white.withAlpha(0.12f));
+            g.fillRoundedRectangle(bar, 3.0f);
+            g.setColour(kAccent.withAlpha(0.85f));
+            g.fillRoundedRectangle(bar.withWidth(bar.getWidth() * info.loadProgress), 3.0f);
+        }
 
         g.setColour(juce::Colours::white.withAlpha(0.65f));
         g.setFont(juce::Font(12.0f));
-        g.drawFittedText(info.label, r.reduced(2), juce::Justification::centredLeft, 2);
+        g.drawFittedText(info.loadProgress >= 0.0f ? juce::String("Loading...") : info.label, r.reduced(2), juce::Justification::centredLeft, 2);
 
         if (info.matchScore > 0.0)
         {
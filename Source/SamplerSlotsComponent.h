@@ -2,30 +2,42 @@
 
 #include "JuceIncludes.h"
 #include "MFPRConstants.h"
+#include "PluginProcessor.h"
 
 namespace mfpr
 {
-class MelodyForgeProAudioProcessor;
-
 class SamplerSlotsComponent final : public juce::Component, public juce::FileDragAndDropTarget
 {
 public:
     explicit SamplerSlotsComponent(MelodyForgeProAudioProcessor& processor);
 
+    // Once per display frame: picks up a new snapshot of the slots if they have changed, and
+    // the progress of running imports. Returns whether anything was repainted.
+    bool update();
+
     void paint(juce::Graphics& g) override;
     void resized() override {}
 
     bool isInterestedInFileDrag(const juce::StringArray& files) override;
     void filesDropped(const juce::StringArray& files, int x, int y) override;
 
+    void mouseDown(const juce::MouseEvent& e) override;
     void mouseMove(const juce::MouseEvent& e) override;
     void mouseExit(const juce::MouseEvent&) override;
 
 private:
+    int getNumSlots() const;
+    int getNumColumns() const;
     int slotAt(int x, int y) const;
+    juce::Rectangle<int> getSlotArea() const;
     juce::Rectangle<int> getSlotBounds(int slot) const;
 
+    // Right-click: the slot's channel and transpose (if over a slot) and the bank size.
+    void showSlotMenu(int slot);
+
     MelodyForgeProAudioProcessor& processor;
+    MelodyForgeProAudioProcessor::SamplerSlotsSnapshot snapshot; // what paint() shows
+    bool loading = false; // some slot in the snapshot is importing
     int hoveredSlot = -1;
 };
 } // namespace mfpr
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "MFPRConstants.h"
+
+namespace mfpr
+{
+// Scale degrees per entry of kModes, as 12-bit masks relative to the key root
+// (bit n set => n semitones above the root is in the scale).
+inline constexpr std::array<uint16_t, kNumModes> kModeMasks = {
+    0b101010110101, // Major            0 2 4 5 7 9 11
+    0b010110101101, // Minor            0 2 3 5 7 8 10
+    0b011010101101, // Dorian           0 2 3 5 7 9 10
+    0b010110101011, // Phrygian         0 1 3 5 7 8 10
+    0b101011010101, // Lydian           0 2 4 6 7 9 11
+    0b011010110101, // Mixolydian       0 2 4 5 7 9 10
+    0b100110101101, // Harmonic Minor   0 2 3 5 7 8 11
+    0b101010101101, // Melodic Minor    0 2 3 5 7 9 11
+    0b001010010101, // Major Pentatonic 0 2 4 7 9
+    0b010010101001, // Minor Pentatonic 0 3 5 7 10
+};
+
+// Key x pitch class x mode lookup, built at compile time.
+struct ScaleTable
+{
+    // Absolute pitch classes in the scale, one 12-bit mask per (mode, key).
+    std::array<std::array<uint16_t, 12>, kNumModes> inScale {};
+
+    // Offset to the nearest in-scale pitch for each (mode, key, pitch class), searching
+    // 0, +1, -1, +2, -2 in that order; 0 if nothing is within a whole tone.
+    std::array<std::array<std::array<int8_t, 12>, 12>, kNumModes> snapOffset {};
+};
+
+constexpr ScaleTable makeScaleTable()
+{
+    ScaleTable t;
+    for (int mode = 0; mode < kNumModes; ++mode)
+    {
+        for (int key = 0; key < 12; ++key)
+        {
+            uint16_t mask = 0;
+            for (int degree = 0; degree < 12; ++degree)
+                if ((kModeMasks[(size_t) mode] >> degree) & 1)
+                    mask = uint16_t(mask | (1u << ((degree + key) % 12)));
+            t.inScale[(size_t) mode][(size_t) key] = mask;
+
+            for (int pc = 0; pc < 12; ++pc)
+            {
+                constexpr int searchOrder[] = { 0, 1, -1, 2, -2 };
+                int8_t offset = 0;
+                for (const int delta : searchOrder)
+                {
+                    if ((mask >> ((pc + delta + 12) % 12)) & 1)
+                    {
+                        offset = int8_t(delta);
+                        break;
+                    }
+                }
+                t.snapOffset[(size_t) mode][(size_t) key][(size_t) pc] = offset;
+            }
+        }
+    }
+    return t;
+}
+
+inline constexpr ScaleTable kScaleTable = makeScaleTable();
+
+constexpr int clampModeIndex(int modeIndex)
+{
+    return (modeIndex >= 0 && modeIndex < kNumModes) ? modeIndex : 0;
+}
+
+constexpr int pitchClassOf(int midiNote)
+{
+    const int m = midiNote % 12;
+    return m < 0 ? m + 12 : m;
+}
+
+constexpr bool isPitchClassInScale(int pitchClass, int keyRoot, int modeIndex)
+{
+    return ((kScaleTable.inScale[(size_t) clampModeIndex(modeIndex)][(size_t) pitchClassOf(keyRoot)] >> pitchClassOf(pitchClass)) & 1) != 0;
+}
+
+// Moves midiNote to the nearest in-scale pitch (preferring upwards) and clamps to 0..127.
+constexpr int snapToScale(int midiNote, int keyRoot, int modeIndex)
+{
+    const int offset = kScaleTable.snapOffset[(size_t) clampModeIndex(modeIndex)][(size_t) pitchClassOf(keyRoot)][(size_t) pitchClassOf(midiNote)];
+    const int snapped = midiNote + offset;
+    return snapped < 0 ? 0 : (snapped > 127 ? 127 : snapped);
+}
+
+// True if the mode has a minor third, i.e. chords built on its root use minor intervals.
+constexpr bool isMinorMode(int modeIndex)
+{
+    return ((kModeMasks[(size_t) clampModeIndex(modeIndex)] >> 3) & 1) != 0;
+}
+
+static_assert(snapToScale(61, 0, 0) == 62, "C# snaps up to D in C major");
+static_assert(snapToScale(66, 0, 1) == 67, "F# snaps up to G in C minor");
+static_assert(isPitchClassInScale(9, 9, 1) && !isPitchClassInScale(1, 9, 1), "A minor contains A but not C#");
+static_assert(!isMinorMode(0) && isMinorMode(1) && isMinorMode(9), "mode quality");
+} // namespace mfpr
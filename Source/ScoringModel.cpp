@@ -0,0 +1,256 @@
+#include "ScoringModel.h"
+#include "ScaleTables.h"
+
+namespace mfpr
+{
+static constexpr size_t featureIndex(PatternFeature f)
+{
+    return (size_t) f;
+}
+
+static bool parseWeightTable(const juce::var& table, PatternFeatures& out)
+{
+    auto* obj = table.getDynamicObject();
+    if (obj == nullptr)
+        return false;
+
+    out.fill(0.0f);
+    for (const auto& property : obj->getProperties())
+    {
+        const auto name = property.name.toString();
+        const auto it = std::find_if(kPatternFeatureNames.begin(), kPatternFeatureNames.end(), [&](const char* n) { return name == n; });
+        if (it == kPatternFeatureNames.end() || !(property.value.isDouble() || property.value.isInt() || property.value.isInt64()))
+            return false;
+
+        out[(size_t) std::distance(kPatternFeatureNames.begin(), it)] = (float) (double) property.value;
+    }
+    return true;
+}
+
+bool ScoringModel::loadFromJson(const juce::String& json)
+{
+    juce::var root;
+    if (juce::JSON::parse(json, root).failed() || root.getDynamicObject() == nullptr)
+        return false;
+
+    std::array<PatternFeatures, kNumGenres> newWeights {};
+    std::array<bool, kNumGenres> newHasWeights {};
+
+    const auto defaultTable = root.getProperty("default", juce::var());
+    if (!defaultTable.isVoid())
+    {
+        PatternFeatures w;
+        if (!parseWeightTable(defaultTable, w))
+            return false;
+        newWeights.fill(w);
+        newHasWeights.fill(true);
+    }
+
+    const auto genres = root.getProperty("genres", juce::var());
+    if (!genres.isVoid())
+    {
+        auto* obj = genres.getDynamicObject();
+        if (obj == nullptr)
+            return false;
+
+        for (const auto& property : obj->getProperties())
+        {
+            const auto name = property.name.toString();
+            const auto it = std::find_if(kGenres.begin(), kGenres.end(), [&](const juce::String& g) { return g.equalsIgnoreCase(name); });
+            if (it == kGenres.end())
+                return false;
+
+            const auto g = (size_t) std::distance(kGenres.begin(), it);
+            if (!parseWeightTable(property.value, newWeights[g]))
+                return false;
+            newHasWeights[g] = true;
+        }
+    }
+
+    weights = newWeights;
+    hasWeights = newHasWeights;
+    return true;
+}
+
+bool ScoringModel::loadFromFile(const juce::File& file)
+{
+    return file.existsAsFile() && loadFromJson(file.loadFileAsString());
+}
+
+juce::File ScoringModel::getUserWeightsFile()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile(kCompanyName)
+        .getChildFile(kPluginName)
+        .getChildFile("ScoringWeights.json");
+}
+
+void ScoringModel::setWeights(int genreIndex, const PatternFeatures& w)
+{
+    const auto g = (size_t) juce::jlimit(0, kNumGenres - 1, genreIndex);
+    weights[g] = w;
+    hasWeights[g] = true;
+}
+
+void ScoringModel::clear()
+{
+    hasWeights.fill(false);
+}
+
+bool ScoringModel::hasWeightsFor(int genreIndex) const
+{
+    return hasWeights[(size_t) juce::jlimit(0, kNumGenres - 1, genreIndex)];
+}
+
+void ScoringModel::extractFeatures(const GeneratedPattern& pattern, const GenerationParams& params, PatternFeatures& f)
+{
+    f.fill(0.0f);
+    f[featureIndex(PatternFeature::bias)] = 1.0f;
+
+    const auto numNotes = (int) pattern.notes.size();
+    const auto steps = (float) juce::jmax(1, pattern.lengthSteps);
+    f[featureIndex(PatternFeature::noteCount)] = float(numNotes) / 100.0f;
+    f[featureIndex(PatternFeature::density)] = float(numNotes) / steps;
+    if (numNotes == 0)
+        return;
+
+    const bool hybrid = params.type == GeneratorType::hybrid;
+    const bool everyNoteIsMelody = params.type == GeneratorType::chord;
+    const int melodyTrack = hybrid ? 4 : 0;
+    const int keyRoot = params.keyIndex;
+    const int mode = params.modeIndex;
+
+    // Pass 1, every note: scale membership, velocities and (hybrid) the pitch classes the chord part
+    // sounds on each step, as a 12-bit mask.
+    constexpr int kMaxChordSteps = 16 * 16;
+    std::array<uint16_t, kMaxChordSteps> chordMask {};
+
+    int inScale = 0;
+    int velocitySum = 0, minVelocity = 127, maxVelocity = 0;
+    for (const auto& n : pattern.notes)
+    {
+        inScale += isPitchClassInScale(n.getNoteNumber(), keyRoot, mode) ? 1 : 0;
+        velocitySum += n.getVelocity();
+        minVelocity = juce::jmin(minVelocity, n.getVelocity());
+        maxVelocity = juce::jmax(maxVelocity, n.getVelocity());
+
+        if (hybrid && n.getTrack() != melodyTrack)
+        {
+            const auto bit = uint16_t(1u << pitchClassOf(n.getNoteNumber()));
+            for (int s = n.getStartStep(), end = juce::jmin(kMaxChordSteps, n.getEndStep()); s < end; ++s)
+                chordMask[(size_t) s] = uint16_t(chordMask[(size_t) s] | bit);
+        }
+    }
+
+    // Pass 2, melody notes in pattern order (same intervals as MelodyGenerator::score()).
+    std::array<int, 12> degrees {};
+    std::array<int, 6> leaps {};
+    int melodyNotes = 0, intervals = 0, stacked = 0, leapExcess = 0;
+    int offBeat = 0, odd16ths = 0, chordTones = 0, lengthSum = 0;
+    int lowest = 127, highest = 0;
+    int lastNote = -1, lastStep = -1;
+
+    for (const auto& n : pattern.notes)
+    {
+        if (!everyNoteIsMelody && n.getTrack() != melodyTrack)
+            continue;
+
+        const int note = n.getNoteNumber();
+        const int step = n.getStartStep();
+        ++melodyNotes;
+        ++degrees[(size_t) pitchClassOf(note - keyRoot)];
+        offBeat += (step & 3) != 0 ? 1 : 0;
+        odd16ths += step & 1;
+        lengthSum += n.getLengthSteps();
+        lowest = juce::jmin(lowest, note);
+        highest = juce::jmax(highest, note);
+        if (hybrid && step < kMaxChordSteps)
+            chordTones += (chordMask[(size_t) step] >> pitchClassOf(note)) & 1;
+
+        if (lastNote >= 0)
+        {
+            if (step == lastStep)
+            {
+                ++stacked;
+            }
+            else
+            {
+                const int interval = std::abs(note - lastNote);
+                const int bucket = interval == 0 ? 0 : interval <= 2 ? 1 : interval <= 4 ? 2 : interval <= 7 ? 3 : interval <= 12 ? 4 : 5;
+                ++leaps[(size_t) bucket];
+                leapExcess += juce::jmax(0, interval - 7);
+                ++intervals;
+            }
+        }
+        lastNote = note;
+        lastStep = step;
+    }
+
+    const auto perNote = 1.0f / float(numNotes);
+    f[featureIndex(PatternFeature::inScale)] = float(inScale) * perNote;
+    f[featureIndex(PatternFeature::meanVelocity)] = float(velocitySum) * perNote / 127.0f;
+    f[featureIndex(PatternFeature::velocitySpread)] = float(maxVelocity - minVelocity) / 127.0f;
+    f[featureIndex(PatternFeature::melodyDensity)] = float(melodyNotes) / steps;
+
+    if (melodyNotes == 0)
+        return;
+
+    const auto perMelodyNote = 1.0f / float(melodyNotes);
+    for (size_t d = 0; d < degrees.size(); ++d)
+        f[featureIndex(PatternFeature::degree0) + d] = float(degrees[d]) * perMelodyNote;
+
+    f[featureIndex(PatternFeature::syncopation)] = float(offBeat) * perMelodyNote;
+    f[featureIndex(PatternFeature::offbeat16ths)] = float(odd16ths) * perMelodyNote;
+    f[featureIndex(PatternFeature::chordToneAdherence)] = float(chordTones) * perMelodyNote;
+    f[featureIndex(PatternFeature::range)] = float(highest - lowest) / 24.0f;
+    f[featureIndex(PatternFeature::meanLength)] = float(lengthSum) * perMelodyNote / 16.0f;
+    f[featureIndex(PatternFeature::stackedOnsets)] = float(stacked) * perMelodyNote;
+
+    if (intervals == 0)
+        return;
+
+    const auto perInterval = 1.0f / float(intervals);
+    for (size_t b = 0; b < leaps.size(); ++b)
+        f[featureIndex(PatternFeature::leapUnison) + b] = float(leaps[b]) * perInterval;
+    f[featureIndex(PatternFeature::leapExcess)] = float(leapExcess) * perInterval / 12.0f;
+}
+
+void ScoringModel::scoreBatch(const GeneratedPattern* const* patterns, int count, const GenerationParams& params, double* scoresOut) const
+{
+    jassert(hasWeightsFor(params.genreIndex));
+    const auto& w = weights[(size_t) juce::jlimit(0, kNumGenres - 1, params.genreIndex)];
+
+    // Features are stored feature-major, so the weighting below runs over contiguous
+    // lanes with no horizontal sums and vectorises without reassociating anything.
+    constexpr int kChunk = 16;
+    std::array<std::array<float, kChunk>, kNumPatternFeatures> columns {};
+    PatternFeatures f;
+
+    for (int base = 0; base < count; base += kChunk)
+    {
+        const int n = juce::jmin(kChunk, count - base);
+        for (int i = 0; i < n; ++i)
+        {
+            extractFeatures(*patterns[base + i], params, f);
+            for (size_t k = 0; k < f.size(); ++k)
+                columns[k][(size_t) i] = f[k];
+        }
+
+        std::array<float, kChunk> sums {};
+        for (size_t k = 0; k < columns.size(); ++k)
+            for (size_t i = 0; i < kChunk; ++i)
+                sums[i] += columns[k][i] * w[k];
+
+        for (int i = 0; i < n; ++i)
+            scoresOut[base + i] = sums[(size_t) i];
+    }
+}
+
+double ScoringModel::score(const GeneratedPattern& pattern, const GenerationParams& params) const
+{
+    const GeneratedPattern* p = &pattern;
+    double s = 0.0;
+    scoreBatch(&p, 1, params, &s);
+    return s;
+}
+} // namespace mfpr
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "MFPRConstants.h"
+#include "MelodyGenerator.h"
+
+namespace mfpr
+{
+// Fixed-length description of a pattern. "Melody" means the notes MelodyGenerator::score()
+// looks at: track 4 for hybrid, track 0 for melody, every note for chord patterns.
+enum class PatternFeature
+{
+    bias = 0,           // always 1
+    noteCount,          // notes / 100
+    density,            // notes per step
+    melodyDensity,      // melody notes per step
+    leapUnison,         // leap histogram: fraction of melody intervals of 0 semitones
+    leapStep,           // 1-2
+    leapThird,          // 3-4
+    leapFifth,          // 5-7
+    leapOctave,         // 8-12
+    leapWide,           // > 12
+    degree0,            // pitch-class histogram of the melody relative to the key root
+    degree1,
+    degree2,
+    degree3,
+    degree4,
+    degree5,
+    degree6,
+    degree7,
+    degree8,
+    degree9,
+    degree10,
+    degree11,
+    inScale,            // fraction of all notes in the key/mode
+    syncopation,        // fraction of melody onsets off the beat
+    offbeat16ths,       // fraction of melody onsets on odd 16ths
+    chordToneAdherence, // fraction of melody notes whose pitch class sounds in the chord part
+    range,              // melody range in semitones / 24
+    meanVelocity,       // / 127
+    velocitySpread,     // (max - min) / 127
+    meanLength,         // melody note length in steps / 16
+    stackedOnsets,      // fraction of melody notes starting on the same step as the previous one
+    leapExcess,         // sum of max(0, |interval| - 7) / 12 per melody interval
+
+    count
+};
+
+inline constexpr int kNumPatternFeatures = (int) PatternFeature::count;
+
+// JSON keys for the weights file, in PatternFeature order.
+inline constexpr std::array<const char*, kNumPatternFeatures> kPatternFeatureNames = {
+    "bias", "noteCount", "density", "melodyDensity",
+    "leapUnison", "leapStep", "leapThird", "leapFifth", "leapOctave", "leapWide",
+    "degree0", "degree1", "degree2", "degree3", "degree4", "degree5",
+    "degree6", "degree7", "degree8", "degree9", "degree10", "degree11",
+    "inScale", "syncopation", "offbeat16ths", "chordToneAdherence", "range",
+    "meanVelocity", "velocitySpread", "meanLength", "stackedOnsets", "leapExcess",
+};
+
+using PatternFeatures = std::array<float, kNumPatternFeatures>;
+
+// Linear scoring model: score = dot(features, weights[genre]). Genres without weights
+// (and no "default" table) are left to MelodyGenerator::score().
+//
+// Weights file:
+//   {
+//     "default": { "density": -1.5, "leapExcess": -0.4, ... },
+//     "genres": { "Trap": { "syncopation": 0.8, ... }, "Lo-Fi": { ... } }
+//   }
+// Genres are matched by their kGenres name; missing features weigh 0.
+class ScoringModel final
+{
+public:
+    // Replaces all weights. Returns false (and keeps the previous weights) on malformed
+    // JSON, unknown genre names or unknown feature names.
+    bool loadFromJson(const juce::String& json);
+    bool loadFromFile(const juce::File& file);
+
+    // <user app data>/xAI Music Tools/MelodyForgePro/ScoringWeights.json
+    static juce::File getUserWeightsFile();
+
+    void setWeights(int genreIndex, const PatternFeatures& weights);
+    void clear();
+
+    bool hasWeightsFor(int genreIndex) const;
+
+    static void extractFeatures(const GeneratedPattern& pattern, const GenerationParams& params, PatternFeatures& out);
+
+    // Scores every pattern with the genre's weights (hasWeightsFor(params.genreIndex) must
+    // be true). Features are extracted into a small stack buffer and combined with the
+    // weights in one contiguous multiply-add loop per chunk, so the call does not allocate
+    // and may run concurrently on different ranges.
+    void scoreBatch(const GeneratedPattern* const* patterns, int count, const GenerationParams& params, double* scoresOut) const;
+
+    double score(const GeneratedPattern& pattern, const GenerationParams& params) const;
+
+private:
+    std::array<PatternFeatures, kNumGenres> weights {};
+    std::array<bool, kNumGenres> hasWeights {};
+};
+} // namespace mfpr
@@ -0,0 +1,234 @@
+#include "SlotLoader.h"
+#include "AssetLibrary.h"
+#include <cstring>
+
+namespace mfpr
+{
+std::unique_ptr<SlotContent> importMidiFile(const juce::File& file, const AssetLibrary& library, const std::function<void(float)>& onProgress)
+{
+    auto report = [&onProgress](float p)
+    {
+        if (onProgress)
+            onProgress(p);
+    };
+
+    report(0.0f);
+    if (!file.existsAsFile())
+        return nullptr;
+
+    juce::FileInputStream in(file);
+    if (!in.openedOk())
+        return nullptr;
+
+    juce::MidiFile midi;
+    if (!midi.readFrom(in))
+        return nullptr;
+
+    if (midi.getNumTracks() <= 0)
+        return nullptr;
+
+    auto* tr = midi.getTrack(0);
+    if (tr == nullptr)
+        return nullptr;
+    report(0.4f);
+
+    juce::MidiMessageSequence seq(*tr);
+    seq.updateMatchedPairs();
+    report(0.5f);
+
+    auto match = library.matchMidiToLibrary(seq);
+    report(0.8f);
+
+    // Convert sequence -> GeneratedPattern (16th-quantised)
+    auto content = std::make_unique<SlotContent>();
+    auto& pat = content->pattern;
+    pat.notes.reserve(256);
+    const int tpq = midi.getTimeFormat() > 0 ? midi.getTimeFormat() : 960;
+    const double stepTicks = double(tpq) / 4.0;
+    double maxEndTick = 0.0;
+
+    for (int i = 0; i < seq.getNumEvents(); ++i)
+    {
+        auto* e = seq.getEventPointer(i);
+        if (e == nullptr)
+            continue;
+        const auto& m = e->message;
+        if (!m.isNoteOn())
+            continue;
+        if (auto* off = e->noteOffObject)
+        {
+            const auto startTick = m.getTimeStamp();
+            const auto endTick = off->message.getTimeStamp();
+            const int startStep = int(std::llround(startTick / stepTicks));
+            const int lenSteps = juce::jmax(1, int(std::llround((endTick - startTick) / stepTicks)));
+            pat.notes.emplace_back(m.getNoteNumber(), startStep, lenSteps, (int) m.getVelocity(), 1, 0);
+            maxEndTick = std::max(maxEndTick, endTick);
+        }
+    }
+
+    const int maxStep = int(std::ceil(maxEndTick / stepTicks));
+    pat.lengthSteps = juce::jmax(16, ((maxStep + 15) / 16) * 16);
+    pat.numTracks = 1;
+    content->schedule = PatternSchedule(pat);
+
+    content->label = file.getFileName();
+    content->matchScore = match.matched ? match.score : 0.0;
+    if (match.matched)
+    {
+        content->label = match.isChord ? juce::String::formatted("Matched Chords %03d", match.index)
+                                       : juce::String::formatted("Matched Melody %03d", match.index);
+    }
+
+    report(1.0f);
+    return content;
+}
+
+static uint64_t packProgress(uint32_t requestId, float p)
+{
+    uint32_t bits = 0;
+    std::memcpy(&bits, &p, sizeof(bits));
+    return (uint64_t(requestId) << 32) | bits;
+}
+
+class SlotLoader::Worker final : public juce::Thread
+{
+public:
+    Worker(SlotLoader& l, int index)
+        : juce::Thread(juce::String::formatted("MFPR slot loader %d", index))
+        , loader(l)
+    {
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+            if (!loader.importNext())
+                wait(-1);
+    }
+
+private:
+    SlotLoader& loader;
+};
+
+SlotLoader::SlotLoader(const AssetLibrary& lib, LoadedCallback callback)
+    : SlotLoader(lib, std::move(callback), juce::jlimit(1, 4, juce::SystemStats::getNumCpus() - 1))
+{
+}
+
+SlotLoader::SlotLoader(const AssetLibrary& lib, LoadedCallback callback, int numThreads)
+    : library(lib)
+    , onLoaded(std::move(callback))
+{
+    const int n = juce::jlimit(1, 16, numThreads);
+    workers.reserve((size_t) n);
+    for (int i = 0; i < n; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>(*this, i + 1));
+        workers.back()->startThread();
+    }
+}
+
+SlotLoader::~SlotLoader()
+{
+    for (auto& w : workers)
+    {
+        w->signalThreadShouldExit();
+        w->notify();
+    }
+
+    for (auto& w : workers)
+        w->stopThread(5000);
+}
+
+void SlotLoader::enqueue(int slot, const juce::File& file)
+{
+    // Caller holds queueLock.
+    queue.erase(std::remove_if(queue.begin(), queue.end(), [slot](const Request& r) { return r.slot == slot; }), queue.end());
+
+    const auto id = nextRequestId++;
+    progress[(size_t) slot].store(packProgress(id, 0.0f));
+    latestRequest[(size_t) slot].store(id);
+    queue.push_back({ slot, file, id });
+    ++version;
+}
+
+void SlotLoader::wakeWorkers()
+{
+    for (auto& w : workers)
+        w->notify();
+}
+
+void SlotLoader::load(int slot, const juce::File& file)
+{
+    if (!juce::isPositiveAndBelow(slot, kMaxSlots))
+        return;
+
+    {
+        const juce::ScopedLock sl(queueLock);
+        enqueue(slot, file);
+    }
+    wakeWorkers();
+}
+
+void SlotLoader::load(int firstSlot, const juce::Array<juce::File>& files)
+{
+    if (!juce::isPositiveAndBelow(firstSlot, kMaxSlots))
+        return;
+
+    {
+        const juce::ScopedLock sl(queueLock);
+        const int count = juce::jmin(files.size(), kMaxSlots - firstSlot);
+        for (int i = 0; i < count; ++i)
+            enqueue(firstSlot + i, files.getReference(i));
+    }
+    wakeWorkers();
+}
+
+float SlotLoader::getProgress(int slot) const
+{
+    if (!juce::isPositiveAndBelow(slot, kMaxSlots) || latestRequest[(size_t) slot].load() == 0)
+        return -1.0f;
+
+    const auto bits = uint32_t(progress[(size_t) slot].load());
+    float p = 0.0f;
+    std::memcpy(&p, &bits, sizeof(p));
+    return p;
+}
+
+bool SlotLoader::importNext()
+{
+    Request request;
+    {
+        const juce::ScopedLock sl(queueLock);
+        if (queue.empty())
+            return false;
+
+        request = queue.front();
+        queue.pop_front();
+    }
+
+    // Progress is stored only while this is still the slot's latest request.
+    auto& slotProgress = progress[(size_t) request.slot];
+    const auto report = [&slotProgress, id = request.id](float p)
+    {
+        auto current = slotProgress.load();
+        while (uint32_t(current >> 32) == id && !slotProgress.compare_exchange_weak(current, packProgress(id, p)))
+        {
+        }
+    };
+    auto content = importMidiFile(request.file, library, report);
+
+    // Only the slot's latest request is published; a superseded one is waiting in the queue
+    // or being imported by another thread. Claiming and publishing under one lock keeps an
+    // import superseded meanwhile from publishing after the newer one.
+    const juce::ScopedLock sl(publishLock);
+    auto id = request.id;
+    if (latestRequest[(size_t) request.slot].compare_exchange_strong(id, 0))
+    {
+        if (content != nullptr)
+            onLoaded(request.slot, std::move(content));
+        ++version;
+    }
+    return true;
+}
+} // namespace mfpr
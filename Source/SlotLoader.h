@@ -0,0 +1,94 @@
+#pragma once
+
+#include "JuceIncludes.h"
+#include "MelodyGenerator.h"
+#include "PatternSchedule.h"
+#include "RealtimeHandoff.h"
+#include <deque>
+
+namespace mfpr
+{
+class AssetLibrary;
+
+// A sampler slot's imported pattern, with what the slot UI shows for it.
+struct SlotContent
+{
+    GeneratedPattern pattern;
+    PatternSchedule schedule; // `pattern` compiled for playback
+    juce::String label;
+    double matchScore = 0.0; // 0..1, 0 when no library template matched
+};
+
+// Reads the first track of a MIDI file into slot content (quantised to 16ths) and matches
+// it against the library. Reports its progress (0..1) to `onProgress`, if given. Returns
+// null if the file cannot be read or has no tracks.
+std::unique_ptr<SlotContent> importMidiFile(const juce::File& file, const AssetLibrary& library, const std::function<void(float)>& onProgress = {});
+
+// Passes slot content from loader threads to the audio thread.
+using SlotContentHandoff = RealtimeHandoff<SlotContent>;
+
+// Imports dropped MIDI files on background threads so large files and big batches never
+// stall the message thread. Queued files are parsed and matched in parallel, in the order
+// they were queued, and each is handed to `onLoaded` (on its loader thread) as soon as it
+// is done. A newer request for a slot replaces an older one that has not finished.
+//
+// The loader has threads of its own rather than using the shared WorkerPool, which the
+// generation thread relies on and must not find busy with file reads.
+class SlotLoader final
+{
+public:
+    static constexpr int kMaxSlots = 128;
+
+    using LoadedCallback = std::function<void(int slot, std::unique_ptr<SlotContent> content)>;
+
+    SlotLoader(const AssetLibrary& library, LoadedCallback onLoaded);
+    SlotLoader(const AssetLibrary& library, LoadedCallback onLoaded, int numThreads);
+    ~SlotLoader();
+
+    // Message thread.
+    void load(int slot, const juce::File& file);
+
+    // Message thread. Queues files[i] for slot firstSlot + i; files past the last slot are ignored.
+    void load(int firstSlot, const juce::Array<juce::File>& files);
+
+    // Progress (0..1) of the slot's queued or running import, or -1 if there is none.
+    float getProgress(int slot) const;
+
+    // Moves whenever an import is queued or finishes (not as it progresses).
+    uint32_t getVersion() const { return version.load(); }
+
+private:
+    struct Request
+    {
+        int slot = 0;
+        juce::File file;
+        uint32_t id = 0;
+    };
+
+    class Worker;
+
+    void enqueue(int slot, const juce::File& file);
+    void wakeWorkers();
+
+    // Loader threads. Imports the oldest queued file; false if the queue was empty.
+    bool importNext();
+
+    const AssetLibrary& library;
+    LoadedCallback onLoaded;
+
+    juce::CriticalSection queueLock;
+    std::deque<Request> queue;
+    uint32_t nextRequestId = 1;
+
+    std::array<std::atomic<uint32_t>, kMaxSlots> latestRequest {}; // 0: none pending
+    // The latest request's id (high 32 bits) and progress (float bits), so a superseded
+    // import can't report over the request that replaced it.
+    std::array<std::atomic<uint64_t>, kMaxSlots> progress {};
+    juce::CriticalSection publishLock; // a slot's imports are published in request order
+    std::atomic<uint32_t> version { 0 };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    JUCE_DECLARE_NON_COPYABLE(SlotLoader)
+};
+} // namespace mfpr
@@ -0,0 +1,114 @@
+#include "TransportScheduler.h"
+
+namespace mfpr
+{
+void ActiveNoteTable::noteOn(int channel, int noteNumber)
+{
+    auto& c = counts[indexOf(channel, noteNumber)];
+    if (c == 0)
+        ++numActive;
+    c = (uint8_t) juce::jmin(255, c + 1);
+}
+
+void ActiveNoteTable::noteOff(int channel, int noteNumber)
+{
+    // One note-off ends the note however many times it was started, as it does on a synth.
+    auto& c = counts[indexOf(channel, noteNumber)];
+    if (c > 0)
+        --numActive;
+    c = 0;
+}
+
+void ActiveNoteTable::releaseAll(juce::MidiBuffer& out, int samplePosition)
+{
+    if (numActive == 0)
+        return;
+
+    for (size_t i = 0; i < counts.size(); ++i)
+    {
+        if (counts[i] == 0)
+            continue;
+        out.addEvent(juce::MidiMessage::noteOff(int(i / 128) + 1, int(i % 128)), samplePosition);
+        counts[i] = 0;
+    }
+    numActive = 0;
+}
+
+void TransportScheduler::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate > 0.0 ? newSampleRate : 44100.0;
+    expectedPpq = 0.0;
+    lastBpm = 120.0;
+    hostPlaying = false;
+}
+
+TransportScheduler::Block TransportScheduler::advance(juce::AudioPlayHead* playHead, int numSamples)
+{
+    Block b;
+
+    juce::Optional<juce::AudioPlayHead::PositionInfo> position;
+    if (playHead != nullptr)
+        position = playHead->getPosition();
+
+    if (position.hasValue())
+        if (const auto bpm = position->getBpm(); bpm.hasValue() && *bpm > 0.0)
+            lastBpm = *bpm;
+    b.bpm = lastBpm;
+
+    const double blockPpqLength = double(numSamples) * lastBpm / (60.0 * sampleRate);
+    const auto hostPpq = position.hasValue() ? position->getPpqPosition() : juce::Optional<double> {};
+    const bool playing = position.hasValue() && position->getIsPlaying() && hostPpq.hasValue();
+
+    double startPpq = expectedPpq;
+    double endPpq = startPpq + blockPpqLength;
+
+    if (playing)
+    {
+        if (!hostPlaying)
+        {
+            // Switching from the internal clock: jump to the host, keeping earlier positions'
+            // distance to "now" the same.
+            b.relocated = true;
+            b.clockOffsetPpq = *hostPpq - expectedPpq;
+            startPpq = *hostPpq;
+        }
+        else if (std::abs(*hostPpq - expectedPpq) > kRelocateTolerancePpq)
+        {
+            b.relocated = true;
+            startPpq = *hostPpq;
+        }
+
+        // The block ends where the host says it does at this tempo; starting from the
+        // expected position spreads any drift over the block instead of skipping it.
+        endPpq = juce::jmax(startPpq + blockPpqLength * 0.5, *hostPpq + blockPpqLength);
+    }
+    else if (hostPlaying)
+    {
+        b.stopped = true;
+    }
+    hostPlaying = playing;
+
+    b.ranges[0] = { 0, numSamples, startPpq, endPpq };
+    b.numRanges = 1;
+
+    if (playing && position->getIsLooping())
+    {
+        if (const auto loop = position->getLoopPoints(); loop.hasValue() && loop->ppqEnd > loop->ppqStart)
+        {
+            if (startPpq < loop->ppqEnd && endPpq > loop->ppqEnd)
+            {
+                const int wrap = juce::jlimit(1, juce::jmax(1, numSamples - 1), b.ranges[0].sampleAt(loop->ppqEnd));
+                if (wrap < numSamples)
+                {
+                    b.ranges[0] = { 0, wrap, startPpq, loop->ppqEnd };
+                    b.ranges[1] = { wrap, numSamples, loop->ppqStart, loop->ppqStart + (endPpq - loop->ppqEnd) };
+                    b.numRanges = 2;
+                }
+            }
+        }
+    }
+
+    expectedPpq = b.endPpq();
+    return b;
+}
+} // namespace mfpr
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "JuceIncludes.h"
+
+namespace mfpr
+{
+// A stretch of a block mapped linearly onto the musical timeline: samples [fromSample,
+// toSample) play PPQ [startPpq, endPpq).
+struct EmissionRange
+{
+    int fromSample = 0;
+    int toSample = 0;
+    double startPpq = 0.0;
+    double endPpq = 0.0;
+
+    // Positions this close to a range boundary count as on it, so rounding in the running
+    // PPQ position cannot move an event on the grid to the neighbouring range or sample.
+    static constexpr double kTolerancePpq = 1.0e-9;
+
+    bool isEmpty() const { return toSample <= fromSample; }
+
+    // Ranges that share a boundary never both contain a position.
+    bool contains(double ppq) const { return ppq >= startPpq - kTolerancePpq && ppq < endPpq - kTolerancePpq; }
+
+    double ppqAt(int sample) const
+    {
+        return startPpq + (endPpq - startPpq) * double(sample - fromSample) / double(juce::jmax(1, toSample - fromSample));
+    }
+
+    // First sample at or after `ppq` (not clamped to the range).
+    int sampleAt(double ppq) const
+    {
+        return fromSample + (int) std::ceil((ppq - startPpq) / (endPpq - startPpq) * double(toSample - fromSample) - 1.0e-3);
+    }
+
+    // The part of this range inside samples [from, to), with the same mapping.
+    EmissionRange clippedTo(int from, int to) const
+    {
+        EmissionRange r;
+        r.fromSample = juce::jmax(fromSample, from);
+        r.toSample = juce::jmin(toSample, to);
+        r.startPpq = ppqAt(r.fromSample);
+        r.endPpq = r.toSample > r.fromSample ? ppqAt(r.toSample) : r.startPpq;
+        return r;
+    }
+};
+
+// Notes started by scheduled playback and not yet ended, per channel and note, so they
+// can be cut cleanly when the timeline jumps or the pattern is replaced.
+class ActiveNoteTable
+{
+public:
+    void noteOn(int channel, int noteNumber);
+    void noteOff(int channel, int noteNumber);
+
+    bool isEmpty() const { return numActive == 0; }
+
+    // Adds a note-off for every active note at samplePosition and forgets them.
+    void releaseAll(juce::MidiBuffer& out, int samplePosition);
+
+private:
+    static size_t indexOf(int channel, int noteNumber) { return (size_t) ((juce::jlimit(1, 16, channel) - 1) * 128 + (noteNumber & 127)); }
+
+    std::array<uint8_t, 16 * 128> counts {};
+    int numActive = 0;
+};
+
+// Follows the host transport from block to block and tells the processor which part of the
+// timeline each block plays. While the host is stopped (or there is no play head) time runs
+// on an internal clock, so live triggering keeps working; the internal clock carries on
+// from wherever the host stopped.
+class TransportScheduler final
+{
+public:
+    // Host positions further than this from where the previous block ended are a relocation;
+    // smaller differences (tempo changed during the previous block, rounding) are absorbed
+    // into the next block so no event is skipped or played twice.
+    static constexpr double kRelocateTolerancePpq = 0.125;
+
+    struct Block
+    {
+        std::array<EmissionRange, 2> ranges {}; // two when a host loop wraps inside the block
+        int numRanges = 1;
+
+        bool relocated = false; // the timeline jumped at sample 0: cut everything sounding
+        bool stopped = false;   // the host transport stopped at sample 0
+        double clockOffsetPpq = 0.0; // add to timeline positions kept from earlier blocks
+        double bpm = 120.0;
+
+        // Sample where a host loop jumps back (ranges[1].fromSample), or -1.
+        int loopWrapSample() const { return numRanges > 1 ? ranges[1].fromSample : -1; }
+
+        double ppqAt(int sample) const
+        {
+            return (numRanges > 1 && sample >= ranges[1].fromSample) ? ranges[1].ppqAt(sample) : ranges[0].ppqAt(sample);
+        }
+
+        double endPpq() const { return ranges[(size_t) numRanges - 1].endPpq; }
+    };
+
+    void prepare(double newSampleRate);
+
+    // Call once per block, before any events are scheduled.
+    Block advance(juce::AudioPlayHead* playHead, int numSamples);
+
+private:
+    double sampleRate = 44100.0;
+    double expectedPpq = 0.0; // where the previous block ended
+    double lastBpm = 120.0;
+    bool hostPlaying = false;
+};
+} // namespace mfpr
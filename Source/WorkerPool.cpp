@@ -0,0 +1,101 @@
+#include "WorkerPool.h"
+
+#include <thread>
+
+namespace mfpr
+{
+class WorkerPool::Worker final : public juce::Thread
+{
+public:
+    Worker(WorkerPool& p, int workerSlot)
+        : juce::Thread(juce::String::formatted("MFPR Worker %d", workerSlot))
+        , pool(p)
+        , slot(workerSlot)
+    {
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wake.wait(100);
+            pool.workerLoop(slot);
+        }
+    }
+
+    juce::WaitableEvent wake;
+
+private:
+    WorkerPool& pool;
+    const int slot;
+};
+
+WorkerPool::WorkerPool() : WorkerPool(juce::SystemStats::getNumCpus() - 1) {}
+
+WorkerPool::WorkerPool(int numWorkers)
+{
+    const int n = juce::jlimit(0, 63, numWorkers);
+    workers.reserve((size_t) n);
+    for (int i = 0; i < n; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>(*this, i + 1));
+        workers.back()->startThread();
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    for (auto& w : workers)
+    {
+        w->signalThreadShouldExit();
+        w->wake.signal();
+    }
+
+    for (auto& w : workers)
+        w->stopThread(2000);
+}
+
+void WorkerPool::drain(Job& job, int slot)
+{
+    for (int i = job.next.fetch_add(1); i < job.count; i = job.next.fetch_add(1))
+        job.invoke(job.context, i, slot);
+}
+
+void WorkerPool::workerLoop(int slot)
+{
+    // Register before looking at the job so run() cannot return while we hold it.
+    workersInJob.fetch_add(1);
+    if (auto* job = currentJob.load())
+        drain(*job, slot);
+    workersInJob.fetch_sub(1);
+}
+
+void WorkerPool::run(int count, InvokeFn invoke, void* context)
+{
+    if (count <= 0)
+        return;
+
+    Job job;
+    job.invoke = invoke;
+    job.context = context;
+    job.count = count;
+
+    if (workers.empty() || count == 1 || busy.exchange(true))
+    {
+        drain(job, 0);
+        return;
+    }
+
+    currentJob.store(&job);
+    for (auto& w : workers)
+        w->wake.signal();
+
+    drain(job, 0);
+
+    currentJob.store(nullptr);
+    while (workersInJob.load() != 0)
+        std::this_thread::yield();
+
+    busy.store(false);
+}
+} // namespace mfpr
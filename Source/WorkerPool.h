@@ -0,0 +1,62 @@
+#pragma once
+
+#include "JuceIncludes.h"
+
+namespace mfpr
+{
+// A fixed set of worker threads shared by every plugin instance in the process
+// (use via juce::SharedResourcePointer<WorkerPool>).
+//
+// parallelFor() fans an index range out across the workers and lets the calling
+// thread take part, so it never blocks on workers that are busy with another job:
+// if the pool is already running something, the caller simply does all the work.
+// Posting a job does not allocate.
+class WorkerPool final
+{
+public:
+    WorkerPool();
+    explicit WorkerPool(int numWorkers);
+    ~WorkerPool();
+
+    int getNumWorkers() const noexcept { return (int) workers.size(); }
+
+    // Upper bound (exclusive) of the worker slot passed to parallelFor callbacks.
+    int getMaxConcurrency() const noexcept { return getNumWorkers() + 1; }
+
+    // Calls fn(index, workerSlot) for every index in [0, count). workerSlot is 0 on
+    // the calling thread and 1..getNumWorkers() on workers, so callers can keep
+    // per-thread scratch without locking. Returns once every index has run.
+    template <typename Fn>
+    void parallelFor(int count, Fn&& fn)
+    {
+        using FnType = std::remove_reference_t<Fn>;
+        run(count,
+            [](void* context, int index, int slot) { (*static_cast<FnType*>(context))(index, slot); },
+            const_cast<void*>(static_cast<const void*>(std::addressof(fn))));
+    }
+
+private:
+    using InvokeFn = void (*)(void*, int, int);
+
+    struct Job
+    {
+        InvokeFn invoke = nullptr;
+        void* context = nullptr;
+        int count = 0;
+        std::atomic<int> next { 0 };
+    };
+
+    class Worker;
+
+    void run(int count, InvokeFn invoke, void* context);
+    static void drain(Job& job, int slot);
+    void workerLoop(int slot);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> busy { false };
+    std::atomic<Job*> currentJob { nullptr };
+    std::atomic<int> workersInJob { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(WorkerPool)
+};
+} // namespace mfpr
@@ -1,11 +1,55 @@
 #include <algorithm>
 #include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
 #include <unordered_set>
 
 #include "../Source/AssetLibrary.h"
+#include "../Source/BatchGenerator.h"
+#include "../Source/CandidateSearch.h"
+#include "../Source/CounterRng.h"
+#include "../Source/Harmoniser.h"
+#include "../Source/MarkovMelody.h"
 #include "../Source/MelodyGenerator.h"
 #include "../Source/MidiExporter.h"
+#include "../Source/NoteStepIndex.h"
+#include "../Source/ParticlesComponent.h"
+#include "../Source/PatternEditModel.h"
+#include "../Source/PluginEditor.h"
 #include "../Source/PluginProcessor.h"
+#include "../Source/SamplerBank.h"
+#include "../Source/ScaleTables.h"
+#include "../Source/ScoringModel.h"
+#include "../Source/SlotLoader.h"
+#include "../Source/TransportScheduler.h"
+#include "../Source/WorkerPool.h"
+
+// Global-heap allocations are counted (from any thread) while countAllocations is set.
+static std::atomic<bool> countAllocations { false };
+static std::atomic<int> allocationCount { 0 };
+
+void* operator new(std::size_t size)
+{
+    if (countAllocations.load(std::memory_order_relaxed))
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    if (auto* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
 
 namespace
 {
@@ -33,12 +77,12 @@ static std::uint64_t hashPattern(const mfpr::GeneratedPattern& p)
     mix((std::uint64_t) p.numTracks);
     for (const auto& n : p.notes)
     {
-        mix((std::uint64_t) (n.noteNumber & 0x7f));
-        mix((std::uint64_t) (n.startStep & 0xffff));
-        mix((std::uint64_t) (n.lengthSteps & 0xffff));
-        mix((std::uint64_t) (n.velocity & 0x7f));
-        mix((std::uint64_t) (n.channel & 0x0f));
-        mix((std::uint64_t) (n.track & 0x0f));
+        mix((std::uint64_t) (n.getNoteNumber() & 0x7f));
+        mix((std::uint64_t) (n.getStartStep() & 0xffff));
+        mix((std::uint64_t) (n.getLengthSteps() & 0xffff));
+        mix((std::uint64_t) (n.getVelocity() & 0x7f));
+        mix((std::uint64_t) (n.getChannel() & 0x0f));
+        mix((std::uint64_t) (n.getTrack() & 0x0f));
     }
     return h;
 }
@@ -64,8 +108,8 @@ static int runChordGenValidation()
 
     std::array<bool, 4> tracksPresent { false, false, false, false };
     for (const auto& n : pattern.notes)
-        if (n.track >= 0 && n.track < 4)
-            tracksPresent[(size_t) n.track] = true;
+        if (n.getTrack() < 4)
+            tracksPresent[(size_t) n.getTrack()] = true;
 
     require(std::all_of(tracksPresent.begin(), tracksPresent.end(), [](bool b) { return b; }),
             "Chord generation must output notes on tracks 0-3.");
@@ -176,6 +220,2274 @@ static int runRandomizationVariance()
     return 0;
 }
 
+static int runParallelCandidatesDeterministic()
+{
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+    mfpr::WorkerPool pool(3);
+
+    mfpr::GenerationParams params;
+    params.genreIndex = 5;
+    params.keyIndex = 4;
+    params.modeIndex = 1;
+    params.lengthBars = 8;
+    params.type = mfpr::GeneratorType::hybrid;
+    params.melodyFollowChordChance = 0.80f;
+
+    for (const int count : { 1, 10, 64, 256 })
+    {
+        params.seed = (uint32_t) (500 + count);
+
+        std::vector<double> scores;
+        for (int i = 0; i < count; ++i)
+        {
+            auto p = params;
+            p.seed = params.seed + (uint32_t) i;
+            scores.push_back(gen.score(gen.generate(p, 64, 100, 1, library), p));
+        }
+
+        // No early stop, stop at the first of the top three candidates, stop at the first candidate.
+        auto ranked = scores;
+        std::sort(ranked.begin(), ranked.end(), std::greater<double>());
+        const auto topThree = ranked[(size_t) juce::jmin(2, count - 1)];
+
+        for (const double threshold : { std::numeric_limits<double>::infinity(), topThree, scores[0] })
+        {
+            // Reference: the original serial loop, breaking at the first candidate reaching the threshold.
+            double bestScore = -1.0e9;
+            mfpr::GeneratedPattern expected;
+            for (int i = 0; i < count; ++i)
+            {
+                auto p = params;
+                p.seed = params.seed + (uint32_t) i;
+                auto candidate = gen.generate(p, 64, 100, 1, library);
+                const auto s = gen.score(candidate, p);
+                if (s > bestScore)
+                {
+                    bestScore = s;
+                    expected = std::move(candidate);
+                }
+                if (s >= threshold)
+                    break;
+            }
+
+            mfpr::CandidateSearchSettings settings;
+            settings.numCandidates = count;
+            settings.earlyStopScore = threshold;
+
+            mfpr::CandidateSearch search;
+            const auto serial = search.run(gen, params, 64, 100, 1, library, settings, nullptr);
+            require(hashPattern(serial) == hashPattern(expected), "Serial candidate search must match the reference loop.");
+
+            for (int repeat = 0; repeat < 4; ++repeat)
+            {
+                const auto parallel = search.run(gen, params, 64, 100, 1, library, settings, &pool);
+                require(hashPattern(parallel) == hashPattern(expected), "Parallel candidate search must match serial search.");
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int runParallelGenerationDeterministic()
+{
+    // Counter-based draws do not depend on the order they are taken in.
+    const mfpr::CounterRng rng(12345u, 2u);
+    std::vector<uint64_t> forward;
+    for (uint64_t c = 0; c < 64; ++c)
+        forward.push_back(rng.bits(c));
+    for (uint64_t c = 64; c-- > 0;)
+        require(rng.bits(c) == forward[(size_t) c], "CounterRng draws must not depend on draw order.");
+
+    for (uint64_t c = 0; c < 10000; ++c)
+    {
+        const auto u = rng.unitFloat(c);
+        const auto k = rng.between(c, -5, 6);
+        require(u >= 0.0f && u < 1.0f && k >= -5 && k <= 5, "CounterRng values must stay in range.");
+    }
+
+    // Every pattern of a grid, generated serially and then in parallel in reverse order.
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+    mfpr::WorkerPool pool(3);
+
+    std::vector<mfpr::GenerationParams> grid;
+    for (int type = 0; type < (int) mfpr::kTypes.size(); ++type)
+    {
+        for (const int bars : { 4, 16 })
+        {
+            for (uint32_t seed = 1; seed <= 40; ++seed)
+            {
+                mfpr::GenerationParams params;
+                params.genreIndex = (int) (seed % (uint32_t) mfpr::kNumGenres);
+                params.keyIndex = (int) (seed % 12u);
+                params.modeIndex = (int) (seed % (uint32_t) mfpr::kNumModes);
+                params.lengthBars = bars;
+                params.type = (mfpr::GeneratorType) type;
+                params.melodyFollowChordChance = 0.80f;
+                params.seed = seed * 7919u;
+                grid.push_back(params);
+            }
+        }
+    }
+
+    const int count = (int) grid.size();
+    std::vector<std::uint64_t> serial((size_t) count), parallel((size_t) count);
+    for (int i = 0; i < count; ++i)
+        serial[(size_t) i] = hashPattern(gen.generate(grid[(size_t) i], 60, 100, 1, library));
+
+    for (int repeat = 0; repeat < 3; ++repeat)
+    {
+        pool.parallelFor(count, [&](int job, int)
+        {
+            const int i = count - 1 - job;
+            parallel[(size_t) i] = hashPattern(gen.generate(grid[(size_t) i], 60, 100, 1, library));
+        });
+        require(parallel == serial, "Parallel generation must match serial generation.");
+    }
+
+    return 0;
+}
+
+static int runMarkovGenerator()
+{
+    // Alias sampling reproduces the row weights.
+    mfpr::AliasTable<1, 5> table;
+    const std::array<double, 5> weights = { 1.0, 0.0, 3.0, 0.5, 5.5 };
+    table.setRow(0, weights);
+
+    const mfpr::CounterRng rng(77u, 0u);
+    const int draws = 200000;
+    std::array<int, 5> histogram {};
+    for (int i = 0; i < draws; ++i)
+        ++histogram[(size_t) table.sample(0, rng.bits((uint64_t) i))];
+
+    for (size_t o = 0; o < weights.size(); ++o)
+        require(std::abs(double(histogram[o]) / draws - weights[o] / 10.0) < 0.005, "Alias sampling must follow the row weights.");
+
+    // Markov melodies stay in key, near the root and within the leap limit, like template melodies.
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+
+    std::unordered_set<std::uint64_t> unique;
+    int patterns = 0;
+    for (uint32_t seed = 1; seed <= 100; ++seed)
+    {
+        mfpr::GenerationParams params;
+        params.genreIndex = (int) (seed % (uint32_t) mfpr::kNumGenres);
+        params.keyIndex = (int) (seed % 12u);
+        params.modeIndex = (int) (seed % (uint32_t) mfpr::kNumModes);
+        params.lengthBars = 4 * (1 + (int) (seed % 4u));
+        params.type = mfpr::GeneratorType::markov;
+        params.seed = seed;
+
+        const int root = 48 + (int) (seed % 24u);
+        const int home = mfpr::snapToScale(root, params.keyIndex, params.modeIndex);
+        const auto pattern = gen.generate(params, root, 100, 1, library);
+        require(!pattern.notes.empty() && pattern.numTracks == 1, "Markov patterns must contain a single melody track.");
+        require(hashPattern(gen.generate(params, root, 100, 1, library)) == hashPattern(pattern), "Markov generation must be deterministic.");
+
+        int lastNote = -1, lastStep = -1;
+        for (const auto& n : pattern.notes)
+        {
+            require(n.getTrack() == 0 && n.getEndStep() <= pattern.lengthSteps, "Markov notes must lie inside the pattern.");
+            require(mfpr::isPitchClassInScale(n.getNoteNumber(), params.keyIndex, params.modeIndex), "Markov notes must be in key.");
+            require(std::abs(n.getNoteNumber() - home) <= 16, "Markov melodies must stay near the root.");
+            require(n.getStartStep() >= lastStep, "Markov onsets must not go backwards.");
+            if (lastNote >= 0 && n.getStartStep() != lastStep)
+                require(std::abs(n.getNoteNumber() - lastNote) <= 13, "Markov melodies must respect the leap filter.");
+
+            lastNote = n.getNoteNumber();
+            lastStep = n.getStartStep();
+        }
+
+        unique.insert(hashPattern(pattern));
+        ++patterns;
+    }
+
+    require(double(unique.size()) / patterns > 0.95, "Markov randomization variance must exceed 95%.");
+    return 0;
+}
+
+static int runLiveHarmoniser()
+{
+    // Every chord tone in the table is in key.
+    for (int mode = 0; mode < mfpr::kNumModes; ++mode)
+        for (int key = 0; key < 12; ++key)
+            for (int pc = 0; pc < 12; ++pc)
+            {
+                const auto& e = mfpr::kHarmonyTable.entries[(size_t) mode][(size_t) key][(size_t) pc];
+                const int root = pc + e.snap;
+                for (const int offset : { 0, (int) e.third, (int) e.fifth, (int) e.seventh })
+                    require(mfpr::isPitchClassInScale(root + offset, key, mode), "Harmony tones must be in key.");
+                require(0 < e.third && e.third < e.fifth && e.fifth < e.seventh, "Harmony tones must stack upwards.");
+            }
+
+    const auto noteEvents = [](const juce::MidiBuffer& buffer, bool noteOns)
+    {
+        std::vector<std::pair<int, int>> events; // (note, sample position)
+        for (const auto metadata : buffer)
+        {
+            const auto m = metadata.getMessage();
+            if (noteOns ? m.isNoteOn() : m.isNoteOff())
+                events.push_back({ m.getNoteNumber(), metadata.samplePosition });
+        }
+        std::sort(events.begin(), events.end());
+        return events;
+    };
+    using Events = std::vector<std::pair<int, int>>;
+
+    // Tech House voices triads: C4 in C major adds E4 and G4 at the note's own sample position.
+    mfpr::Harmoniser harmoniser;
+    mfpr::Harmoniser::Settings settings { 0, 0, 2 };
+    juce::MidiBuffer out;
+    harmoniser.process(juce::MidiMessage::noteOn(1, 60, (juce::uint8) 100), 17, settings, out);
+    require(noteEvents(out, true) == Events { { 64, 17 }, { 67, 17 } }, "A note-on must add its chord tones at the same sample.");
+
+    // Note-offs release what was added, even after a key change.
+    settings.keyIndex = 2;
+    out.clear();
+    harmoniser.process(juce::MidiMessage::noteOff(1, 60), 40, settings, out);
+    require(noteEvents(out, false) == Events { { 64, 40 }, { 67, 40 } }, "A note-off must release the chord tones it added.");
+
+    // Overlapping chords share G4: it starts once and ends with the last note holding it.
+    settings.keyIndex = 0;
+    out.clear();
+    harmoniser.process(juce::MidiMessage::noteOn(1, 60, (juce::uint8) 100), 0, settings, out);
+    harmoniser.process(juce::MidiMessage::noteOn(1, 64, (juce::uint8) 100), 1, settings, out);
+    require(noteEvents(out, true) == Events { { 64, 0 }, { 67, 0 }, { 71, 1 } }, "Shared chord tones must start once.");
+
+    out.clear();
+    harmoniser.process(juce::MidiMessage::noteOff(1, 60), 2, settings, out);
+    require(noteEvents(out, false) == Events { { 64, 2 } }, "Shared chord tones must outlive the first note releasing them.");
+    out.clear();
+    harmoniser.process(juce::MidiMessage::noteOff(1, 64), 3, settings, out);
+    require(noteEvents(out, false) == Events { { 67, 3 }, { 71, 3 } }, "The last note must release the remaining chord tones.");
+
+    // Enabled on the processor, incoming notes are harmonised in the same block at the same
+    // sample instead of triggering a pattern (House voices sevenths).
+    mfpr::MelodyForgeProAudioProcessor proc;
+    proc.getAPVTS().getParameter("harmonise")->setValueNotifyingHost(1.0f);
+    proc.prepareToPlay(48000.0, 512);
+
+    juce::AudioBuffer<float> audio(2, 512);
+    juce::MidiBuffer midi;
+    midi.addEvent(juce::MidiMessage::noteOn(1, 60, (juce::uint8) 100), 100);
+    proc.processBlock(audio, midi);
+    require(noteEvents(midi, true) == Events { { 60, 100 }, { 64, 100 }, { 67, 100 }, { 71, 100 } },
+            "The processor must add the harmony at the input's sample position and nothing else.");
+    return 0;
+}
+
+// Waits until the processor's generation thread has published the pattern for its latest trigger.
+static void waitForGeneratedPattern(const mfpr::MelodyForgeProAudioProcessor& proc)
+{
+    const auto deadline = juce::Time::getMillisecondCounter() + 10000;
+    while (proc.isGeneratingPattern())
+    {
+        require(juce::Time::getMillisecondCounter() < deadline, "Pattern generation must finish.");
+        juce::Thread::sleep(1);
+    }
+}
+
+static int runSampleAccurateTriggers()
+{
+    const double sampleRate = 48000.0;
+    const int blockSize = 2048;
+    const int sixteenth = 6000; // samples, at the 120 bpm used without a playhead
+
+    const auto makeProcessor = [&]()
+    {
+        // Melody type: single-note triggers give one track, chord input (hybrid) more.
+        auto proc = std::make_unique<mfpr::MelodyForgeProAudioProcessor>();
+        auto* type = proc->getAPVTS().getParameter("generator");
+        type->setValueNotifyingHost(type->convertTo0to1(1.0f));
+        proc->prepareToPlay(sampleRate, blockSize);
+        return proc;
+    };
+
+    // A trigger late in a large block starts the pattern on a 16th grid anchored at its own
+    // sample, so the (unjittered) note-offs sit on that grid rather than the block's.
+    {
+        auto proc = makeProcessor();
+        const int triggerSample = 1500;
+        juce::AudioBuffer<float> audio(2, blockSize);
+        int noteOffs = 0;
+        for (int block = 0; block < 100; ++block)
+        {
+            juce::MidiBuffer midi;
+            if (block == 0)
+                midi.addEvent(juce::MidiMessage::noteOn(1, 60, (juce::uint8) 100), triggerSample);
+            proc->processBlock(audio, midi);
+            if (block == 0)
+                waitForGeneratedPattern(*proc);
+
+            for (const auto metadata : midi)
+            {
+                if (!metadata.getMessage().isNoteOff())
+                    continue;
+                const auto offset = (juce::int64(block) * blockSize + metadata.samplePosition - triggerSample) % sixteenth;
+                require(offset <= 1 || offset >= sixteenth - 1, "Pattern events must be timed from the trigger's sample.");
+                ++noteOffs;
+            }
+        }
+        require(noteOffs > 0, "The triggered pattern must play.");
+    }
+
+    // A chord whose notes straddle a block boundary is still recognised as one.
+    {
+        auto proc = makeProcessor();
+        juce::AudioBuffer<float> audio(2, blockSize);
+        juce::MidiBuffer first;
+        first.addEvent(juce::MidiMessage::noteOn(1, 48, (juce::uint8) 100), 2040);
+        first.addEvent(juce::MidiMessage::noteOn(1, 52, (juce::uint8) 100), 2043);
+        first.addEvent(juce::MidiMessage::noteOn(1, 55, (juce::uint8) 100), 2046);
+        proc->processBlock(audio, first);
+        waitForGeneratedPattern(*proc);
+        require(proc->getCurrentPattern()->numTracks == 1, "The chord's first note must trigger at once.");
+
+        juce::MidiBuffer second;
+        second.addEvent(juce::MidiMessage::noteOn(1, 59, (juce::uint8) 100), 10);
+        proc->processBlock(audio, second);
+        waitForGeneratedPattern(*proc);
+        require(proc->getCurrentPattern()->numTracks > 1, "Completing the chord in the next block must retrigger as chord input.");
+    }
+    return 0;
+}
+
+// Play head whose position the test sets before every block.
+struct ScriptedPlayHead final : public juce::AudioPlayHead
+{
+    juce::Optional<PositionInfo> getPosition() const override { return info; }
+
+    // Moves on by one block at the current tempo, wrapping at the loop end like a host.
+    void advance(int numSamples, double sampleRate)
+    {
+        auto ppq = *info.getPpqPosition() + double(numSamples) * *info.getBpm() / (60.0 * sampleRate);
+        if (info.getIsLooping() && ppq >= info.getLoopPoints()->ppqEnd)
+            ppq -= info.getLoopPoints()->ppqEnd - info.getLoopPoints()->ppqStart;
+        info.setPpqPosition(ppq);
+    }
+
+    PositionInfo info;
+};
+
+static int runTransportScheduler()
+{
+    const double sampleRate = 48000.0;
+    const int blockSize = 2048;
+
+    ScriptedPlayHead head;
+    head.info.setIsPlaying(true);
+    head.info.setBpm(120.0);
+    head.info.setPpqPosition(0.0);
+    head.info.setLoopPoints(juce::AudioPlayHead::LoopPoints { 0.0, 4.0 });
+
+    // Continuous play, including a tempo change, gives back-to-back ranges.
+    mfpr::TransportScheduler scheduler;
+    scheduler.prepare(sampleRate);
+    double expected = 0.0;
+    for (int block = 0; block < 40; ++block)
+    {
+        if (block == 20)
+            head.info.setBpm(140.0);
+        const auto b = scheduler.advance(&head, blockSize);
+        require(b.relocated == (block == 0) && !b.stopped && b.numRanges == 1, "Only starting playback may relocate.");
+        require(std::abs(b.ranges[0].startPpq - expected) < 1.0e-9, "Blocks must continue where the last one ended.");
+        expected = b.endPpq();
+        head.advance(blockSize, sampleRate);
+    }
+
+    // A loop end inside a block splits it at the wrap; the next block carries on after it.
+    head.info.setIsLooping(true);
+    head.info.setBpm(120.0);
+    head.info.setPpqPosition(3.95);
+    scheduler.prepare(sampleRate);
+    auto b = scheduler.advance(&head, blockSize);
+    require(b.numRanges == 2 && b.ranges[0].endPpq == 4.0 && b.ranges[1].startPpq == 0.0, "A loop wrap must split the block.");
+    require(std::abs(b.loopWrapSample() - 1200) <= 1, "The wrap must land on the loop end's sample.");
+    head.advance(blockSize, sampleRate);
+    b = scheduler.advance(&head, blockSize);
+    require(!b.relocated && b.numRanges == 1 && std::abs(b.ranges[0].startPpq - *head.info.getPpqPosition()) < 1.0e-9,
+            "Play must continue after a loop wrap.");
+
+    // Jumps and stops are reported; stopped time runs on from where the host stopped.
+    head.info.setPpqPosition(2.0);
+    require(scheduler.advance(&head, blockSize).relocated, "A jump must be reported as a relocation.");
+    head.info.setIsPlaying(false);
+    b = scheduler.advance(&head, blockSize);
+    require(b.stopped && b.ranges[0].startPpq > 2.0, "A stop must be reported and keep time running.");
+
+    // Through the processor: no note is left hanging by loop wraps, relocations or a stop.
+    mfpr::MelodyForgeProAudioProcessor proc;
+    proc.setPlayHead(&head);
+    proc.prepareToPlay(sampleRate, blockSize);
+
+    head.info.setIsPlaying(true);
+    head.info.setPpqPosition(0.0);
+
+    juce::AudioBuffer<float> audio(2, blockSize);
+    std::array<int, 16 * 128> sounding {};
+    int eventsAfterStop = 0;
+    for (int block = 0; block < 160; ++block)
+    {
+        if (block == 100)
+            head.info.setPpqPosition(1.3); // relocate mid-loop
+        if (block == 140)
+            head.info.setIsPlaying(false);
+
+        juce::MidiBuffer midi;
+        if (block == 0)
+            midi.addEvent(juce::MidiMessage::noteOn(2, 60, (juce::uint8) 100), 700);
+        if (block == 1)
+            midi.addEvent(juce::MidiMessage::noteOff(2, 60), 0);
+        proc.processBlock(audio, midi);
+        if (block == 0)
+            waitForGeneratedPattern(proc);
+
+        for (const auto metadata : midi)
+        {
+            const auto m = metadata.getMessage();
+            const auto index = (size_t) ((m.getChannel() - 1) * 128 + m.getNoteNumber());
+            if (m.isNoteOn())
+                sounding[index] = 1;
+            else if (m.isNoteOff())
+                sounding[index] = 0;
+            if (block > 140)
+                ++eventsAfterStop;
+        }
+
+        if (block == 140)
+            require(std::all_of(sounding.begin(), sounding.end(), [](int n) { return n == 0; }), "Stopping must end every note.");
+        if (head.info.getIsPlaying())
+            head.advance(blockSize, sampleRate);
+    }
+    require(eventsAfterStop == 0, "A stopped transport must end the pattern until it is triggered again.");
+    proc.setPlayHead(nullptr);
+
+    // A pattern triggered mid-loop repeats, in phase, through the part of the loop before
+    // its trigger once the loop wraps. Edited to a note on every 16th (on channel 3, apart
+    // from the trigger), so every part of the loop has notes to play.
+    {
+        mfpr::GeneratedPattern everyStep;
+        everyStep.lengthSteps = 16;
+        for (int step = 0; step < 16; ++step)
+            everyStep.notes.emplace_back(60 + step % 12, step, 1, 100, 3, 0);
+
+        mfpr::MelodyForgeProAudioProcessor looped;
+        looped.setPlayHead(&head);
+        looped.prepareToPlay(sampleRate, blockSize);
+        head.info.setIsPlaying(true);
+        head.info.setPpqPosition(0.0);
+
+        const double ppqPerBlock = 2.0 * blockSize / sampleRate; // at 120 bpm
+        bool edited = false, wrapped = false;
+        int notesBeforeTrigger = 0;
+        for (int block = 0; block < 120; ++block)
+        {
+            const auto blockPpq = *head.info.getPpqPosition();
+            juce::MidiBuffer midi;
+            if (block == 23)
+                midi.addEvent(juce::MidiMessage::noteOn(1, 60, (juce::uint8) 100), 0); // at ppq ~1.96
+            if (block == 24)
+                midi.addEvent(juce::MidiMessage::noteOff(1, 60), 0);
+            looped.processBlock(audio, midi);
+            if (block == 23)
+                waitForGeneratedPattern(looped);
+            if (looped.isPatternPlaying() && !edited)
+            {
+                looped.setEditedPattern(everyStep);
+                edited = true;
+            }
+
+            for (const auto metadata : midi)
+                if (wrapped && metadata.getMessage().isNoteOn() && metadata.getMessage().getChannel() == 3 && blockPpq + ppqPerBlock < 1.9)
+                    ++notesBeforeTrigger;
+
+            head.advance(blockSize, sampleRate);
+            wrapped = wrapped || *head.info.getPpqPosition() < blockPpq;
+        }
+        require(edited && wrapped, "The pattern must start before the loop wraps.");
+        require(notesBeforeTrigger >= 8, "A repeating pattern must play before its trigger after a loop wrap.");
+        looped.setPlayHead(nullptr);
+    }
+
+    // A sampler slot triggered near the loop end plays on from the loop start after the wrap
+    // and still stops after its single pass.
+    {
+        auto content = std::make_unique<mfpr::SlotContent>();
+        content->pattern.lengthSteps = 16;
+        content->pattern.notes.emplace_back(40, 0, 2, 100, 1, 0);
+        content->pattern.notes.emplace_back(44, 8, 8, 90, 1, 0);
+        content->schedule = mfpr::PatternSchedule(content->pattern);
+
+        mfpr::SamplerBank bank;
+        bank.publish(0, std::move(content));
+        mfpr::TransportScheduler looping;
+        looping.prepare(sampleRate);
+        head.info.setIsPlaying(true);
+        head.info.setPpqPosition(3.5);
+
+        juce::MidiBuffer input, out;
+        input.addEvent(juce::MidiMessage::noteOn(1, bank.getTriggerNote(0), (juce::uint8) 100), 0);
+        std::array<int, 128> slotSounding {};
+        int noteOns = 0;
+        for (int block = 0; block < 200; ++block) // about four passes of the loop
+        {
+            out.clear();
+            bank.process(looping.advance(&head, blockSize), input, 1u, 0, out);
+            input.clear();
+            head.advance(blockSize, sampleRate);
+
+            for (const auto metadata : out)
+            {
+                const auto m = metadata.getMessage();
+                slotSounding[(size_t) m.getNoteNumber()] = m.isNoteOn() ? 1 : 0;
+                noteOns += m.isNoteOn() ? 1 : 0;
+            }
+        }
+        require(bank.getNumActive() == 0, "A slot carried across a loop wrap must still finish.");
+        require(noteOns == 2, "A slot carried across a loop wrap must play its phrase once.");
+        require(std::all_of(slotSounding.begin(), slotSounding.end(), [](int n) { return n == 0; }), "A finished slot must not leave notes hanging.");
+    }
+    return 0;
+}
+
+static int runBenchGenerate()
+{
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+
+    const int iterations = 200;
+    for (int type = 0; type < (int) mfpr::kTypes.size(); ++type)
+    {
+        for (const auto& lengthName : mfpr::kLengths)
+        {
+            mfpr::GenerationParams params;
+            params.genreIndex = 7;
+            params.keyIndex = 9;
+            params.modeIndex = 1;
+            params.lengthBars = lengthName.getIntValue();
+            params.type = (mfpr::GeneratorType) type;
+            params.melodyFollowChordChance = (params.type == mfpr::GeneratorType::hybrid) ? 0.80f : 0.0f;
+
+            size_t notes = 0;
+            const auto start = juce::Time::getMillisecondCounterHiRes();
+            for (int i = 0; i < iterations; ++i)
+            {
+                params.seed = (uint32_t) (1 + i);
+                notes += gen.generate(params, 60, 100, 1, library).notes.size();
+            }
+            const auto elapsedMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+            require(notes > 0, "Benchmark patterns must contain notes.");
+            juce::Logger::writeToLog("generate " + mfpr::kTypes[(size_t) type]
+                                     + juce::String::formatted(" %2d bars: %8.2f us/pattern (%d notes)",
+                                                               params.lengthBars,
+                                                               elapsedMs * 1000.0 / iterations,
+                                                               int(notes / (size_t) iterations)));
+        }
+    }
+    return 0;
+}
+
+// Scale lookup as it was before the tables: std::find over the degree list.
+static const std::array<std::vector<int>, mfpr::kNumModes> referenceScales = { {
+    { 0, 2, 4, 5, 7, 9, 11 }, // Major
+    { 0, 2, 3, 5, 7, 8, 10 }, // Minor
+    { 0, 2, 3, 5, 7, 9, 10 }, // Dorian
+    { 0, 1, 3, 5, 7, 8, 10 }, // Phrygian
+    { 0, 2, 4, 6, 7, 9, 11 }, // Lydian
+    { 0, 2, 4, 5, 7, 9, 10 }, // Mixolydian
+    { 0, 2, 3, 5, 7, 8, 11 }, // Harmonic Minor
+    { 0, 2, 3, 5, 7, 9, 11 }, // Melodic Minor
+    { 0, 2, 4, 7, 9 },        // Major Pentatonic
+    { 0, 3, 5, 7, 10 },       // Minor Pentatonic
+} };
+
+static bool referenceInScale(int pitchClass, int keyRoot, int mode)
+{
+    const auto pc = ((pitchClass - keyRoot) % 12 + 12) % 12;
+    const auto& scale = referenceScales[(size_t) mode];
+    return std::find(scale.begin(), scale.end(), pc) != scale.end();
+}
+
+static int referenceSnap(int midiNote, int keyRoot, int mode)
+{
+    if (referenceInScale(midiNote % 12, keyRoot, mode))
+        return juce::jlimit(0, 127, midiNote);
+
+    for (int delta = 1; delta <= 2; ++delta)
+    {
+        if (referenceInScale((midiNote + delta) % 12, keyRoot, mode))
+            return juce::jlimit(0, 127, midiNote + delta);
+        if (referenceInScale((midiNote - delta) % 12, keyRoot, mode))
+            return juce::jlimit(0, 127, midiNote - delta);
+    }
+
+    return juce::jlimit(0, 127, midiNote);
+}
+
+static int runScaleTablesMatchReference()
+{
+    for (int mode = 0; mode < mfpr::kNumModes; ++mode)
+    {
+        for (int key = 0; key < 12; ++key)
+        {
+            for (int note = -24; note < 152; ++note)
+            {
+                require(mfpr::isPitchClassInScale(note, key, mode) == referenceInScale(note, key, mode),
+                        "Scale table membership must match the degree lists.");
+                require(mfpr::snapToScale(note, key, mode) == referenceSnap(note, key, mode),
+                        "Scale table snapping must match the reference search.");
+            }
+        }
+    }
+
+    require(mfpr::kModes.size() == referenceScales.size(), "Every mode needs a scale.");
+    require(mfpr::kModes[0] == "Major" && mfpr::kModes[1] == "Minor", "Mode indices 0/1 must stay Major/Minor.");
+    return 0;
+}
+
+static int runBenchGenerationThroughput()
+{
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+
+    // Snap lookups: table vs the previous std::find search.
+    const int snapIterations = 2000000;
+    int sink = 0;
+
+    auto start = juce::Time::getMillisecondCounterHiRes();
+    for (int i = 0; i < snapIterations; ++i)
+        sink += referenceSnap(24 + (i % 96), i % 12, (i >> 4) & 1);
+    const auto referenceMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+    start = juce::Time::getMillisecondCounterHiRes();
+    for (int i = 0; i < snapIterations; ++i)
+        sink -= mfpr::snapToScale(24 + (i % 96), i % 12, (i >> 4) & 1);
+    const auto tableMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+    require(sink == 0, "Table and reference snapping must agree.");
+    juce::Logger::writeToLog(juce::String::formatted("snapToScale: reference %.2f ns, table %.2f ns",
+                                                     referenceMs * 1.0e6 / snapIterations,
+                                                     tableMs * 1.0e6 / snapIterations));
+
+    // Whole-pattern throughput across every type, length and mode.
+    int patterns = 0;
+    start = juce::Time::getMillisecondCounterHiRes();
+    for (uint32_t seed = 1; seed <= 40; ++seed)
+    {
+        for (int type = 0; type < (int) mfpr::kTypes.size(); ++type)
+        {
+            for (int mode = 0; mode < mfpr::kNumModes; ++mode)
+            {
+                mfpr::GenerationParams params;
+                params.genreIndex = (int) (seed % (uint32_t) mfpr::kNumGenres);
+                params.keyIndex = (int) (seed % 12u);
+                params.modeIndex = mode;
+                params.lengthBars = 4 * (1 + (int) (seed % 4u));
+                params.type = (mfpr::GeneratorType) type;
+                params.melodyFollowChordChance = (params.type == mfpr::GeneratorType::hybrid) ? 0.80f : 0.0f;
+                params.seed = seed;
+
+                require(!gen.generate(params, 60, 100, 1, library).notes.empty(), "Generated patterns must contain notes.");
+                ++patterns;
+            }
+        }
+    }
+    const auto elapsedMs = juce::Time::getMillisecondCounterHiRes() - start;
+    juce::Logger::writeToLog(juce::String::formatted("generate: %.0f patterns/s (%d patterns)",
+                                                     patterns * 1000.0 / juce::jmax(0.001, elapsedMs),
+                                                     patterns));
+    return 0;
+}
+
+static int runBatchGenerateSmoke()
+{
+    mfpr::AssetLibrary library;
+    mfpr::WorkerPool pool(3);
+
+    const auto dir = juce::File::getSpecialLocation(juce::File::tempDirectory).getNonexistentChildFile("MFPRBatchTest", "");
+    require(dir.createDirectory(), "Batch output directory must be creatable.");
+
+    mfpr::BatchGenerator::Grid grid;
+    grid.genres = { 0, 1 };
+    grid.keys = { 0, 2 };
+    grid.modes = { 0, 1 };
+    grid.lengths = { 0, 1 };
+    grid.types = { 0, 2 };
+    grid.seeds = { 10, 11 };
+    require(grid.getNumPatterns() == 2 * 3 * 2 * 2 * 3 * 2, "Grid size must be the product of its ranges.");
+
+    mfpr::BatchGenerator::Settings settings;
+    settings.outputDir = dir;
+
+    int lastProgress = 0;
+    bool progressOrdered = true;
+    const auto result = mfpr::BatchGenerator::run(library, grid, settings, &pool, [&](int done, int total)
+    {
+        progressOrdered = progressOrdered && done > lastProgress && done <= total;
+        lastProgress = done;
+        return true;
+    });
+
+    const int expected = (int) grid.getNumPatterns();
+    require(result.written == expected && result.failed == 0, "Batch must write one file per grid point.");
+    require(progressOrdered && lastProgress == expected, "Progress must increase up to the total.");
+
+    const auto files = dir.findChildFiles(juce::File::findFiles, true, "*.mid");
+    require(files.size() == expected, "Every grid point must produce a distinct file.");
+
+    // Files must match the single-pattern export path byte for byte.
+    const auto params = mfpr::BatchGenerator::paramsForIndex(grid, expected - 1);
+    mfpr::MelodyGenerator gen;
+    const auto bytes = mfpr::MidiExporter::renderPatternToMidiFileBytes(gen.generate(params, 60, 100, 1, library), settings.midi);
+
+    juce::MemoryBlock written;
+    require(mfpr::BatchGenerator::fileForParams(dir, params).loadFileAsData(written), "Batch file must be readable.");
+    require(written == bytes, "Batch file must equal the exported pattern.");
+
+    // Out-of-range indices are clamped before counting.
+    auto clamped = grid;
+    clamped.types = { 0, 99 };
+    require(mfpr::BatchGenerator::sanitise(clamped).getNumPatterns() == 2 * 3 * 2 * 2 * (int) mfpr::kTypes.size() * 2,
+            "The sanitised grid must count the types that exist.");
+
+    // A grid too large to index is rejected, not truncated.
+    auto oversized = grid;
+    oversized.seeds = { 0, std::numeric_limits<int>::max() };
+    require(mfpr::BatchGenerator::sanitise(oversized).getNumPatterns() > mfpr::BatchGenerator::kMaxPatterns,
+            "The oversized grid must count every seed.");
+    const auto rejected = mfpr::BatchGenerator::run(library, oversized, settings, &pool);
+    require(rejected.error.isNotEmpty() && rejected.written == 0 && rejected.failed == 0,
+            "An oversized grid must be rejected before generating anything.");
+
+    dir.deleteRecursively();
+    return 0;
+}
+
+// The juce::MidiFile based export that MidiExporter used to do; the direct writer must match it byte for byte.
+static juce::MemoryBlock referenceMidiFileBytes(const mfpr::GeneratedPattern& pattern, const mfpr::MidiExporter::Settings& settings)
+{
+    const auto ticksPerQuarter = juce::jlimit(96, 9600, settings.ticksPerQuarterNote);
+    const auto stepTicks = ticksPerQuarter / 4;
+
+    const auto requestedTracks = settings.forceNumTracks > 0 ? settings.forceNumTracks : pattern.numTracks;
+    const auto numTracks = juce::jlimit(1, 16, requestedTracks);
+
+    juce::MidiFile midi;
+    midi.setTicksPerQuarterNote(ticksPerQuarter);
+
+    std::vector<juce::MidiMessageSequence> tracks;
+    tracks.resize((size_t) numTracks);
+
+    tracks[0].addEvent(juce::MidiMessage::timeSignatureMetaEvent(settings.timeSigNumerator, settings.timeSigDenominator), 0.0);
+    tracks[0].addEvent(juce::MidiMessage::tempoMetaEvent(int(60'000'000.0 / juce::jmax(1.0, settings.bpm))), 0.0);
+    tracks[0].updateMatchedPairs();
+
+    for (const auto& packed : pattern.notes)
+    {
+        const auto n = packed.toMidiNote();
+        const auto tr = juce::jlimit(0, numTracks - 1, n.track);
+
+        auto on = juce::MidiMessage::noteOn(n.channel, n.noteNumber, (juce::uint8) juce::jlimit(1, 127, n.velocity));
+        on.setTimeStamp((double) (n.startStep * stepTicks));
+        tracks[(size_t) tr].addEvent(on);
+
+        auto off = juce::MidiMessage::noteOff(n.channel, n.noteNumber);
+        off.setTimeStamp((double) ((n.startStep + juce::jmax(1, n.lengthSteps)) * stepTicks));
+        tracks[(size_t) tr].addEvent(off);
+    }
+
+    for (auto& t : tracks)
+    {
+        t.updateMatchedPairs();
+        midi.addTrack(t);
+    }
+
+    juce::MemoryBlock mb;
+    juce::MemoryOutputStream mos(mb, false);
+    midi.writeTo(mos);
+    return mb;
+}
+
+static int runMidiWriterMatchesReference()
+{
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+
+    int compared = 0;
+    auto check = [&](const mfpr::GeneratedPattern& pattern, const mfpr::MidiExporter::Settings& s)
+    {
+        const auto bytes = mfpr::MidiExporter::renderPatternToMidiFileBytes(pattern, s);
+        require(bytes == referenceMidiFileBytes(pattern, s), "Direct SMF writer must match juce::MidiFile byte for byte.");
+
+        juce::MemoryBlock streamed;
+        {
+            juce::MemoryOutputStream mos(streamed, false);
+            require(mfpr::MidiExporter::writePatternToStream(pattern, mos, s), "Stream export must succeed.");
+        }
+        require(streamed == bytes, "Stream export must write the same bytes.");
+        ++compared;
+    };
+
+    for (uint32_t seed = 1; seed <= 12; ++seed)
+    {
+        for (int type = 0; type < (int) mfpr::kTypes.size(); ++type)
+        {
+            mfpr::GenerationParams params;
+            params.genreIndex = (int) (seed % (uint32_t) mfpr::kNumGenres);
+            params.keyIndex = (int) (seed % 12u);
+            params.modeIndex = (int) (seed % (uint32_t) mfpr::kNumModes);
+            params.lengthBars = 4 * (1 + (int) (seed % 4u));
+            params.type = (mfpr::GeneratorType) type;
+            params.seed = seed;
+
+            const auto pattern = gen.generate(params, 60, 100, 1 + (int) (seed % 16u), library);
+
+            mfpr::MidiExporter::Settings s;
+            check(pattern, s);
+
+            s.ticksPerQuarterNote = 96 + 7 * (int) seed;
+            s.bpm = 60.0 + 13.5 * seed;
+            s.timeSigNumerator = 3 + (int) (seed % 5u);
+            s.timeSigDenominator = (seed % 2u) ? 8 : 4;
+            s.forceNumTracks = (int) (seed % 4u);
+            check(pattern, s);
+        }
+    }
+
+    // Hand-made edge cases: re-triggered notes on the same pitch (the exporter must add the
+    // same note-offs as updateMatchedPairs), channel changes inside a track, out-of-range
+    // tracks/velocities, zero lengths and long gaps that need multi-byte deltas.
+    mfpr::GeneratedPattern edge;
+    edge.numTracks = 3;
+    edge.notes = mfpr::packNotes({
+        { 60, 0, 8, 100, 1, 0 },
+        { 60, 2, 2, 90, 1, 0 },
+        { 60, 2, 1, 80, 1, 0 },
+        { 64, 0, 0, 0, 2, 0 },
+        { 64, 0, 4, 200, 2, 0 },
+        { 67, 4, 4, 100, 1, 5 },
+        { 67, 6, 4, 100, 1, 5 },
+        { 72, 4000, 1, 127, 16, 1 },
+        { 48, 1, 3, 64, 10, 2 },
+        { 48, 1, 3, 64, 11, 2 },
+    });
+
+    for (const int tracks : { 0, 1, 2, 3, 16 })
+    {
+        for (const int tpq : { 96, 960, 9600 })
+        {
+            mfpr::MidiExporter::Settings s;
+            s.forceNumTracks = tracks;
+            s.ticksPerQuarterNote = tpq;
+            check(edge, s);
+        }
+    }
+
+    check(mfpr::GeneratedPattern {}, mfpr::MidiExporter::Settings {});
+
+    juce::Logger::writeToLog(juce::String::formatted("midi writer: %d exports identical to juce::MidiFile", compared));
+    return 0;
+}
+
+static int runBenchMidiExport()
+{
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+
+    std::vector<mfpr::GeneratedPattern> patterns;
+    for (uint32_t seed = 1; seed <= 32; ++seed)
+    {
+        mfpr::GenerationParams params;
+        params.genreIndex = (int) (seed % (uint32_t) mfpr::kNumGenres);
+        params.lengthBars = 4 * (1 + (int) (seed % 4u));
+        params.type = (mfpr::GeneratorType) (seed % (uint32_t) mfpr::kTypes.size());
+        params.seed = seed;
+        patterns.push_back(gen.generate(params, 60, 100, 1, library));
+    }
+
+    const mfpr::MidiExporter::Settings s;
+    const int rounds = 200;
+    size_t sink = 0;
+
+    auto measure = [&](auto&& render)
+    {
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+        for (int r = 0; r < rounds; ++r)
+            for (const auto& p : patterns)
+                sink += render(p).getSize();
+        const auto elapsedMs = juce::Time::getMillisecondCounterHiRes() - start;
+        return (double) (rounds * (int) patterns.size()) * 1000.0 / juce::jmax(0.001, elapsedMs);
+    };
+
+    const auto referenceRate = measure([&](const mfpr::GeneratedPattern& p) { return referenceMidiFileBytes(p, s); });
+    const auto directRate = measure([&](const mfpr::GeneratedPattern& p) { return mfpr::MidiExporter::renderPatternToMidiFileBytes(p, s); });
+
+    require(sink > 0, "Exports must produce bytes.");
+    juce::Logger::writeToLog(juce::String::formatted("midi export: juce::MidiFile %.0f files/s, direct %.0f files/s",
+                                                     referenceRate,
+                                                     directRate));
+    return 0;
+}
+
+static int runPackedNoteRoundTrip()
+{
+    static_assert(sizeof(mfpr::PackedNote) == 8, "PackedNote size");
+
+    for (int channel = 1; channel <= 16; ++channel)
+    {
+        for (int track = 0; track < 16; ++track)
+        {
+            const mfpr::MidiNote n { 127 - track, 1000 * channel, 1 + track, channel * 7, channel, track };
+            const mfpr::PackedNote packed(n);
+            const auto back = packed.toMidiNote();
+            require(back.noteNumber == n.noteNumber && back.startStep == n.startStep && back.lengthSteps == n.lengthSteps
+                        && back.velocity == n.velocity && back.channel == n.channel && back.track == n.track,
+                    "In-range notes must survive packing unchanged.");
+        }
+    }
+
+    const mfpr::PackedNote clamped(200, -5, 0, 0, 0, 99);
+    require(clamped.getNoteNumber() == 127 && clamped.getStartStep() == 0 && clamped.getLengthSteps() == 1
+                && clamped.getVelocity() == 1 && clamped.getChannel() == 1 && clamped.getTrack() == 15,
+            "Out-of-range fields must clamp to the MidiNote ranges.");
+    require(mfpr::PackedNote(60, 100000, 100000, 100, 1, 0).getEndStep() == 2 * mfpr::PackedNote::kMaxSteps,
+            "Steps must clamp to kMaxSteps.");
+
+    auto retuned = mfpr::PackedNote(60, 4, 2, 100, 3, 5);
+    retuned.setChannel(12);
+    require(retuned.getChannel() == 12 && retuned.getTrack() == 5, "setChannel must keep the track.");
+
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+    mfpr::GenerationParams params;
+    params.type = mfpr::GeneratorType::hybrid;
+    params.lengthBars = 16;
+    const auto pattern = gen.generate(params, 60, 100, 1, library);
+    require(mfpr::packNotes(mfpr::unpackNotes(pattern.notes)).size() == pattern.notes.size(), "Conversion helpers must keep every note.");
+
+    juce::Logger::writeToLog(juce::String::formatted("notes: %d bytes each, %d bytes for a 16-bar hybrid pattern",
+                                                     (int) sizeof(mfpr::PackedNote),
+                                                     (int) (pattern.notes.size() * sizeof(mfpr::PackedNote))));
+    return 0;
+}
+
+template <typename Fn>
+static int countAllocationsDuring(Fn&& fn)
+{
+    allocationCount.store(0);
+    countAllocations.store(true);
+    fn();
+    countAllocations.store(false);
+    return allocationCount.load();
+}
+
+static int runGenerationAllocations()
+{
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+    mfpr::WorkerPool pool(3);
+
+    auto paramsFor = [](int type, int bars, uint32_t seed)
+    {
+        mfpr::GenerationParams params;
+        params.genreIndex = (int) (seed % (uint32_t) mfpr::kNumGenres);
+        params.keyIndex = (int) (seed % 12u);
+        params.modeIndex = (int) (seed % (uint32_t) mfpr::kNumModes);
+        params.lengthBars = bars;
+        params.type = (mfpr::GeneratorType) type;
+        params.seed = seed;
+        return params;
+    };
+
+    // A reused pattern never allocates once it has been through one generation.
+    mfpr::GeneratedPattern reused;
+    gen.generateInto(reused, paramsFor(2, 16, 1), 60, 100, 1, library);
+
+    const auto generatorAllocations = countAllocationsDuring([&]
+    {
+        for (uint32_t seed = 1; seed <= 20; ++seed)
+            for (int type = 0; type < (int) mfpr::kTypes.size(); ++type)
+                for (const int bars : { 4, 8, 12, 16 })
+                    gen.generateInto(reused, paramsFor(type, bars, seed), 60, 100, 1, library);
+    });
+    require(generatorAllocations == 0, "generateInto must not allocate once the pattern is warmed up.");
+
+    // Candidate searches (serial and on the pool) reuse their buffers between runs.
+    mfpr::CandidateSearch search;
+    mfpr::CandidateSearchSettings settings;
+    settings.numCandidates = 64;
+    search.run(gen, paramsFor(2, 16, 1), 60, 100, 1, library, settings, nullptr);
+
+    const auto searchAllocations = countAllocationsDuring([&]
+    {
+        for (uint32_t seed = 100; seed < 110; ++seed)
+        {
+            search.run(gen, paramsFor((int) (seed % 3u), 16, seed), 60, 100, 1, library, settings, nullptr);
+            search.run(gen, paramsFor((int) (seed % 3u), 16, seed), 60, 100, 1, library, settings, &pool);
+        }
+    });
+    require(searchAllocations == 0, "Candidate search must not allocate once warmed up.");
+
+    // Whole trigger path: what the generation thread allocates must not grow with the candidate
+    // count, and the blocks switching to the new pattern must not allocate at all.
+    juce::ScopedJuceInitialiser_GUI init;
+    mfpr::MelodyForgeProAudioProcessor proc;
+    proc.setRateAndBufferSizeDetails(48000.0, 512);
+    proc.prepareToPlay(48000.0, 512);
+
+    juce::AudioBuffer<float> buffer(2, 512);
+    juce::MidiBuffer midi;
+    auto* candidatesParam = proc.getAPVTS().getParameter("candidates");
+
+    auto triggeredBlock = [&](int candidates)
+    {
+        candidatesParam->setValueNotifyingHost(candidatesParam->convertTo0to1((float) candidates));
+        proc.triggerGenerateFromUI();
+        midi.clear();
+        const auto allocations = countAllocationsDuring([&]
+        {
+            proc.processBlock(buffer, midi);
+            waitForGeneratedPattern(proc);
+        });
+
+        // 16 blocks cover the 16th the new pattern waits for.
+        const auto switchAllocations = countAllocationsDuring([&]
+        {
+            for (int block = 0; block < 16; ++block)
+            {
+                midi.clear();
+                proc.processBlock(buffer, midi);
+            }
+        });
+        require(switchAllocations == 0, "Switching to a generated pattern must not allocate.");
+        return allocations;
+    };
+
+    triggeredBlock(1);
+    triggeredBlock(64);
+    const auto oneCandidate = triggeredBlock(1);
+    const auto manyCandidates = triggeredBlock(64);
+
+    juce::Logger::writeToLog(juce::String::formatted("allocations per generated pattern: %d (1 candidate), %d (64 candidates)",
+                                                     oneCandidate,
+                                                     manyCandidates));
+    require(std::abs(manyCandidates - oneCandidate) < 8, "Generating more candidates must not allocate per candidate.");
+
+    proc.releaseResources();
+    return 0;
+}
+
+static int runStreamingScoreMatchesScore()
+{
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+    mfpr::GeneratedPattern scored;
+
+    for (uint32_t seed = 1; seed <= 30; ++seed)
+    {
+        for (int type = 0; type < (int) mfpr::kTypes.size(); ++type)
+        {
+            for (const int bars : { 4, 8, 12, 16 })
+            {
+                mfpr::GenerationParams params;
+                params.genreIndex = (int) (seed % (uint32_t) mfpr::kNumGenres);
+                params.keyIndex = (int) (seed % 12u);
+                params.modeIndex = (int) (seed % (uint32_t) mfpr::kNumModes);
+                params.lengthBars = bars;
+                params.type = (mfpr::GeneratorType) type;
+                params.seed = seed;
+
+                const auto expected = gen.generate(params, 60, 100, 1, library);
+                const auto expectedScore = gen.score(expected, params);
+
+                const auto s = gen.generateScored(scored, params, 60, 100, 1, library);
+                require(s == expectedScore, "Streaming score must equal score() exactly.");
+                require(hashPattern(scored) == hashPattern(expected), "Scored generation must produce the same pattern.");
+
+                require(gen.generateScored(scored, params, 60, 100, 1, library, expectedScore) == -std::numeric_limits<double>::infinity(),
+                        "A candidate that can only tie the bound must be abandoned.");
+                require(gen.generateScored(scored, params, 60, 100, 1, library, expectedScore - 1.0e-9) == expectedScore,
+                        "A candidate that beats the bound must be scored in full.");
+            }
+        }
+    }
+
+    // Branch-and-bound never changes the winner.
+    for (int type = 0; type < (int) mfpr::kTypes.size(); ++type)
+    {
+        for (const int count : { 10, 64, 256 })
+        {
+            mfpr::GenerationParams params;
+            params.genreIndex = 9;
+            params.lengthBars = 8;
+            params.type = (mfpr::GeneratorType) type;
+            params.seed = (uint32_t) (1000 + count);
+
+            mfpr::CandidateSearchSettings settings;
+            settings.numCandidates = count;
+
+            mfpr::CandidateSearch search;
+            settings.branchAndBound = false;
+            const auto full = search.run(gen, params, 60, 100, 1, library, settings, nullptr);
+            require(search.getNumAbandoned() == 0, "Nothing is abandoned without branch-and-bound.");
+
+            settings.branchAndBound = true;
+            const auto pruned = search.run(gen, params, 60, 100, 1, library, settings, nullptr);
+            require(hashPattern(pruned) == hashPattern(full), "Branch-and-bound must keep the winner.");
+        }
+    }
+    return 0;
+}
+
+static int runBenchCandidateSearch()
+{
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+    mfpr::WorkerPool pool;
+    mfpr::CandidateSearch search;
+
+    for (const int count : { 10, 64, 256 })
+    {
+        for (const bool branchAndBound : { false, true })
+        {
+            mfpr::CandidateSearchSettings settings;
+            settings.numCandidates = count;
+            settings.branchAndBound = branchAndBound;
+
+            const int triggers = 40;
+            int abandoned = 0;
+            const auto start = juce::Time::getMillisecondCounterHiRes();
+            for (int t = 0; t < triggers; ++t)
+            {
+                mfpr::GenerationParams params;
+                params.genreIndex = t % mfpr::kNumGenres;
+                params.lengthBars = 16;
+                params.type = mfpr::GeneratorType::hybrid;
+                params.seed = (uint32_t) (1 + t * 997);
+
+                search.run(gen, params, 60, 100, 1, library, settings, &pool);
+                abandoned += search.getNumAbandoned();
+            }
+            const auto elapsedMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+            juce::Logger::writeToLog(juce::String::formatted("candidates %3d, branch-and-bound %s: %7.3f ms/trigger, %5.1f%% abandoned",
+                                                             count,
+                                                             branchAndBound ? "on " : "off",
+                                                             elapsedMs / triggers,
+                                                             100.0 * abandoned / (triggers * count)));
+        }
+    }
+    return 0;
+}
+
+static float featureOf(const mfpr::PatternFeatures& f, mfpr::PatternFeature feature)
+{
+    return f[(size_t) feature];
+}
+
+static int runScoringModel()
+{
+    using F = mfpr::PatternFeature;
+
+    // Hand-made hybrid pattern in C major: a C major triad held for 8 steps, then a melody
+    // C4 (step 0), E4 (step 2), B4 (step 3, off-beat), F#5 (step 6, out of scale, 7-semitone leap).
+    mfpr::GeneratedPattern pattern;
+    pattern.lengthSteps = 16;
+    pattern.numTracks = 5;
+    for (const int n : { 48, 52, 55 })
+        pattern.notes.emplace_back(n, 0, 8, 90, 1, n == 48 ? 0 : (n == 52 ? 1 : 2));
+    pattern.notes.emplace_back(60, 0, 2, 100, 1, 4);
+    pattern.notes.emplace_back(64, 2, 1, 100, 1, 4);
+    pattern.notes.emplace_back(71, 3, 3, 100, 1, 4);
+    pattern.notes.emplace_back(78, 6, 2, 100, 1, 4);
+
+    mfpr::GenerationParams params;
+    params.type = mfpr::GeneratorType::hybrid;
+    params.keyIndex = 0;
+    params.modeIndex = 0;
+
+    mfpr::PatternFeatures f;
+    mfpr::ScoringModel::extractFeatures(pattern, params, f);
+
+    auto approx = [](float a, float b) { return std::abs(a - b) < 1.0e-6f; };
+    require(featureOf(f, F::bias) == 1.0f, "Bias feature must be 1.");
+    require(approx(featureOf(f, F::density), 7.0f / 16.0f), "Density counts every note.");
+    require(approx(featureOf(f, F::melodyDensity), 4.0f / 16.0f), "Melody density counts track 4 only.");
+    require(approx(featureOf(f, F::inScale), 6.0f / 7.0f), "F# is the only out-of-scale note.");
+    require(approx(featureOf(f, F::chordToneAdherence), 2.0f / 4.0f), "C and E sound in the chord; B and F# do not.");
+    require(approx(featureOf(f, F::syncopation), 3.0f / 4.0f) && approx(featureOf(f, F::offbeat16ths), 1.0f / 4.0f), "Onset features.");
+    require(approx(featureOf(f, F::leapThird), 1.0f / 3.0f) && approx(featureOf(f, F::leapFifth), 2.0f / 3.0f), "Leap histogram.");
+    require(approx(featureOf(f, F::range), 18.0f / 24.0f), "Melody range.");
+    require(approx(featureOf(f, F::degree0), 0.25f) && approx(featureOf(f, F::degree6), 0.25f), "Degree histogram is relative to the key.");
+
+    // Weights file parsing.
+    mfpr::ScoringModel model;
+    require(!model.hasWeightsFor(0), "An empty model has no weights.");
+    require(!model.loadFromJson("{ \"default\": { \"noSuchFeature\": 1 } }"), "Unknown features must be rejected.");
+    require(!model.loadFromJson("{ \"genres\": { \"Polka\": { \"density\": 1 } } }"), "Unknown genres must be rejected.");
+    require(!model.loadFromJson("not json"), "Malformed JSON must be rejected.");
+    require(model.loadFromJson("{ \"genres\": { \"techno\": { \"density\": 2, \"leapExcess\": -1.5 } } }"), "Valid weights must load.");
+    require(model.hasWeightsFor(8) && !model.hasWeightsFor(0), "Genres are matched by name, case-insensitively.");
+
+    params.genreIndex = 8;
+    const auto expected = 2.0 * featureOf(f, F::density) - 1.5 * featureOf(f, F::leapExcess);
+    require(std::abs(model.score(pattern, params) - expected) < 1.0e-5, "Score must be the weighted feature sum.");
+
+    // Batched scores equal one-at-a-time scores.
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+    require(model.loadFromJson("{ \"default\": { \"density\": -1.0, \"chordToneAdherence\": 1.2, \"leapStep\": 0.7, \"syncopation\": 0.3, \"range\": -0.5 } }"),
+            "Default weights must load.");
+
+    std::vector<mfpr::GeneratedPattern> patterns;
+    for (uint32_t seed = 1; seed <= 40; ++seed)
+    {
+        params.seed = seed;
+        patterns.push_back(gen.generate(params, 60, 100, 1, library));
+    }
+
+    std::vector<const mfpr::GeneratedPattern*> pointers;
+    for (const auto& p : patterns)
+        pointers.push_back(&p);
+
+    std::vector<double> batched(patterns.size());
+    model.scoreBatch(pointers.data(), (int) pointers.size(), params, batched.data());
+    for (size_t i = 0; i < patterns.size(); ++i)
+        require(batched[i] == model.score(patterns[i], params), "Batched and single scores must match.");
+
+    // Candidate search ranks by the model, serially and in parallel, like a reference loop.
+    mfpr::WorkerPool pool(3);
+    for (const int count : { 1, 10, 64, 256 })
+    {
+        params.seed = (uint32_t) (300 + count);
+
+        double bestScore = -1.0e9;
+        mfpr::GeneratedPattern best;
+        for (int i = 0; i < count; ++i)
+        {
+            auto p = params;
+            p.seed = params.seed + (uint32_t) i;
+            auto candidate = gen.generate(p, 60, 100, 1, library);
+            const auto s = model.score(candidate, p);
+            if (s > bestScore)
+            {
+                bestScore = s;
+                best = std::move(candidate);
+            }
+        }
+
+        mfpr::CandidateSearchSettings settings;
+        settings.numCandidates = count;
+        settings.scoringModel = &model;
+
+        mfpr::CandidateSearch search;
+        require(hashPattern(search.run(gen, params, 60, 100, 1, library, settings, nullptr)) == hashPattern(best),
+                "Model-ranked search must match the reference loop.");
+        require(hashPattern(search.run(gen, params, 60, 100, 1, library, settings, &pool)) == hashPattern(best),
+                "Parallel model-ranked search must match serial.");
+    }
+    return 0;
+}
+
+static int runBenchScoringModel()
+{
+    mfpr::AssetLibrary library;
+    mfpr::MelodyGenerator gen;
+    mfpr::ScoringModel model;
+    require(model.loadFromJson("{ \"default\": { \"density\": -1.0, \"chordToneAdherence\": 1.2, \"leapExcess\": -0.5 } }"), "Weights must load.");
+
+    mfpr::GenerationParams params;
+    params.type = mfpr::GeneratorType::hybrid;
+    params.lengthBars = 16;
+
+    std::vector<mfpr::GeneratedPattern> patterns;
+    std::vector<const mfpr::GeneratedPattern*> pointers;
+    patterns.reserve(256);
+    for (uint32_t seed = 1; seed <= 256; ++seed)
+    {
+        params.seed = seed;
+        patterns.push_back(gen.generate(params, 60, 100, 1, library));
+        pointers.push_back(&patterns.back());
+    }
+
+    const int rounds = 50;
+    std::vector<double> scores(patterns.size());
+    double sink = 0.0;
+
+    auto start = juce::Time::getMillisecondCounterHiRes();
+    for (int r = 0; r < rounds; ++r)
+        for (const auto& p : patterns)
+            sink += gen.score(p, params);
+    const auto heuristicMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+    start = juce::Time::getMillisecondCounterHiRes();
+    for (int r = 0; r < rounds; ++r)
+    {
+        model.scoreBatch(pointers.data(), (int) pointers.size(), params, scores.data());
+        sink += scores[0];
+    }
+    const auto modelMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+    require(std::isfinite(sink), "Scores must be finite.");
+    const auto evaluations = double(rounds * (int) patterns.size());
+    juce::Logger::writeToLog(juce::String::formatted("score 16-bar hybrid: heuristic %.0f ns, feature model %.0f ns per pattern",
+                                                     heuristicMs * 1.0e6 / evaluations,
+                                                     modelMs * 1.0e6 / evaluations));
+    return 0;
+}
+
+static int runLayerEngine()
+{
+    const double sampleRate = 48000.0;
+    const int blockSize = 1000;
+    const int sixteenth = 6000; // samples per step at 120 bpm
+
+    // Schedules are in time order, offs first within a step, and cut at the pattern's end.
+    mfpr::GeneratedPattern pattern;
+    pattern.lengthSteps = 16;
+    pattern.notes.emplace_back(60, 0, 4, 100, 1, 0);
+    pattern.notes.emplace_back(64, 4, 2, 90, 1, 0);
+    pattern.notes.emplace_back(60, 4, 20, 80, 1, 0); // re-struck as the first ends, runs past the end
+
+    const mfpr::PatternSchedule schedule(pattern);
+    const auto& events = schedule.getEvents();
+    require(events.size() == 6, "Every note must give one note-on and one note-off.");
+    require(events[1].step == 4 && events[1].noteNumber == 60 && events[1].velocity == 0 && events[2].velocity == 80,
+            "A note-off must come before a note-on of the same step.");
+    require(events.back().step == 16 && events.back().noteNumber == 60, "Notes must be cut at the pattern's end.");
+
+    // Two layers on their own channels and transposes: a looping one from the first bar, and a
+    // one-shot launched mid-beat on a beat grid. The looping one is stopped during its second pass.
+    mfpr::TransportScheduler transport;
+    transport.prepare(sampleRate);
+    mfpr::LayerEngine engine;
+    engine.launch(0, pattern, { 3, 12, mfpr::LaunchQuantise::bar, true });
+
+    juce::MidiBuffer out;
+    out.ensureSize(8192);
+    std::array<int, 17> noteOns {};
+    std::array<int, 16 * 128> sounding {};
+    int lastChannel3 = 0, firstChannel5 = -1, lastChannel5 = 0;
+    bool onGrid = true;
+
+    for (int block = 0; block < 260; ++block)
+    {
+        if (block == 30)
+            engine.launch(1, pattern, { 5, -12, mfpr::LaunchQuantise::beat, false });
+        if (block == 100)
+            engine.stop(0);
+
+        out.clear();
+        engine.process(transport.advance(nullptr, blockSize), 0.0, out);
+
+        int previous = 0;
+        for (const auto metadata : out)
+        {
+            const auto m = metadata.getMessage();
+            const int time = block * blockSize + metadata.samplePosition;
+            require(metadata.samplePosition >= previous, "Layer events must come out in time order.");
+            previous = metadata.samplePosition;
+
+            if (m.getChannel() == 3)
+            {
+                require(m.getNoteNumber() == 72 || m.getNoteNumber() == 76, "The layer's transpose must be applied.");
+                lastChannel3 = time;
+            }
+            else
+            {
+                require(m.getChannel() == 5 && (m.getNoteNumber() == 48 || m.getNoteNumber() == 52), "Each layer must play on its own channel.");
+                if (firstChannel5 < 0)
+                    firstChannel5 = time;
+                lastChannel5 = time;
+            }
+            onGrid = onGrid && time % sixteenth == 0;
+
+            const auto index = (size_t) ((m.getChannel() - 1) * 128 + m.getNoteNumber());
+            if (m.isNoteOn())
+            {
+                ++noteOns[(size_t) m.getChannel()];
+                sounding[index] = 1;
+            }
+            else
+            {
+                sounding[index] = 0;
+            }
+        }
+    }
+
+    require(onGrid, "Layer events must land exactly on their steps.");
+    require(firstChannel5 == 4 * 2 * sixteenth, "A beat-quantised launch must start on the next beat.");
+    require(lastChannel5 == firstChannel5 + 16 * sixteenth && !engine.isActive(1), "A one-shot layer must play once and free itself.");
+    require(lastChannel3 == 2 * 16 * sixteenth && !engine.isActive(0), "A bar-quantised stop must end the layer at the next bar.");
+    require(noteOns[3] == 6 && noteOns[5] == 3, "Each pass must play every note once.");
+    require(std::all_of(sounding.begin(), sounding.end(), [](int n) { return n == 0; }), "Stopped layers must not leave notes hanging.");
+
+    // All 64 layers at once, without allocating on the audio thread.
+    for (int layer = 0; layer < mfpr::LayerEngine::kMaxLayers; ++layer)
+        engine.launch(layer, pattern, { layer % 16 + 1, layer / 16, mfpr::LaunchQuantise::none, true });
+    out.clear();
+    engine.process(transport.advance(nullptr, blockSize), 0.3, out);
+    for (int layer = 0; layer < mfpr::LayerEngine::kMaxLayers; ++layer)
+        require(engine.isActive(layer), "Every layer must be able to play at once.");
+
+    int ons = 0;
+    const auto allocations = countAllocationsDuring([&]
+    {
+        for (int block = 0; block < 200; ++block)
+        {
+            out.clear();
+            engine.process(transport.advance(nullptr, blockSize), 0.3, out);
+            for (const auto metadata : out)
+                ons += metadata.getMessage().isNoteOn() ? 1 : 0;
+        }
+    });
+    require(allocations == 0, "LayerEngine::process must not allocate.");
+    require(ons > 64 * 3, "Every layer must play.");
+
+    engine.stopAll();
+    out.clear();
+    engine.process(transport.advance(nullptr, blockSize), 0.3, out);
+    require(!engine.isActive(0) && !engine.isActive(mfpr::LayerEngine::kMaxLayers - 1), "stopAll must end every layer.");
+
+    // Under a two-bar host loop (starting just off a block boundary, so it wraps mid-block):
+    // a looping layer launched in the second bar plays through the first bar after each wrap,
+    // and bar-quantised launches and stops issued in the last bar happen at the wrap.
+    {
+        ScriptedPlayHead head;
+        head.info.setIsPlaying(true);
+        head.info.setIsLooping(true);
+        head.info.setBpm(120.0);
+        head.info.setPpqPosition(0.01);
+        head.info.setLoopPoints(juce::AudioPlayHead::LoopPoints { 0.0, 8.0 });
+
+        mfpr::TransportScheduler looping;
+        looping.prepare(sampleRate);
+        mfpr::LayerEngine loopEngine;
+        loopEngine.launch(0, pattern, { 3, 0, mfpr::LaunchQuantise::bar, true });
+
+        const int blocksPerLoop = 192; // 8 ppq of 1000-sample blocks at 120 bpm
+        std::array<int, 3> firstBarOns {}; // channel 3 note-ons in the loop's first bar, per pass
+        int channel5Ons = 0, channel3OnsAfterStop = 0;
+        for (int block = 0; block < 3 * blocksPerLoop; ++block)
+        {
+            const auto blockPpq = *head.info.getPpqPosition();
+            const int pass = block / blocksPerLoop;
+            if (block == blocksPerLoop - 20)
+                loopEngine.launch(1, pattern, { 5, 0, mfpr::LaunchQuantise::bar, true });
+            if (block == 2 * blocksPerLoop - 20)
+                loopEngine.stop(0);
+
+            out.clear();
+            loopEngine.process(looping.advance(&head, blockSize), 0.0, out);
+            head.advance(blockSize, sampleRate);
+
+            for (const auto metadata : out)
+            {
+                const auto m = metadata.getMessage();
+                if (!m.isNoteOn())
+                    continue;
+                if (m.getChannel() == 5)
+                    ++channel5Ons;
+                if (m.getChannel() == 3 && blockPpq > 0.1 && blockPpq < 3.9)
+                    ++firstBarOns[(size_t) pass];
+                if (m.getChannel() == 3 && pass == 2)
+                    ++channel3OnsAfterStop;
+            }
+        }
+
+        require(firstBarOns[0] == 0 && firstBarOns[1] == 2, "A looping layer must play before its launch point after a wrap.");
+        require(channel5Ons >= 3 && loopEngine.isActive(1), "A bar-quantised launch in the loop's last bar must start at the wrap.");
+        require(channel3OnsAfterStop == 0 && !loopEngine.isActive(0), "A bar-quantised stop in the loop's last bar must end the layer at the wrap.");
+    }
+    return 0;
+}
+
+static int runAsyncSlotImport()
+{
+    // The handoff delivers contents in order, never tearing one, while the audio side
+    // neither locks nor allocates.
+    {
+        mfpr::SlotContentHandoff handoff;
+        const int numContents = 2000;
+        std::thread publisher([&]
+        {
+            for (int i = 1; i <= numContents; ++i)
+            {
+                auto content = std::make_unique<mfpr::SlotContent>();
+                content->pattern.lengthSteps = i;
+                content->pattern.notes.emplace_back(60, 0, 1, 100, 1, 0);
+                content->label = juce::String(i);
+                handoff.publish(std::move(content));
+            }
+        });
+
+        int last = 0;
+        while (last < numContents)
+        {
+            if (handoff.update())
+            {
+                const auto* c = handoff.get();
+                require(c->pattern.lengthSteps > last && c->label == juce::String(c->pattern.lengthSteps) && c->pattern.notes.size() == 1,
+                        "Slot content must arrive whole and in order.");
+                last = c->pattern.lengthSteps;
+            }
+        }
+        publisher.join();
+
+        handoff.publish(std::make_unique<mfpr::SlotContent>());
+        require(countAllocationsDuring([&] { handoff.update(); }) == 0, "Picking up slot content must not allocate.");
+    }
+
+    // Through the processor: the import finishes off the message thread and the slot plays it.
+    mfpr::GeneratedPattern pattern;
+    pattern.lengthSteps = 16;
+    pattern.notes.emplace_back(10, 0, 2, 100, 1, 0); // far outside anything the generator plays
+    pattern.notes.emplace_back(118, 4, 2, 100, 1, 0);
+    const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getNonexistentChildFile("MFPRSlotImport", ".mid");
+    require(mfpr::MidiExporter::writePatternToFile(pattern, file, {}), "The test file must be written.");
+
+    mfpr::MelodyForgeProAudioProcessor proc;
+    proc.setRateAndBufferSizeDetails(48000.0, 512);
+    proc.prepareToPlay(48000.0, 512);
+    proc.importMidiToSamplerSlot(1, file);
+
+    const auto deadline = juce::Time::getMillisecondCounter() + 10000;
+    while (proc.getSamplerSlotInfo(1).loadProgress >= 0.0f && juce::Time::getMillisecondCounter() < deadline)
+        juce::Thread::sleep(5);
+    require(proc.getSamplerSlotInfo(1).loadProgress < 0.0f, "The import must finish.");
+    require(proc.getSamplerSlotInfo(1).label != proc.getSamplerSlotInfo(0).label, "The slot must show the imported file.");
+
+    juce::AudioBuffer<float> audio(2, 512);
+    std::unordered_set<int> played;
+    for (int block = 0; block < 40; ++block)
+    {
+        juce::MidiBuffer midi;
+        if (block == 0)
+            midi.addEvent(juce::MidiMessage::noteOn(1, 61, (juce::uint8) 100), 0); // slot 2's trigger note
+        if (block == 1)
+            midi.addEvent(juce::MidiMessage::noteOff(1, 61), 0);
+        proc.processBlock(audio, midi);
+
+        for (const auto metadata : midi)
+            if (metadata.getMessage().isNoteOn() && metadata.getMessage().getNoteNumber() != 61)
+                played.insert(metadata.getMessage().getNoteNumber());
+    }
+    require(played.count(10) == 1 && played.count(118) == 1, "The triggered slot must play the imported notes.");
+
+    proc.releaseResources();
+    file.deleteFile();
+    return 0;
+}
+
+static int runSamplerBank()
+{
+    const double sampleRate = 48000.0;
+    const int blockSize = 1000;
+    const int sixteenth = 6000; // samples per step at 120 bpm
+
+    auto phrase = [](int note)
+    {
+        auto content = std::make_unique<mfpr::SlotContent>();
+        content->pattern.lengthSteps = 16;
+        content->pattern.notes.emplace_back(note, 0, 2, 100, 1, 0);
+        content->pattern.notes.emplace_back(note + 4, 8, 8, 90, 1, 0);
+        content->schedule = mfpr::PatternSchedule(content->pattern);
+        return content;
+    };
+
+    mfpr::SamplerBank bank;
+    require(bank.getNumSlots() == mfpr::SamplerBank::kDefaultNumSlots, "The bank must start with the default slot count.");
+    require(bank.getTriggerNote(0) == 60 && bank.getTriggerNote(3) == 63, "Default trigger notes must stay 60-63.");
+
+    bank.setNumSlots(128);
+    for (int slot = 0; slot < mfpr::SamplerBank::kMaxSlots; ++slot)
+        bank.publish(slot, phrase(24 + slot % 64));
+
+    // Remapping a note takes it from its previous slot.
+    bank.setTriggerNote(100, 36);
+    require(bank.getTriggerNote(100) == 36 && bank.getTriggerNote((36 + 128 - 60) % 128) == -1, "A note must trigger one slot only.");
+    bank.setSlotSettings(100, { 9, 12 });
+
+    mfpr::TransportScheduler transport;
+    transport.prepare(sampleRate);
+    juce::MidiBuffer input, out;
+    out.ensureSize(16384);
+    std::array<int, 16 * 128> sounding {};
+    std::array<int, 17> ons {};
+    bool onGrid = true;
+
+    auto runBlock = [&](int block)
+    {
+        out.clear();
+        bank.process(transport.advance(nullptr, blockSize), input, 1u, 0, out);
+        for (const auto metadata : out)
+        {
+            const auto m = metadata.getMessage();
+            const auto index = (size_t) ((m.getChannel() - 1) * 128 + m.getNoteNumber());
+            sounding[index] = m.isNoteOn() ? 1 : 0;
+            ons[(size_t) m.getChannel()] += m.isNoteOn() ? 1 : 0;
+            onGrid = onGrid && (block * blockSize + metadata.samplePosition - 500) % sixteenth == 0;
+        }
+        input.clear();
+    };
+
+    // Slot 0 plays on the trigger's channel, slot 100 on its own channel and transposed.
+    input.addEvent(juce::MidiMessage::noteOn(2, 60, (juce::uint8) 100), 500);
+    input.addEvent(juce::MidiMessage::noteOn(2, 36, (juce::uint8) 100), 500);
+    runBlock(0);
+    require(bank.getNumActive() == 2, "Only triggered slots may be active.");
+    require(sounding[(size_t) (1 * 128 + 24)] == 1 && sounding[(size_t) (8 * 128 + 24 + 100 % 64 + 12)] == 1,
+            "Slots must follow their channel and transpose settings.");
+
+    for (int block = 1; block < 120; ++block)
+        runBlock(block);
+    require(onGrid, "Slot events must land on their steps.");
+    require(bank.getNumActive() == 0, "A slot must stop after its single pass.");
+    require(ons[2] == 2 && ons[9] == 2, "A slot must play its phrase once.");
+    require(std::all_of(sounding.begin(), sounding.end(), [](int n) { return n == 0; }), "Finished slots must not leave notes hanging.");
+
+    // Every slot at once (the whole keyboard), without allocating.
+    bank.setTriggerNote(104, 32); // the note slot 100 gave up
+    for (int note = 0; note < 128; ++note)
+        input.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8) 100), 0);
+    const auto allocations = countAllocationsDuring([&]
+    {
+        for (int block = 0; block < 120; ++block)
+        {
+            out.clear();
+            bank.process(transport.advance(nullptr, blockSize), input, 1u, 480, out);
+            input.clear();
+            require(block > 0 || bank.getNumActive() == mfpr::SamplerBank::kMaxSlots, "All slots must be able to play at once.");
+        }
+    });
+    require(allocations == 0, "SamplerBank::process must not allocate.");
+
+    // Slots past the count are not triggered.
+    bank.setNumSlots(4);
+    input.addEvent(juce::MidiMessage::noteOn(1, 70, (juce::uint8) 100), 0);
+    out.clear();
+    bank.process(transport.advance(nullptr, blockSize), input, 1u, 0, out);
+    require(bank.getNumActive() == 0, "Slots beyond the bank size must not play.");
+    return 0;
+}
+
+static int runBenchProcessBlock()
+{
+    const double sampleRate = 48000.0;
+    const int blockSize = 512;
+    const int numBlocks = 1000; // ~10 s, inside one pass of the phrases below
+
+    // A 16-bar run of 16ths, so every triggered slot plays through all measured blocks.
+    auto phrase = []
+    {
+        auto content = std::make_unique<mfpr::SlotContent>();
+        content->pattern.lengthSteps = 256;
+        for (int step = 0; step < 256; ++step)
+            content->pattern.notes.emplace_back(48 + step % 24, step, 1, 100, 1, 0);
+        content->schedule = mfpr::PatternSchedule(content->pattern);
+        return content;
+    };
+
+    juce::ScopedJuceInitialiser_GUI init;
+    int allocationsWithoutSlots = 0;
+    for (const int numSlots : { 0, 4, 32 })
+    {
+        mfpr::MelodyForgeProAudioProcessor proc;
+        proc.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        proc.prepareToPlay(sampleRate, blockSize);
+
+        auto& bank = proc.getSamplerBank();
+        bank.setNumSlots(32);
+        for (int slot = 0; slot < 32; ++slot)
+            bank.publish(slot, phrase());
+
+        // The first block triggers the generated pattern and starts the slots; once the
+        // pattern is generated and has started, the rest is measured.
+        juce::AudioBuffer<float> audio(2, blockSize);
+        juce::MidiBuffer midi;
+        proc.triggerGenerateFromUI();
+        for (int slot = 0; slot < numSlots; ++slot)
+            midi.addEvent(juce::MidiMessage::noteOn(1, bank.getTriggerNote(slot), (juce::uint8) 100), 0);
+        proc.processBlock(audio, midi);
+        waitForGeneratedPattern(proc);
+
+        for (int block = 0; block < 50; ++block)
+        {
+            midi.clear();
+            proc.processBlock(audio, midi);
+        }
+
+        double ms = 0.0;
+        const auto allocations = countAllocationsDuring([&]
+        {
+            const auto start = juce::Time::getMillisecondCounterHiRes();
+            for (int block = 0; block < numBlocks; ++block)
+            {
+                midi.clear();
+                proc.processBlock(audio, midi);
+            }
+            ms = juce::Time::getMillisecondCounterHiRes() - start;
+        });
+
+        require(bank.getNumActive() == numSlots, "Every triggered slot must still be playing.");
+        if (numSlots == 0)
+            allocationsWithoutSlots = allocations;
+        require(allocations == allocationsWithoutSlots, "Playing sampler slots must not allocate.");
+
+        juce::Logger::writeToLog(juce::String::formatted("processBlock with %d active slots: %.1f us per block, %d allocations in %d blocks",
+                                                         numSlots,
+                                                         ms * 1000.0 / numBlocks,
+                                                         allocations,
+                                                         numBlocks));
+        proc.releaseResources();
+    }
+    return 0;
+}
+
+static int runBatchSlotImport()
+{
+    // A folder's worth of files, each with its own marker note.
+    const auto dir = juce::File::getSpecialLocation(juce::File::tempDirectory).getNonexistentChildFile("MFPRBatchImport", "");
+    require(dir.createDirectory().wasOk(), "The test folder must be created.");
+
+    const int numFiles = 24;
+    juce::Array<juce::File> files;
+    for (int i = 0; i < numFiles; ++i)
+    {
+        mfpr::GeneratedPattern pattern;
+        pattern.lengthSteps = 16;
+        pattern.notes.emplace_back(20 + i, 0, 2, 100, 1, 0);
+        pattern.notes.emplace_back(20 + i, 8, 2, 100, 1, 0);
+        files.add(dir.getChildFile(juce::String::formatted("phrase%02d.mid", i)));
+        require(mfpr::MidiExporter::writePatternToFile(pattern, files.getLast(), {}), "The test file must be written.");
+    }
+    files.add(dir.getChildFile("missing.mid")); // unreadable files leave their slot alone
+
+    // Every file lands in its own consecutive slot, delivered as it finishes.
+    {
+        mfpr::AssetLibrary library;
+        std::mutex lock;
+        std::vector<std::pair<int, int>> loaded; // slot, marker note
+        std::unordered_set<std::thread::id> threads;
+
+        mfpr::SlotLoader loader(library,
+                                [&](int slot, std::unique_ptr<mfpr::SlotContent> content)
+                                {
+                                    const std::lock_guard<std::mutex> sl(lock);
+                                    loaded.emplace_back(slot, content->pattern.notes.front().noteNumber);
+                                    threads.insert(std::this_thread::get_id());
+                                },
+                                4);
+        loader.load(110, files); // 18 slots for 25 files
+
+        const auto isLoading = [&]
+        {
+            for (int slot = 110; slot < mfpr::SlotLoader::kMaxSlots; ++slot)
+                if (loader.getProgress(slot) >= 0.0f)
+                    return true;
+            return false;
+        };
+        const auto deadline = juce::Time::getMillisecondCounter() + 20000;
+        while (isLoading() && juce::Time::getMillisecondCounter() < deadline)
+            juce::Thread::sleep(5);
+        require(!isLoading(), "The batch must finish.");
+
+        const std::lock_guard<std::mutex> sl(lock);
+        require(loaded.size() == 18, "Files past the last slot must be ignored.");
+        for (const auto& [slot, note] : loaded)
+            require(note == 20 + slot - 110, "Each file must land in its own slot.");
+
+        juce::Logger::writeToLog(juce::String::formatted("batch import: %d files on %d loader threads", (int) loaded.size(), (int) threads.size()));
+    }
+
+    // Reloading one slot over and over: imports are published in the order they were
+    // requested, however the threads finish, and the last request always wins.
+    {
+        mfpr::AssetLibrary library;
+        std::mutex lock;
+        std::vector<int> published; // marker notes, in publishing order
+
+        mfpr::SlotLoader loader(library,
+                                [&](int, std::unique_ptr<mfpr::SlotContent> content)
+                                {
+                                    const std::lock_guard<std::mutex> sl(lock);
+                                    published.push_back(content->pattern.notes.front().noteNumber);
+                                },
+                                4);
+        for (int i = 0; i < numFiles; ++i)
+        {
+            loader.load(5, files[i]);
+            const auto p = loader.getProgress(5);
+            require(p >= 0.0f && p <= 1.0f, "A queued import must report its progress.");
+        }
+
+        const auto deadline = juce::Time::getMillisecondCounter() + 20000;
+        while (loader.getProgress(5) >= 0.0f && juce::Time::getMillisecondCounter() < deadline)
+            juce::Thread::sleep(5);
+        require(loader.getProgress(5) < 0.0f, "The reloads must finish.");
+
+        const std::lock_guard<std::mutex> sl(lock);
+        require(!published.empty() && published.back() == 20 + numFiles - 1, "The last request must win.");
+        require(std::is_sorted(published.begin(), published.end()) && std::adjacent_find(published.begin(), published.end()) == published.end(),
+                "Imports must be published in request order.");
+    }
+
+    // Through the processor: the bank grows to fit the batch.
+    mfpr::MelodyForgeProAudioProcessor proc;
+    proc.setRateAndBufferSizeDetails(48000.0, 512);
+    proc.prepareToPlay(48000.0, 512);
+    require(proc.importMidiToSamplerSlots(2, files) == numFiles + 1, "Every file must be queued.");
+    require(proc.getSamplerBank().getNumSlots() == numFiles + 3, "The bank must grow to fit the batch.");
+
+    const auto isLoading = [&]
+    {
+        for (int slot = 0; slot < proc.getSamplerBank().getNumSlots(); ++slot)
+            if (proc.getSamplerSlotInfo(slot).loadProgress >= 0.0f)
+                return true;
+        return false;
+    };
+    const auto deadline = juce::Time::getMillisecondCounter() + 20000;
+    while (isLoading() && juce::Time::getMillisecondCounter() < deadline)
+        juce::Thread::sleep(5);
+    for (int i = 0; i <= numFiles; ++i)
+    {
+        const auto info = proc.getSamplerSlotInfo(2 + i);
+        require(info.loadProgress < 0.0f, "The batch must finish.");
+        require(info.hasPhrase == (i < numFiles), "Readable files must fill their slots.");
+    }
+
+    proc.releaseResources();
+    dir.deleteRecursively();
+    return 0;
+}
+
+static int runPlaybackEvents()
+{
+    const int blockSize = 512;
+    juce::ScopedJuceInitialiser_GUI init;
+    mfpr::MelodyForgeProAudioProcessor proc;
+    proc.setRateAndBufferSizeDetails(48000.0, blockSize);
+    proc.prepareToPlay(48000.0, blockSize);
+
+    auto& fifo = proc.getPlaybackEvents();
+    juce::AudioBuffer<float> audio(2, blockSize);
+    juce::MidiBuffer midi;
+
+    // Without a listener nothing is queued.
+    proc.triggerGenerateFromUI();
+    proc.processBlock(audio, midi);
+    waitForGeneratedPattern(proc);
+    for (int block = 0; block < 100 && !proc.isPatternPlaying(); ++block)
+    {
+        midi.clear();
+        proc.processBlock(audio, midi);
+    }
+    require(proc.isPatternPlaying(), "The generated pattern must start.");
+    int numEvents = 0;
+    fifo.drain([&](const mfpr::PlaybackEvent&) { ++numEvents; });
+    require(numEvents == 0, "Nothing must be queued without a listener.");
+
+    // With one, every block reports the step playing and exactly the notes it output. Like the
+    // output's note tables, a note-off ends a pitch however often it was struck.
+    fifo.setListening(true);
+    std::array<int, 128> sounding {};
+    int lastStep = -1, stepChanges = 0;
+    for (int block = 0; block < 400; ++block)
+    {
+        midi.clear();
+        const auto allocations = countAllocationsDuring([&] { proc.processBlock(audio, midi); });
+        require(block == 0 || allocations == 0, "Publishing playback events must not allocate.");
+
+        std::array<int, 128> expected = sounding;
+        for (const auto metadata : midi)
+        {
+            const auto m = metadata.getMessage();
+            if (m.isNoteOn())
+                expected[(size_t) m.getNoteNumber()] = 1;
+            else if (m.isNoteOff())
+                expected[(size_t) m.getNoteNumber()] = 0;
+        }
+
+        const bool complete = fifo.drain([&](const mfpr::PlaybackEvent& e)
+        {
+            if (e.type == mfpr::PlaybackEvent::Type::step)
+            {
+                require(e.step >= 0 && e.step != lastStep, "Steps must only be sent when they change.");
+                lastStep = e.step;
+                ++stepChanges;
+            }
+            else
+            {
+                sounding[e.note] = e.type == mfpr::PlaybackEvent::Type::noteOn ? 1 : 0;
+            }
+        });
+        require(complete, "A drained queue must not overflow.");
+        require(sounding == expected, "Note events must match the block's output.");
+    }
+    // 400 blocks of 512 samples at 120 bpm cover about 34 16th steps.
+    require(stepChanges >= 30, "The playhead must follow the pattern.");
+
+    // A listener that stops draining is told it missed events. Over these ~5 minutes the
+    // step events alone outnumber the queue's capacity.
+    for (int block = 0; block < 30000; ++block)
+    {
+        midi.clear();
+        proc.processBlock(audio, midi);
+    }
+    require(!fifo.drain([](const mfpr::PlaybackEvent&) {}), "Dropped events must be reported.");
+    require(fifo.drain([](const mfpr::PlaybackEvent&) {}), "The overflow is reported once.");
+
+    // A consumer that resets on overflow hears of it before draining what was queued after it.
+    for (int block = 0; block < 30000; ++block)
+    {
+        midi.clear();
+        proc.processBlock(audio, midi);
+    }
+    require(fifo.takeOverflow() && !fifo.takeOverflow(), "takeOverflow() must report dropped events once.");
+    int afterGap = 0;
+    require(fifo.drain([&](const mfpr::PlaybackEvent&) { ++afterGap; }) && afterGap > 0,
+            "The events after the gap must still be delivered, without reporting the gap again.");
+    proc.releaseResources();
+
+    // A pitch struck again while it sounds (two overlapping notes on one layer) is cut by a
+    // single note-off when the layer stops, and must not be left sounding.
+    {
+        mfpr::MelodyForgeProAudioProcessor layered;
+        layered.setRateAndBufferSizeDetails(48000.0, blockSize);
+        layered.prepareToPlay(48000.0, blockSize);
+        layered.getPlaybackEvents().setListening(true);
+
+        mfpr::GeneratedPattern overlapping;
+        overlapping.lengthSteps = 16;
+        overlapping.notes.emplace_back(100, 0, 8, 100, 1, 0);
+        overlapping.notes.emplace_back(100, 2, 8, 100, 1, 0);
+        mfpr::LayerSettings settings;
+        settings.quantise = mfpr::LaunchQuantise::none;
+        layered.getLayerEngine().launch(0, overlapping, settings);
+
+        std::array<int, 128> lit {};
+        int strikes = 0, releases = 0;
+        for (int block = 0; block < 40; ++block) // the second strike comes after ~24 blocks
+        {
+            if (block == 30)
+                layered.getLayerEngine().stopAll();
+            midi.clear();
+            layered.processBlock(audio, midi);
+            layered.getPlaybackEvents().drain([&](const mfpr::PlaybackEvent& e)
+            {
+                if (e.type == mfpr::PlaybackEvent::Type::noteOn)
+                    ++strikes;
+                else if (e.type == mfpr::PlaybackEvent::Type::noteOff)
+                    ++releases;
+                if (e.type != mfpr::PlaybackEvent::Type::step)
+                    lit[e.note] = e.type == mfpr::PlaybackEvent::Type::noteOn ? 1 : 0;
+            });
+        }
+        require(strikes == 2 && releases == 1, "Both strikes and the single cut must be reported.");
+        require(lit[100] == 0, "A pitch ended by one note-off must not stay sounding.");
+        layered.releaseResources();
+    }
+    return 0;
+}
+
+static int runNoteStepIndex()
+{
+    // Range queries report each overlapping note exactly once, matching a full scan.
+    juce::Random rng(42);
+    std::vector<mfpr::PackedNote> notes;
+    for (int i = 0; i < 5000; ++i)
+        notes.emplace_back(rng.nextInt(128), rng.nextInt(4096), 1 + rng.nextInt(rng.nextBool() ? 4 : 200), 100, 1, 0);
+
+    mfpr::NoteStepIndex index;
+    index.build(notes);
+
+    for (int query = 0; query < 500; ++query)
+    {
+        const int from = rng.nextInt(4400) - 100;
+        const int to = from + 1 + rng.nextInt(600);
+
+        std::vector<const mfpr::PackedNote*> found;
+        index.forEachInRange(from, to, [&](const mfpr::PackedNote& n) { found.push_back(&n); });
+
+        std::vector<const mfpr::PackedNote*> expected;
+        for (const auto& n : notes)
+            if (n.getEndStep() > from && n.getStartStep() < to)
+                expected.push_back(&n);
+
+        std::sort(found.begin(), found.end());
+        require(found == expected, "The index must find exactly the notes overlapping the range.");
+    }
+
+    index.clear();
+    int calls = 0;
+    index.forEachInRange(0, 100, [&](const mfpr::PackedNote&) { ++calls; });
+    require(calls == 0, "A cleared index has nothing to find.");
+    return 0;
+}
+
+static int runPatternEditModel()
+{
+    const auto sorted = [](std::vector<mfpr::PackedNote> notes)
+    {
+        std::sort(notes.begin(), notes.end(), [](const mfpr::PackedNote& a, const mfpr::PackedNote& b)
+                  { return std::make_tuple(a.getStartStep(), a.getNoteNumber(), a.getTrack(), a.getLengthSteps(), a.getVelocity(), a.getChannel())
+                         < std::make_tuple(b.getStartStep(), b.getNoteNumber(), b.getTrack(), b.getLengthSteps(), b.getVelocity(), b.getChannel()); });
+        return notes;
+    };
+    const auto flatten = [](const mfpr::PersistentNoteSet& set)
+    {
+        std::vector<mfpr::PackedNote> notes;
+        set.appendTo(notes);
+        return notes;
+    };
+
+    // Random edits against a plain vector, keeping every version along the way.
+    juce::Random rng(7);
+    const auto randomNote = [&] { return mfpr::PackedNote(rng.nextInt(128), rng.nextInt(4096), 1 + rng.nextInt(32), 100, 1, rng.nextInt(2)); };
+
+    std::vector<mfpr::PackedNote> reference;
+    for (int i = 0; i < 20000; ++i)
+        reference.push_back(randomNote());
+
+    auto set = mfpr::PersistentNoteSet::fromNotes(reference);
+    reference = sorted(reference);
+    require(flatten(set) == reference, "A built set must hold the notes in order.");
+
+    std::vector<std::pair<mfpr::PersistentNoteSet, std::vector<mfpr::PackedNote>>> versions;
+    for (int edit = 0; edit < 2000; ++edit)
+    {
+        if (edit % 100 == 0)
+            versions.emplace_back(set, reference);
+
+        if (rng.nextBool())
+        {
+            const auto n = randomNote();
+            set = set.with(n);
+            reference.push_back(n);
+        }
+        else
+        {
+            const auto n = reference[(size_t) rng.nextInt((int) reference.size())];
+            set = set.without(n);
+            reference.erase(std::find(reference.begin(), reference.end(), n));
+        }
+        reference = sorted(reference);
+    }
+    require(flatten(set) == reference && set.size() == (int) reference.size(), "Edits must match the reference.");
+    for (const auto& [version, notes] : versions)
+        require(flatten(version) == notes, "Edits must leave earlier versions untouched.");
+
+    // Hit testing finds the latest-starting note sounding at a cell.
+    for (int query = 0; query < 500; ++query)
+    {
+        const int step = rng.nextInt(4096);
+        const int pitch = rng.nextInt(128);
+        std::optional<mfpr::PackedNote> expected;
+        for (const auto& n : reference)
+            if (n.getNoteNumber() == pitch && n.getStartStep() <= step && n.getEndStep() > step
+                && (!expected.has_value() || n.getStartStep() >= expected->getStartStep()))
+                expected = n;
+
+        const auto found = set.findAt(step, pitch);
+        require(found.has_value() == expected.has_value() && (!found.has_value() || found->getStartStep() == expected->getStartStep()),
+                "findAt must find the note sounding at the cell.");
+    }
+
+    // Edits publish patterns; gestures undo and redo as one step.
+    mfpr::GeneratedPattern pattern;
+    pattern.lengthSteps = 4096;
+    pattern.notes = reference;
+
+    mfpr::PatternEditModel model;
+    model.reset(pattern);
+    require(model.takePattern() == nullptr, "A reset is not an edit to publish.");
+
+    const mfpr::PackedNote a(60, 0, 1, 100, 1, 0);
+    model.beginGesture();
+    model.add(a);
+    for (int length = 2; length <= 8; ++length)
+        model.replace(mfpr::PackedNote(60, 0, length - 1, 100, 1, 0), mfpr::PackedNote(60, 0, length, 100, 1, 0));
+    model.endGesture();
+
+    auto published = model.takePattern();
+    require(published != nullptr && published->notes.size() == reference.size() + 1, "Edits must be published.");
+    require(model.takePattern() == nullptr, "Published edits are not published twice.");
+
+    model.undo();
+    require(model.getNotes().size() == (int) reference.size() && !model.canUndo(), "A drag undoes in one step.");
+    model.redo();
+    require(model.getNotes().findAt(7, 60).has_value(), "Redo restores the drag's result.");
+
+    // History is bounded.
+    for (int i = 0; i < mfpr::PatternEditModel::kMaxUndoSteps + 50; ++i)
+        model.add(mfpr::PackedNote(20, i, 1, 100, 1, 0));
+    int undos = 0;
+    while (model.canUndo())
+    {
+        model.undo();
+        ++undos;
+    }
+    require(undos == mfpr::PatternEditModel::kMaxUndoSteps, "Undo history must keep its last kMaxUndoSteps steps.");
+
+    // Timing: an edit against copying the pattern and searching it, as clicks used to.
+    const int numEdits = 2000;
+    auto start = juce::Time::getMillisecondCounterHiRes();
+    for (int i = 0; i < numEdits; ++i)
+        set = set.with(randomNote());
+    const auto persistentMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+    start = juce::Time::getMillisecondCounterHiRes();
+    size_t sink = 0;
+    for (int i = 0; i < numEdits; ++i)
+    {
+        auto copy = pattern;
+        const auto n = randomNote();
+        sink += size_t(std::find(copy.notes.begin(), copy.notes.end(), n) - copy.notes.begin());
+        copy.notes.push_back(n);
+    }
+    const auto copyMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+    juce::Logger::writeToLog(juce::String::formatted("edit model: %.2f us per edit, %.2f us per copy-and-search edit (%d notes, %d)",
+                                                     persistentMs * 1000.0 / numEdits,
+                                                     copyMs * 1000.0 / numEdits,
+                                                     (int) pattern.notes.size(),
+                                                     int(sink & 1)));
+    return 0;
+}
+
+static int runBenchEditorPaint()
+{
+    juce::ScopedJuceInitialiser_GUI init;
+    mfpr::MelodyForgeProAudioProcessor proc;
+    std::unique_ptr<juce::AudioProcessorEditor> editor(proc.createEditor());
+
+    mfpr::ParticlesComponent* particles = nullptr;
+    for (auto* c : editor->getChildren())
+        if (auto* p = dynamic_cast<mfpr::ParticlesComponent*>(c))
+            particles = p;
+    require(particles != nullptr, "The editor must have a particles layer.");
+
+    juce::Image image(juce::Image::ARGB, editor->getWidth(), editor->getHeight(), true);
+    const int numFrames = 120;
+
+    // Average paint time per frame, of the whole editor or of what the particles repainted.
+    const auto paintFrames = [&](bool animate, bool wholeEditor)
+    {
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            if (animate)
+                particles->advance(1.0 / 30.0);
+
+            juce::Graphics g(image);
+            if (!wholeEditor)
+                g.reduceClipRegion(particles->getLastRepaintedArea());
+            editor->paintEntireComponent(g, false);
+        }
+        return (juce::Time::getMillisecondCounterHiRes() - start) / numFrames;
+    };
+
+    particles->setEnabled(false);
+    const auto offMs = paintFrames(false, true);
+
+    particles->setEnabled(true);
+    const auto wholeMs = paintFrames(true, true); // what repainting the whole overlay cost
+    const auto dirtyMs = paintFrames(true, false);
+
+    // A frame repaints the dots' bounds, a small part of the editor.
+    int64_t dirtyPixels = 0;
+    for (const auto& r : particles->getLastRepaintedArea())
+        dirtyPixels += int64_t(r.getWidth()) * r.getHeight();
+    const auto editorPixels = int64_t(editor->getWidth()) * editor->getHeight();
+    require(dirtyPixels > 0, "Moving particles must repaint something.");
+    require(dirtyPixels * 10 < editorPixels, "A particle frame must repaint under a tenth of the editor.");
+    require(particles->getFrameRateHz() == 30, "Particles start at full frame rate.");
+
+    juce::Logger::writeToLog(juce::String::formatted("editor paint: %.3f ms without particles, %.3f ms per particle frame "
+                                                     "repainting everything, %.3f ms repainting %.2f%% of the editor",
+                                                     offMs,
+                                                     wholeMs,
+                                                     dirtyMs,
+                                                     100.0 * double(dirtyPixels) / double(editorPixels)));
+    return 0;
+}
+
+static int runIdleEditorRepaints()
+{
+    juce::ScopedJuceInitialiser_GUI init;
+    mfpr::MelodyForgeProAudioProcessor proc;
+    std::unique_ptr<juce::AudioProcessorEditor> created(proc.createEditor());
+    auto* editor = dynamic_cast<mfpr::MelodyForgeProAudioEditor*>(created.get());
+    require(editor != nullptr, "The editor must be the plugin's.");
+
+    // Frames as a 60 Hz display would deliver them.
+    double now = juce::Time::getMillisecondCounterHiRes();
+    const auto runFrames = [&](int numFrames)
+    {
+        int repaints = 0;
+        for (int i = 0; i < numFrames; ++i)
+        {
+            now += 1000.0 / 60.0;
+            repaints += editor->update(now);
+        }
+        return repaints;
+    };
+    const int tenSeconds = 600;
+
+    runFrames(1); // takes in the initial state
+    const int idle = runFrames(tenSeconds);
+    require(idle == 0, "An idle editor must not repaint.");
+
+    // Each change repaints what shows it, on the next frame only.
+    mfpr::GeneratedPattern edited;
+    edited.notes.emplace_back(60, 0, 4, 100, 1, 0);
+    proc.setEditedPattern(edited);
+    require(runFrames(1) == 1, "A new pattern must repaint the piano roll.");
+    require(runFrames(tenSeconds) == 0, "A pattern change must repaint once.");
+
+    proc.getSamplerBank().setNumSlots(8);
+    require(runFrames(1) == 1, "A bank change must repaint the sampler slots.");
+    require(runFrames(tenSeconds) == 0, "A bank change must repaint once.");
+
+    proc.getSamplerBank().setTriggerNote(3, 40);
+    require(runFrames(1) == 1, "A trigger note change must repaint the sampler slots.");
+
+    juce::Logger::writeToLog(juce::String::formatted("idle editor: %d repaints over %d frames (10 s at 60 Hz)", idle, tenSeconds));
+    return 0;
+}
+
+static int runLegacySessionState()
+{
+    // A session saved while "mode" was Major/Minor only and "type" had no Markov entry.
+    juce::ValueTree state("Parameters");
+    state.appendChild(juce::ValueTree("PARAM", { { "id", "mode" }, { "value", 1.0f } }), nullptr);
+    state.appendChild(juce::ValueTree("PARAM", { { "id", "type" }, { "value", 2.0f } }), nullptr);
+    juce::MemoryOutputStream saved;
+    state.writeToStream(saved);
+
+    mfpr::MelodyForgeProAudioProcessor proc;
+    proc.setStateInformation(saved.getData(), (int) saved.getDataSize());
+    require(proc.getModeIndex() == 1, "A legacy session must restore its mode.");
+    require(proc.getTypeIndex() == 2, "A legacy session must restore its type.");
+
+    // The new ranges stay out of reach of automation written for the old ones.
+    require(proc.getAPVTS().getParameter("mode") == nullptr, "The legacy mode ID must not be reused.");
+    require(proc.getAPVTS().getParameter("type") == nullptr, "The legacy type ID must not be reused.");
+
+    mfpr::MelodyForgeProAudioProcessor reloaded;
+    juce::MemoryBlock current;
+    proc.getStateInformation(current);
+    reloaded.setStateInformation(current.getData(), (int) current.getSize());
+    require(reloaded.getModeIndex() == 1, "A saved session must restore its mode.");
+    require(reloaded.getTypeIndex() == 2, "A saved session must restore its type.");
+    return 0;
+}
+
 static int runByName(const juce::String& name)
 {
     if (name == "chord_gen_validation")
@@ -188,6 +2500,64 @@ static int runByName(const juce::String& name)
         return runPresetLoadTest();
     if (name == "randomization_variance")
         return runRandomizationVariance();
+    if (name == "parallel_candidates_deterministic")
+        return runParallelCandidatesDeterministic();
+    if (name == "parallel_generation_deterministic")
+        return runParallelGenerationDeterministic();
+    if (name == "markov_generator")
+        return runMarkovGenerator();
+    if (name == "live_harmoniser")
+        return runLiveHarmoniser();
+    if (name == "sample_accurate_triggers")
+        return runSampleAccurateTriggers();
+    if (name == "transport_scheduler")
+        return runTransportScheduler();
+    if (name == "bench_generate")
+        return runBenchGenerate();
+    if (name == "scale_tables_match_reference")
+        return runScaleTablesMatchReference();
+    if (name == "bench_generation_throughput")
+        return runBenchGenerationThroughput();
+    if (name == "batch_generate_smoke")
+        return runBatchGenerateSmoke();
+    if (name == "midi_writer_matches_reference")
+        return runMidiWriterMatchesReference();
+    if (name == "bench_midi_export")
+        return runBenchMidiExport();
+    if (name == "packed_note_round_trip")
+        return runPackedNoteRoundTrip();
+    if (name == "generation_allocations")
+        return runGenerationAllocations();
+    if (name == "streaming_score_matches_score")
+        return runStreamingScoreMatchesScore();
+    if (name == "bench_candidate_search")
+        return runBenchCandidateSearch();
+    if (name == "scoring_model")
+        return runScoringModel();
+    if (name == "bench_scoring_model")
+        return runBenchScoringModel();
+    if (name == "layer_engine")
+        return runLayerEngine();
+    if (name == "async_slot_import")
+        return runAsyncSlotImport();
+    if (name == "sampler_bank")
+        return runSamplerBank();
+    if (name == "bench_process_block")
+        return runBenchProcessBlock();
+    if (name == "batch_slot_import")
+        return runBatchSlotImport();
+    if (name == "playback_events")
+        return runPlaybackEvents();
+    if (name == "note_step_index")
+        return runNoteStepIndex();
+    if (name == "pattern_edit_model")
+        return runPatternEditModel();
+    if (name == "bench_editor_paint")
+        return runBenchEditorPaint();
+    if (name == "idle_editor_repaints")
+        return runIdleEditorRepaints();
+    if (name == "legacy_session_state")
+        return runLegacySessionState();
 
     throw TestFailure("Unknown test name.");
 }
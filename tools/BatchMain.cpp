@@ -0,0 +1,137 @@
+#include "../Source/AssetLibrary.h"
+#include "../Source/BatchGenerator.h"
+#include "../Source/ScoringModel.h"
+#include "../Source/WorkerPool.h"
+
+#include <iostream>
+
+namespace
+{
+static void printUsage()
+{
+    std::cout << "MelodyForgeProBatch --out=<dir> [options]\n"
+                 "\n"
+                 "Generates every combination of the given ranges and writes one .mid file per pattern.\n"
+                 "Ranges are 'first-last' or a single value (indices as in the plugin's menus).\n"
+                 "\n"
+                 "  --genres=0-31      genre indices\n"
+                 "  --keys=0-11        key indices (0 = C)\n"
+                 "  --modes=0-1        mode indices (0 = Major, 1 = Minor, ... 9 = Minor Pentatonic)\n"
+                 "  --lengths=0        length indices (0 = 4 bars, 1 = 8, 2 = 12, 3 = 16)\n"
+                 "  --types=0-2        type indices (0 = Chord, 1 = Melody, 2 = Hybrid, 3 = Markov)\n"
+                 "  --seeds=1          generator seeds\n"
+                 "  --candidates=1     best-of-N per file (1..256)\n"
+                 "  --weights=<file>   scoring weights JSON used to rank the candidates\n"
+                 "  --root=60          input root note\n"
+                 "  --bpm=128          tempo written to the files\n"
+                 "  --threads=N        worker threads (default: all cores)\n";
+}
+
+static bool parseRange(const juce::String& text, mfpr::BatchGenerator::IntRange& range)
+{
+    const auto t = text.trim();
+    if (t.isEmpty())
+        return true;
+
+    if (!t.containsOnly("0123456789-"))
+        return false;
+
+    if (t.containsChar('-'))
+    {
+        range.first = t.upToFirstOccurrenceOf("-", false, false).getIntValue();
+        range.last = t.fromFirstOccurrenceOf("-", false, false).getIntValue();
+    }
+    else
+    {
+        range.first = range.last = t.getIntValue();
+    }
+    return range.first <= range.last;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    juce::ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h") || !args.containsOption("--out"))
+    {
+        printUsage();
+        return args.containsOption("--help|-h") ? 0 : 1;
+    }
+
+    mfpr::BatchGenerator::Grid grid;
+    const std::array<std::pair<const char*, mfpr::BatchGenerator::IntRange*>, 6> ranges = { {
+        { "--genres", &grid.genres },
+        { "--keys", &grid.keys },
+        { "--modes", &grid.modes },
+        { "--lengths", &grid.lengths },
+        { "--types", &grid.types },
+        { "--seeds", &grid.seeds },
+    } };
+
+    for (const auto& r : ranges)
+    {
+        if (!parseRange(args.getValueForOption(r.first), *r.second))
+        {
+            std::cerr << "Invalid range for " << r.first << "\n";
+            return 1;
+        }
+    }
+
+    mfpr::BatchGenerator::Settings settings;
+    settings.outputDir = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--out"));
+    settings.candidates = juce::jlimit(1, mfpr::CandidateSearchSettings::kMaxCandidates, args.getValueForOption("--candidates").getIntValue());
+    if (args.containsOption("--root"))
+        settings.rootNote = juce::jlimit(0, 127, args.getValueForOption("--root").getIntValue());
+    if (args.containsOption("--bpm"))
+        settings.midi.bpm = juce::jlimit(20.0, 999.0, args.getValueForOption("--bpm").getDoubleValue());
+
+    mfpr::ScoringModel scoringModel;
+    if (args.containsOption("--weights"))
+    {
+        const auto weightsFile = args.getFileForOption("--weights");
+        if (!scoringModel.loadFromFile(weightsFile))
+        {
+            std::cerr << "Invalid scoring weights in " << weightsFile.getFullPathName() << "\n";
+            return 1;
+        }
+        settings.scoringModel = &scoringModel;
+    }
+
+    // Out-of-range indices are clamped, so report the grid that will actually be generated.
+    const auto numPatterns = mfpr::BatchGenerator::sanitise(grid).getNumPatterns();
+    if (numPatterns > mfpr::BatchGenerator::kMaxPatterns)
+    {
+        std::cerr << "The grid has " << numPatterns << " patterns, more than the "
+                  << mfpr::BatchGenerator::kMaxPatterns << " one run can generate\n";
+        return 1;
+    }
+
+    if (!settings.outputDir.createDirectory())
+    {
+        std::cerr << "Cannot create " << settings.outputDir.getFullPathName() << "\n";
+        return 1;
+    }
+
+    const int threads = args.containsOption("--threads") ? args.getValueForOption("--threads").getIntValue()
+                                                         : juce::SystemStats::getNumCpus();
+
+    mfpr::AssetLibrary library;
+    mfpr::WorkerPool pool(threads - 1);
+
+    std::cout << "Generating " << numPatterns << " patterns into " << settings.outputDir.getFullPathName() << "\n";
+
+    const auto result = mfpr::BatchGenerator::run(library, grid, settings, &pool, [](int done, int total)
+    {
+        std::cout << "\r" << done << " / " << total << std::flush;
+        return true;
+    });
+
+    std::cout << "\nWrote " << result.written << " files in " << result.seconds << " s ("
+              << (result.seconds > 0.0 ? int(result.written / result.seconds) : 0) << " files/s)";
+    if (result.failed > 0)
+        std::cout << ", " << result.failed << " failed";
+    std::cout << "\n";
+
+    return result.failed == 0 ? 0 : 2;
+}